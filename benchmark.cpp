@@ -0,0 +1,568 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <opencv2/calib3d.hpp>
+
+#include "AllocationCounter.h"
+#include "Calibration.h"
+#include "CornerCache.h"
+#include "RigCalibration.h"
+#include "SyntheticBoard.h"
+
+/// Calibration benchmark against ground truth: renders sets of synthetic
+/// calibN.png images under known intrinsics, distortion and poses, then runs
+/// the calibration on them and reports its cost and how far the results are
+/// from the values the images were made with. The pose command times the
+/// per-frame object matrix math on its own, the rig command checks the rig
+/// calibration on synthetic corners.
+
+/// Inner corners and square side of the project's chessboard
+const cv::Size defaultPatternSize = cv::Size(6, 9);
+constexpr double defaultSquareSide = 0.023;
+
+using Clock = std::chrono::steady_clock;
+using Milliseconds = std::chrono::duration<double, std::milli>;
+
+void printUsage(const char* program) {
+    std::fprintf(stderr,
+                 "Usage: %s generate DIR [--views N] [--noise S] [--blur S] [--seed N] [--resolution WxH] [--pattern WxH]\n"
+                 "                       [--square M]\n"
+                 "       %s calibrate DIR... [--cached] [--all-views] [--solver NAME]...\n"
+                 "       %s pose [--calls N]\n"
+                 "       %s allocations\n"
+                 "       %s rig [--observations N]\n"
+                 "  generate           render a set of calibN.png images and their ground truth into DIR\n"
+                 "  --views N          images in the set (default 30)\n"
+                 "  --noise S          standard deviation of the gray level noise (default 2)\n"
+                 "  --blur S           standard deviation of the blur in pixels, 0 for none (default 0.5)\n"
+                 "  --seed N           seed of the random poses and noise (default 1)\n"
+                 "  --resolution WxH   camera resolution (default 640x480)\n"
+                 "  --pattern WxH      inner corners per row and column (default 6x9)\n"
+                 "  --square M         side of a square in meters (default 0.023)\n"
+                 "  calibrate          load and calibrate every set and compare with its ground truth\n"
+                 "  --cached           keep the corner cache of earlier runs instead of detecting again\n"
+                 "  --all-views        calibrate from every view instead of a diverse subset\n"
+                 "  --solver NAME      calibration solver: sparse (default) or opencv, repeat to compare them\n"
+                 "  pose               time turning a board pose into the object matrix, cv::Mat against fixed size\n"
+                 "  --calls N          conversions per variant (default 1000000)\n"
+                 "  allocations        check that the allocation counter of --check-allocations sees cv::Mat buffers\n"
+                 "  rig                calibrate a synthetic rig of three cameras, one of which finds the corners in reverse\n"
+                 "  --observations N   board positions seen by the rig (default 40)\n",
+                 program, program, program, program, program);
+}
+
+/// Largest and RMS distance between where the true and the estimated camera
+/// model put the same rays, over a grid covering the image
+void modelError(const SyntheticBoard::CameraModel& truth, const Intrinsics& estimate, double& rms, double& max) {
+    std::vector<cv::Point2d> pixels;
+    for (int y = 0; y <= 12; ++y) {
+        for (int x = 0; x <= 16; ++x) {
+            pixels.emplace_back(x * (truth.Resolution.width - 1) / 16.0, y * (truth.Resolution.height - 1) / 12.0);
+        }
+    }
+    std::vector<cv::Point2d> rays;
+    cv::undistortPoints(pixels, rays, truth.CameraMatrix, truth.DistortionCoefficients);
+    std::vector<cv::Point3d> points;
+    for (const auto& ray : rays) {
+        points.emplace_back(ray.x, ray.y, 1.0);
+    }
+    std::vector<cv::Point2d> projected;
+    cv::projectPoints(points, cv::Vec3d(), cv::Vec3d(), estimate.CameraMatrix, estimate.DistortionCoefficients, projected);
+    double squared = 0.0;
+    max = 0.0;
+    for (size_t i = 0; i < pixels.size(); ++i) {
+        const double distance = cv::norm(projected[i] - pixels[i]);
+        squared += distance * distance;
+        max = std::max(max, distance);
+    }
+    rms = std::sqrt(squared / pixels.size());
+}
+
+/// Rotation in degrees and translation in millimeters between an estimated and
+/// the true pose. The board looks the same turned half way around, so the
+/// detector may number its corners from the other end; the closer of both is used.
+void poseError(const SyntheticBoard::View& truth, const cv::Vec3d& rotation, const cv::Vec3d& translation, const cv::Size& patternSize, double squareSide,
+               double& rotationError, double& translationError) {
+    cv::Matx33d trueRotation;
+    cv::Matx33d estimatedRotation;
+    cv::Rodrigues(truth.Rotation, trueRotation);
+    cv::Rodrigues(rotation, estimatedRotation);
+    const cv::Matx33d halfTurn(-1.0, 0.0, 0.0, 0.0, -1.0, 0.0, 0.0, 0.0, 1.0);
+    const cv::Vec3d center(0.5 * (patternSize.width - 1) * squareSide, 0.5 * (patternSize.height - 1) * squareSide, 0.0);
+    const cv::Matx33d candidates[2] = {trueRotation, trueRotation * halfTurn};
+    const cv::Vec3d candidateTranslations[2] = {truth.Translation, truth.Translation + 2.0 * (trueRotation * center)};
+    rotationError = 360.0;
+    for (int i = 0; i < 2; ++i) {
+        cv::Vec3d difference;
+        cv::Rodrigues(estimatedRotation.t() * candidates[i], difference);
+        const double angle = cv::norm(difference) * 180.0 / CV_PI;
+        if (angle < rotationError) {
+            rotationError = angle;
+            translationError = 1000.0 * cv::norm(translation - candidateTranslations[i]);
+        }
+    }
+}
+
+int generate(const std::string& directory, int argc, char* argv[], int first) {
+    SyntheticBoard::GroundTruth truth;
+    cv::Size resolution(640, 480);
+    truth.PatternSize = defaultPatternSize;
+    truth.SquareSide = defaultSquareSide;
+    truth.Noise = 2.0;
+    truth.Blur = 0.5;
+    uint32_t views = 30;
+    uint64_t seed = 1;
+    for (int i = first; i < argc; ++i) {
+        std::string_view arg = argv[i];
+        if (arg == "--views" && i + 1 < argc) {
+            views = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (arg == "--noise" && i + 1 < argc) {
+            truth.Noise = std::stod(argv[++i]);
+        } else if (arg == "--blur" && i + 1 < argc) {
+            truth.Blur = std::stod(argv[++i]);
+        } else if (arg == "--seed" && i + 1 < argc) {
+            seed = std::stoull(argv[++i]);
+        } else if (arg == "--resolution" && i + 1 < argc) {
+            if (std::sscanf(argv[++i], "%dx%d", &resolution.width, &resolution.height) != 2 || resolution.width < 16 || resolution.height < 16) {
+                std::fprintf(stderr, "Invalid resolution %s, expected WxH\n", argv[i]);
+                return EXIT_FAILURE;
+            }
+        } else if (arg == "--pattern" && i + 1 < argc) {
+            if (std::sscanf(argv[++i], "%dx%d", &truth.PatternSize.width, &truth.PatternSize.height) != 2 || truth.PatternSize.width < 2 ||
+                truth.PatternSize.height < 2) {
+                std::fprintf(stderr, "Invalid pattern size %s, expected WxH\n", argv[i]);
+                return EXIT_FAILURE;
+            }
+        } else if (arg == "--square" && i + 1 < argc) {
+            truth.SquareSide = std::stod(argv[++i]);
+        } else {
+            printUsage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    cv::RNG rng(seed);
+    truth.Camera = SyntheticBoard::defaultCamera(resolution);
+    truth.Views = SyntheticBoard::randomViews(truth.Camera, truth.PatternSize, truth.SquareSide, views, rng);
+    if (truth.Views.size() < views) {
+        std::fprintf(stderr, "Only found %zu poses with the whole board in view\n", truth.Views.size());
+    }
+    const auto start = Clock::now();
+    if (!SyntheticBoard::writeSet(directory, truth, rng)) {
+        return EXIT_FAILURE;
+    }
+    std::printf("Rendered %zu views into %s in %.1f ms\n", truth.Views.size(), directory.c_str(), Milliseconds(Clock::now() - start).count());
+    return EXIT_SUCCESS;
+}
+
+/// Compare the current intrinsics of calibration with the ground truth and print them as a row
+bool report(const std::string& directory, const SyntheticBoard::GroundTruth& truth, const Calibration& calibration, double loadMs, double calibrationMs) {
+    const auto intrinsics = calibration.GetIntrinsics();
+    const char* solver = CalibrationWorker::getSolverName(calibration.Solver);
+    if (!intrinsics) {
+        std::printf("%-24s %-7s %3zu/%-3zu calibration failed\n", directory.c_str(), solver, calibration.CalibImageNames.size(), truth.Views.size());
+        return false;
+    }
+    const auto& trueCamera = truth.Camera.CameraMatrix;
+    const double focalError = std::max(std::abs(intrinsics->CameraMatrix(0, 0) - trueCamera(0, 0)), std::abs(intrinsics->CameraMatrix(1, 1) - trueCamera(1, 1)));
+    const double centerError = std::hypot(intrinsics->CameraMatrix(0, 2) - trueCamera(0, 2), intrinsics->CameraMatrix(1, 2) - trueCamera(1, 2));
+    double modelRms = 0.0;
+    double modelMax = 0.0;
+    modelError(truth.Camera, *intrinsics, modelRms, modelMax);
+
+    double rotationError = 0.0;
+    double translationError = 0.0;
+    size_t poses = 0;
+    for (size_t i = 0; i < calibration.CalibImageNames.size() && static_cast<int>(i) < intrinsics->RotationVectors.rows; ++i) {
+        // calibN.png is view N of the ground truth
+        const auto& name = calibration.CalibImageNames[i];
+        const size_t view = std::stoul(name.substr(5, name.size() - 9));
+        if (view >= truth.Views.size()) {
+            continue;
+        }
+        double rotation = 0.0;
+        double translation = 0.0;
+        poseError(truth.Views[view], intrinsics->RotationVectors.at<cv::Vec3d>(static_cast<int>(i)),
+                  intrinsics->TranslationVectors.at<cv::Vec3d>(static_cast<int>(i)), truth.PatternSize, truth.SquareSide, rotation, translation);
+        rotationError += rotation;
+        translationError += translation;
+        ++poses;
+    }
+    if (poses > 0) {
+        rotationError /= poses;
+        translationError /= poses;
+    }
+    std::printf("%-24s %-7s %3zu/%-3zu %10.1f %10.1f %8.3f %8.3f %8.3f %9.3f %9.3f %9.4f %9.3f\n", directory.c_str(), solver,
+                calibration.CalibImageNames.size(), truth.Views.size(), loadMs, calibrationMs, intrinsics->ReprojectionError, focalError, centerError,
+                modelRms, modelMax, rotationError, translationError);
+    return true;
+}
+
+int calibrate(const std::vector<std::string>& directories, const std::vector<CalibrationWorker::Solver>& solvers, bool cached, bool allViews) {
+    std::printf("%-24s %-7s %7s %10s %10s %8s %8s %8s %9s %9s %9s %9s\n", "set", "solver", "found", "load ms", "calib ms", "rms px", "df px", "dc px",
+                "model px", "model max", "rot deg", "trans mm");
+    bool failed = false;
+    for (const auto& directory : directories) {
+        SyntheticBoard::GroundTruth truth;
+        if (!SyntheticBoard::readGroundTruth(directory, truth)) {
+            std::fprintf(stderr, "No ground truth in %s\n", directory.c_str());
+            failed = true;
+            continue;
+        }
+        if (!cached) {
+            std::error_code error;
+            std::filesystem::remove(std::filesystem::path(directory) / CornerCacheFileName, error);
+        }
+
+        Calibration calibration(truth.PatternSize, truth.Camera.Resolution, static_cast<float>(truth.SquareSide));
+        calibration.ViewSelection = !allViews;
+        calibration.Solver = solvers.front();
+        // only detecting the board in every image or reading the corner cache
+        auto start = Clock::now();
+        calibration.LoadFromDirectory(directory, false);
+        const double loadMs = Milliseconds(Clock::now() - start).count();
+        // every solver on its own, without loading
+        for (const auto solver : solvers) {
+            calibration.Solver = solver;
+            start = Clock::now();
+            calibration.CalcCameraMat();
+            calibration.WaitForCalibration();
+            const double calibrationMs = Milliseconds(Clock::now() - start).count();
+            failed = !report(directory, truth, calibration, loadMs, calibrationMs) || failed;
+        }
+    }
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/// The object matrix the way UpdateRotTransMat built it before
+/// Calibration::PoseToObjectMatrix, through heap-backed cv::Mat temporaries
+void matObjectMatrix(const cv::Mat& rotationVector, const cv::Mat& translationVector, float scaling_factor, mat4& objectMatrix) {
+    cv::Mat rotation = cv::Mat::eye(3, 3, rotationVector.type());
+    cv::Rodrigues(rotationVector, rotation);
+    cv::Mat finalMatrix = scaling_factor * cv::Mat::eye(4, 4, rotation.type());
+    finalMatrix.at<double>(3, 3) = 1.0;
+    finalMatrix(cv::Range(0, 3), cv::Range(0, 3)) *= rotation;
+    finalMatrix(cv::Range(0, 3), cv::Range(3, 4)) = translationVector * -1;
+    finalMatrix = finalMatrix.t();
+    for (int i = 0; i < 16; ++i) {
+        objectMatrix[i] = static_cast<float>(finalMatrix.at<double>(i));
+    }
+}
+
+/// Per call cost of the old and the fixed size object matrix over random
+/// board poses, and the largest difference between their results
+int pose(uint64_t calls) {
+    constexpr size_t poseCount = 1024;
+    cv::RNG rng(1);
+    std::vector<cv::Vec3d> rotations(poseCount);
+    std::vector<cv::Vec3d> translations(poseCount);
+    std::vector<cv::Mat> rotationMats(poseCount);
+    std::vector<cv::Mat> translationMats(poseCount);
+    for (size_t i = 0; i < poseCount; ++i) {
+        rotations[i] = cv::Vec3d(rng.uniform(-CV_PI, CV_PI), rng.uniform(-CV_PI, CV_PI), rng.uniform(-CV_PI, CV_PI)) * (1.0 / std::sqrt(3.0));
+        translations[i] = cv::Vec3d(rng.uniform(-0.5, 0.5), rng.uniform(-0.5, 0.5), rng.uniform(0.2, 2.0));
+        rotationMats[i] = cv::Mat(rotations[i]).clone();
+        translationMats[i] = cv::Mat(translations[i]).clone();
+    }
+    const auto scale = static_cast<float>(defaultSquareSide);
+
+    // summed so neither loop can be optimized away
+    double checksum = 0.0;
+    mat4 objectMatrix;
+    auto start = Clock::now();
+    for (uint64_t i = 0; i < calls; ++i) {
+        matObjectMatrix(rotationMats[i % poseCount], translationMats[i % poseCount], scale, objectMatrix);
+        checksum += objectMatrix[i % 16];
+    }
+    const double matNs = 1e6 * Milliseconds(Clock::now() - start).count() / static_cast<double>(calls);
+    start = Clock::now();
+    for (uint64_t i = 0; i < calls; ++i) {
+        Calibration::PoseToObjectMatrix(rotations[i % poseCount], translations[i % poseCount], scale, objectMatrix);
+        checksum += objectMatrix[i % 16];
+    }
+    const double matxNs = 1e6 * Milliseconds(Clock::now() - start).count() / static_cast<double>(calls);
+
+    float maxDifference = 0.0f;
+    for (size_t i = 0; i < poseCount; ++i) {
+        mat4 expected;
+        matObjectMatrix(rotationMats[i], translationMats[i], scale, expected);
+        Calibration::PoseToObjectMatrix(rotations[i], translations[i], scale, objectMatrix);
+        for (int j = 0; j < 16; ++j) {
+            maxDifference = std::max(maxDifference, std::abs(expected[j] - objectMatrix[j]));
+        }
+    }
+
+    std::printf("%-8s %10s\n", "variant", "ns/call");
+    std::printf("%-8s %10.1f\n", "mat", matNs);
+    std::printf("%-8s %10.1f\n", "matx", matxNs);
+    std::printf("speedup %.1fx, largest difference %.3g (checksum %.3f)\n", matNs / matxNs, maxDifference, checksum);
+    // both compute the same matrix up to rounding
+    return maxDifference < 1e-5f ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/// Frame loops run through the allocation counter like the --check-allocations
+/// of the tracking UI. Loops which create a cv::Mat every frame outside of an
+/// ExternalScope have to be flagged, loops which reuse their buffers not.
+int allocations() {
+    AllocationCounter::installMatAllocator();
+    constexpr uint64_t warmupFrames = 10;
+    constexpr uint64_t checkedFrames = 100;
+    // frames after warm-up which made an owned allocation
+    auto countAllocatingFrames = [](auto&& frame) {
+        uint64_t allocatingFrames = 0;
+        for (uint64_t i = 0; i < warmupFrames + checkedFrames; ++i) {
+            const auto start = AllocationCounter::get();
+            frame();
+            const auto end = AllocationCounter::get();
+            if (i >= warmupFrames && end.Owned > start.Owned) {
+                ++allocatingFrames;
+            }
+        }
+        return allocatingFrames;
+    };
+
+    cv::Mat reused;
+    const cv::Mat rotationVector(cv::Vec3d(0.1, 0.2, 0.3), true);
+    const cv::Mat translationVector(cv::Vec3d(0.0, 0.0, 1.0), true);
+    mat4 objectMatrix;
+    struct Case {
+        const char* Name;
+        uint64_t AllocatingFrames;
+        uint64_t Expected;
+    };
+    const Case cases[] = {
+        {"reused mat", countAllocatingFrames([&]() { reused.create(480, 640, CV_8UC3); }), 0},
+        {"mat per frame", countAllocatingFrames([]() { cv::Mat temporary(480, 640, CV_8UC3); }), checkedFrames},
+        {"mat in external scope", countAllocatingFrames([]() {
+             AllocationCounter::ExternalScope opencv;
+             cv::Mat temporary(480, 640, CV_8UC3);
+         }), 0},
+        {"mat pose math", countAllocatingFrames([&]() { matObjectMatrix(rotationVector, translationVector, 1.0f, objectMatrix); }), checkedFrames},
+        {"matx pose math", countAllocatingFrames([&]() {
+             Calibration::PoseToObjectMatrix(cv::Vec3d(0.1, 0.2, 0.3), cv::Vec3d(0.0, 0.0, 1.0), 1.0f, objectMatrix);
+         }), 0},
+    };
+
+    bool failed = false;
+    std::printf("%-24s %18s %9s\n", "case", "allocating frames", "expected");
+    for (const auto& check : cases) {
+        std::printf("%-24s %18llu %9llu\n", check.Name, static_cast<unsigned long long>(check.AllocatingFrames),
+                    static_cast<unsigned long long>(check.Expected));
+        failed = failed || check.AllocatingFrames != check.Expected;
+    }
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/// Rig calibration from the noisy corners of three synthetic cameras.
+/// Camera 1 numbers every board in reverse and camera 2 every third one, like
+/// chessboard detections do when the board appears turned half around. Fails
+/// if the extrinsics or the fused board poses are off.
+int rig(uint32_t observationCount) {
+    constexpr size_t cameraCount = 3;
+    // a detector finds the corners to about 0.2 px
+    constexpr double cornerNoise = 0.2;
+    constexpr double maxExtrinsicsDegrees = 0.2;
+    constexpr double maxExtrinsicsMm = 3.0;
+    constexpr double maxFusedDegrees = 0.5;
+    constexpr double maxFusedMm = 5.0;
+    cv::RNG rng(1);
+    const auto camera = SyntheticBoard::defaultCamera(cv::Size(640, 480));
+    auto intrinsics = std::make_shared<Intrinsics>();
+    intrinsics->CameraMatrix = camera.CameraMatrix;
+    intrinsics->DistortionCoefficients = cv::Mat(camera.DistortionCoefficients, true);
+    CalibrationWorker::toProjection(intrinsics->CameraMatrix, intrinsics->ProjMat);
+    const std::vector<std::shared_ptr<const Intrinsics>> cameraIntrinsics(cameraCount, intrinsics);
+
+    // camera 0 into every camera, side by side and turned a little towards each other
+    std::vector<RigCalibration::Pose> truth = {
+        {cv::Vec3d(), cv::Vec3d()},
+        {cv::Vec3d(0.02, -0.25, 0.01), cv::Vec3d(0.25, 0.01, 0.03)},
+        {cv::Vec3d(-0.03, 0.2, -0.02), cv::Vec3d(-0.2, -0.02, 0.01)},
+    };
+    std::vector<cv::Vec3f> objectPoints;
+    for (int j = 0; j < defaultPatternSize.height; ++j) {
+        for (int i = 0; i < defaultPatternSize.width; ++i) {
+            objectPoints.emplace_back(static_cast<float>(i * defaultSquareSide), static_cast<float>(j * defaultSquareSide), 0.0f);
+        }
+    }
+
+    RigCalibration calibration(cameraCount, objectPoints);
+    const auto boards = SyntheticBoard::randomViews(camera, defaultPatternSize, defaultSquareSide, observationCount, rng);
+    // corners every camera found of the boards at least two cameras saw, empty
+    // if it was not fully in view, and which board they are of
+    std::vector<std::vector<std::vector<cv::Point2f>>> observations;
+    std::vector<size_t> observedBoards;
+    std::vector<cv::Point2f> projected;
+    for (size_t o = 0; o < boards.size(); ++o) {
+        std::vector<std::vector<cv::Point2f>> points(cameraCount);
+        for (size_t c = 0; c < cameraCount; ++c) {
+            cv::Vec3d rotation = boards[o].Rotation;
+            cv::Vec3d translation = boards[o].Translation;
+            if (c > 0) {
+                cv::composeRT(boards[o].Rotation, boards[o].Translation, truth[c].RotationVector, truth[c].TranslationVector, rotation, translation);
+            }
+            cv::projectPoints(objectPoints, rotation, translation, camera.CameraMatrix, camera.DistortionCoefficients, projected);
+            const bool inView = translation[2] > 0.0 && std::all_of(projected.begin(), projected.end(), [&camera](const cv::Point2f& point) {
+                return point.x >= 0.0f && point.y >= 0.0f && point.x < camera.Resolution.width && point.y < camera.Resolution.height;
+            });
+            if (!inView) {
+                continue;
+            }
+            for (auto& point : projected) {
+                point += cv::Point2f(static_cast<float>(rng.gaussian(cornerNoise)), static_cast<float>(rng.gaussian(cornerNoise)));
+            }
+            if (c == 1 || (c == 2 && o % 3 == 0)) {
+                std::reverse(projected.begin(), projected.end());
+            }
+            points[c] = projected;
+        }
+        if (calibration.addObservation(points)) {
+            observations.push_back(std::move(points));
+            observedBoards.push_back(o);
+        }
+    }
+
+    const auto start = Clock::now();
+    if (!calibration.calibrate(cameraIntrinsics, 50)) {
+        return EXIT_FAILURE;
+    }
+    std::printf("Calibrated %zu cameras from %zu observations in %.1f ms, reprojection error %.3f px\n", cameraCount, calibration.getObservationCount(),
+                Milliseconds(Clock::now() - start).count(), calibration.getError());
+
+    // distance between two poses as rotation angle and translation
+    auto poseDistance = [](const RigCalibration::Pose& a, const RigCalibration::Pose& b, double& degrees, double& mm) {
+        cv::Matx33d rotationA;
+        cv::Matx33d rotationB;
+        cv::Rodrigues(a.RotationVector, rotationA);
+        cv::Rodrigues(b.RotationVector, rotationB);
+        degrees = std::acos(std::clamp(0.5 * (cv::trace(rotationA.t() * rotationB) - 1.0), -1.0, 1.0)) * 180.0 / CV_PI;
+        mm = 1000.0 * cv::norm(a.TranslationVector - b.TranslationVector);
+    };
+    bool failed = false;
+    std::printf("%-8s %9s %9s\n", "camera", "rot deg", "trans mm");
+    for (size_t c = 1; c < cameraCount; ++c) {
+        double degrees = 0.0;
+        double mm = 0.0;
+        poseDistance(calibration.getExtrinsics()[c], truth[c], degrees, mm);
+        std::printf("%-8zu %9.4f %9.3f\n", c, degrees, mm);
+        failed = failed || degrees > maxExtrinsicsDegrees || mm > maxExtrinsicsMm;
+    }
+
+    // every camera poses the board on its own, in whichever order it found the corners
+    double worstDegrees = 0.0;
+    double worstMm = 0.0;
+    std::vector<std::optional<RigCalibration::Pose>> poses(cameraCount);
+    for (size_t o = 0; o < observations.size(); ++o) {
+        const auto& points = observations[o];
+        const auto& board = boards[observedBoards[o]];
+        for (size_t c = 0; c < cameraCount; ++c) {
+            poses[c].reset();
+            cv::Vec3d rotation;
+            cv::Vec3d translation;
+            if (!points[c].empty() && cv::solvePnP(objectPoints, points[c], camera.CameraMatrix, camera.DistortionCoefficients, rotation, translation)) {
+                poses[c] = RigCalibration::Pose{rotation, translation};
+            }
+        }
+        RigCalibration::Pose fused;
+        if (!RigCalibration::fusePoses(truth, poses, objectPoints, fused)) {
+            continue;
+        }
+        double degrees = 0.0;
+        double mm = 0.0;
+        poseDistance(fused, RigCalibration::Pose{board.Rotation, board.Translation}, degrees, mm);
+        worstDegrees = std::max(worstDegrees, degrees);
+        worstMm = std::max(worstMm, mm);
+    }
+    std::printf("fused board poses: worst %.4f deg, %.3f mm\n", worstDegrees, worstMm);
+    failed = failed || worstDegrees > maxFusedDegrees || worstMm > maxFusedMm;
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        printUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    const std::string_view command = argv[1];
+    if (command == "pose") {
+        uint64_t calls = 1000000;
+        for (int i = 2; i < argc; ++i) {
+            std::string_view arg = argv[i];
+            if (arg == "--calls" && i + 1 < argc) {
+                calls = std::max<uint64_t>(std::stoull(argv[++i]), 1);
+            } else {
+                printUsage(argv[0]);
+                return EXIT_FAILURE;
+            }
+        }
+        return pose(calls);
+    }
+    if (command == "allocations") {
+        return allocations();
+    }
+    if (command == "rig") {
+        uint32_t observations = 40;
+        for (int i = 2; i < argc; ++i) {
+            std::string_view arg = argv[i];
+            if (arg == "--observations" && i + 1 < argc) {
+                observations = std::max<uint32_t>(static_cast<uint32_t>(std::stoul(argv[++i])), 1);
+            } else {
+                printUsage(argv[0]);
+                return EXIT_FAILURE;
+            }
+        }
+        return rig(observations);
+    }
+    if (argc < 3) {
+        printUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (command == "generate") {
+        return generate(argv[2], argc, argv, 3);
+    }
+    if (command == "calibrate") {
+        std::vector<std::string> directories;
+        bool cached = false;
+        bool allViews = false;
+        std::vector<CalibrationWorker::Solver> solvers;
+        for (int i = 2; i < argc; ++i) {
+            std::string_view arg = argv[i];
+            if (arg == "--solver" && i + 1 < argc) {
+                CalibrationWorker::Solver solver;
+                if (!CalibrationWorker::parseSolver(argv[++i], solver)) {
+                    std::fprintf(stderr, "Unknown solver %s\n", argv[i]);
+                    return EXIT_FAILURE;
+                }
+                solvers.push_back(solver);
+            } else if (arg == "--cached") {
+                cached = true;
+            } else if (arg == "--all-views") {
+                allViews = true;
+            } else if (arg.substr(0, 2) == "--") {
+                printUsage(argv[0]);
+                return EXIT_FAILURE;
+            } else {
+                directories.emplace_back(arg);
+            }
+        }
+        if (directories.empty()) {
+            printUsage(argv[0]);
+            return EXIT_FAILURE;
+        }
+        if (solvers.empty()) {
+            solvers.push_back(CalibrationWorker::Solver::Sparse);
+        }
+        return calibrate(directories, solvers, cached, allViews);
+    }
+    printUsage(argv[0]);
+    return EXIT_FAILURE;
+}
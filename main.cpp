@@ -1,22 +1,36 @@
 #include <SDL2/SDL.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
 #include <cstdlib>
 #include <iostream>
 #include <opencv2/core/opengl.hpp>
 
 #include <opencv2/videoio.hpp>
 #include <string_view>
+#include <vector>
 
 #include <opencv2/highgui.hpp> // saving images
 #include <Ui.h>
 #include <Texture.h>
 
+#include "AllocationCounter.h"
+#include "FrameArena.h"
+#include "FrameSource.h"
 #include "Calibration.h"
 #include "IndexedMesh.h"
+#include "IntrinsicsStore.h"
+#include "LatencyStats.h"
+#include "PatternDetector.h"
 #include "Pipeline.h"
 #include "RenderPass.h"
 #include "Renderer.h"
+#include "Tracker.h"
+#include "Undistorter.h"
 
-const cv::Size patternSize = cv::Size(6, 9);
+/// Inner corners of the default chessboard
+const cv::Size defaultPatternSize = cv::Size(6, 9);
 
 // just copy a glsl file in here with the vertex shader
 constexpr std::string_view vertexShaderSource =
@@ -110,10 +124,75 @@ constexpr std::string_view cubeFragmentShaderSource =
 
 
 int main(int argc, char* argv[]) {
-    // Select video source from command line argument 1 (an int)
-    int videoSourceIndex = 0;
-    if (argc > 1) {
-        videoSourceIndex = std::stoi(argv[1]);
+    // cv::Mat buffers bypass operator new, count them too
+    AllocationCounter::installMatAllocator();
+
+    // Select video sources from the positional arguments: camera indices,
+    // video files or numbered image sequences such as frames/frame%04d.png.
+    // Every source gets its own calibration and tracking thread.
+    std::vector<std::string> videoSourceUris;
+    auto pacing = FrameSource::Pacing::RealTime;
+    double sequenceFps = 30.0;
+    // frames after which any heap allocation outside of OpenCV counts as a failure, 0 disables the check
+    uint64_t allocationCheckWarmup = 0;
+    // where per-stage latency percentiles are written as JSON on exit
+    std::string latencyDumpPath;
+    // raw recordings of the sources in order, see FrameRecorder
+    std::vector<std::string> recordingPaths;
+    uint64_t startFrame = 0;
+    // downscale factor of the coarse detection pass, 1 detects at full resolution
+    float coarseScale = 1.0f;
+    // frames followed with optical flow between detections, 0 detects every frame
+    uint32_t flowInterval = 0;
+    // Laplacian variance below which frames are skipped, 0 searches every frame and
+    // negative keeps the default
+    float minSharpness = -1.0f;
+    // intrinsics of every camera seen before, loaded at start and updated by every calibration
+    std::string intrinsicsPath(IntrinsicsStoreDefaultPath);
+    // whether the camera frames start out shown with the lens distortion removed, see Ui::UndistortBackground
+    bool undistortBackground = true;
+    auto detectorType = PatternDetector::Type::Chessboard;
+    cv::Size patternSize = defaultPatternSize;
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg = argv[i];
+        if (arg == "--unthrottled") {
+            pacing = FrameSource::Pacing::Unthrottled;
+        } else if (arg == "--fps" && i + 1 < argc) {
+            sequenceFps = std::stod(argv[++i]);
+        } else if (arg == "--check-allocations" && i + 1 < argc) {
+            allocationCheckWarmup = std::stoull(argv[++i]);
+        } else if (arg == "--latency-dump" && i + 1 < argc) {
+            latencyDumpPath = argv[++i];
+        } else if (arg == "--record" && i + 1 < argc) {
+            recordingPaths.emplace_back(argv[++i]);
+        } else if (arg == "--start-frame" && i + 1 < argc) {
+            startFrame = std::stoull(argv[++i]);
+        } else if (arg == "--coarse-scale" && i + 1 < argc) {
+            coarseScale = std::stof(argv[++i]);
+        } else if (arg == "--flow-interval" && i + 1 < argc) {
+            flowInterval = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (arg == "--min-sharpness" && i + 1 < argc) {
+            minSharpness = std::stof(argv[++i]);
+        } else if (arg == "--no-undistort") {
+            undistortBackground = false;
+        } else if (arg == "--intrinsics" && i + 1 < argc) {
+            intrinsicsPath = argv[++i];
+        } else if (arg == "--detector" && i + 1 < argc) {
+            if (!PatternDetector::parseType(argv[++i], detectorType)) {
+                std::fprintf(stderr, "Unknown detector %s\n", argv[i]);
+                return EXIT_FAILURE;
+            }
+        } else if (arg == "--pattern" && i + 1 < argc) {
+            if (std::sscanf(argv[++i], "%dx%d", &patternSize.width, &patternSize.height) != 2 || patternSize.width < 2 || patternSize.height < 2) {
+                std::fprintf(stderr, "Invalid pattern size %s, expected WxH\n", argv[i]);
+                return EXIT_FAILURE;
+            }
+        } else {
+            videoSourceUris.emplace_back(arg);
+        }
+    }
+    if (videoSourceUris.empty()) {
+        videoSourceUris.emplace_back("0");
     }
 
     cv::ocl::setUseOpenCL(true);
@@ -141,24 +220,60 @@ int main(int argc, char* argv[]) {
                     device.OpenCL_C_Version().c_str());
     }
 
-    cv::VideoCapture videoSource;
-    if (!videoSource.open(videoSourceIndex)) {
-        std::fprintf(stderr, "Could not open video source on index %d\n",
-                     videoSourceIndex);
-        return EXIT_FAILURE;
+    float squareSideLengthM = 0.023;
+    // capture, detection and pose run on threads of each tracker, the render
+    // loop only picks up their newest results
+    std::vector<std::unique_ptr<Tracker>> trackers;
+    bool replay = false;
+    for (size_t i = 0; i < videoSourceUris.size(); ++i) {
+        auto source = FrameSource::create(videoSourceUris[i], pacing, sequenceFps);
+        if (source && startFrame > 0 && !source->seek(startFrame)) {
+            std::fprintf(stderr, "Could not seek %s to frame %llu\n", videoSourceUris[i].c_str(), static_cast<unsigned long long>(startFrame));
+        }
+        auto tracker = Tracker::create(std::move(source), patternSize, squareSideLengthM);
+        if (!tracker) {
+            return EXIT_FAILURE;
+        }
+        if (i < recordingPaths.size() && !tracker->startRecording(recordingPaths[i])) {
+            return EXIT_FAILURE;
+        }
+        {
+            auto lock = tracker->lockCalibration();
+            tracker->getCalibration().SetIntrinsicsStore(intrinsicsPath, tracker->getSource().getName());
+            tracker->getCalibration().SetDetector(detectorType, patternSize);
+            tracker->getCalibration().CoarseScale = coarseScale;
+            tracker->getCalibration().FlowTracking = flowInterval > 0;
+            if (flowInterval > 0) {
+                tracker->getCalibration().FlowRedetectInterval = flowInterval;
+            }
+            if (minSharpness >= 0.0f) {
+                tracker->getCalibration().QualityGating = minSharpness > 0.0f;
+                tracker->getCalibration().MinSharpness = minSharpness;
+            }
+        }
+        replay = replay || !tracker->getSource().isLive();
+        trackers.emplace_back(std::move(tracker));
     }
-    cv::Size screenSize = cv::Size(videoSource.get(cv::CAP_PROP_FRAME_WIDTH), videoSource.get(cv::CAP_PROP_FRAME_HEIGHT));
+
+    // compose the cameras in a grid of tiles, the window keeps the size of the first camera
+    const uint32_t tileColumns = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(trackers.size()))));
+    const uint32_t tileRows = static_cast<uint32_t>((trackers.size() + tileColumns - 1) / tileColumns);
+    const cv::Size tileSize(trackers[0]->getFrameSize().width / tileColumns, trackers[0]->getFrameSize().height / tileColumns);
+    cv::Size screenSize(tileSize.width * tileColumns, tileSize.height * tileRows);
 
     auto renderer = Renderer::create("Calibration", screenSize.width, screenSize.height);
     if (!renderer) {
         std::fprintf(stderr, "Failed to initialize renderer\n");
         return EXIT_FAILURE;
     }
+    // don't let vsync cap the loop when measuring maximum throughput
+    renderer->setVSync(pacing == FrameSource::Pacing::RealTime);
     auto ui = Ui::create(renderer->getNativeWindowHandle());
     if (!renderer) {
         std::fprintf(stderr, "Failed to initialize renderer\n");
         return EXIT_FAILURE;
     }
+    ui->UndistortBackground = undistortBackground;
 
     auto fullscreenQuad = IndexedMesh::createFullscreenQuad("fullscreen quad");
     auto axis = IndexedMesh::createAxis("axis");
@@ -210,6 +325,11 @@ int main(int argc, char* argv[]) {
     passInfo.ClearColor[3] = 1.0f;
     passInfo.DepthWrite = false;
     passInfo.DepthTest = false;
+    passInfo.DebugName = "clear";
+    auto clearPass = RenderPass::create(passInfo);
+
+    // the quad of every tile is drawn after one clear of the whole window
+    passInfo.Clear = false;
     passInfo.DebugName = "full screen quad";
     auto fullscreenPass = RenderPass::create(passInfo);
 
@@ -223,26 +343,32 @@ int main(int argc, char* argv[]) {
     passInfo.DepthTest = true; //turn on or off that the axes draw over the cube
     auto axisPass = RenderPass::create(passInfo);
 
-    auto texture = Texture::create(screenSize.width, screenSize.height);
-    if (!texture) {
-        std::fprintf(stderr, "Failed to create camera texture\n");
-        return EXIT_FAILURE;
+    std::vector<std::unique_ptr<Texture>> textures;
+    for (const auto& tracker : trackers) {
+        auto texture = Texture::create(tracker->getFrameSize().width, tracker->getFrameSize().height);
+        if (!texture) {
+            std::fprintf(stderr, "Failed to create camera texture\n");
+            return EXIT_FAILURE;
+        }
+        textures.emplace_back(std::move(texture));
     }
-
-    cv::Mat frame;
+    // newest result of every tracker, valid until the next acquire on that tracker
+    std::vector<Tracker::Result*> results(trackers.size(), nullptr);
+    // whether the result was acquired this frame, only those get their latency recorded
+    std::vector<bool> freshResults(trackers.size(), false);
+    std::vector<LatencyStats> latencies(trackers.size());
+    // undistortion maps of every camera, rebuilt when its intrinsics change
+    std::vector<Undistorter> undistorters(trackers.size());
+    // reused between frames so undistorting does not allocate
+    std::vector<cv::Mat> undistortedFrames(trackers.size());
 
     bool running = true;
-    bool calibrateFrame = false;
     SDL_Event event;
 
-    float squareSideLengthM = 0.023;
-    Calibration calibration(patternSize, screenSize, squareSideLengthM);
-
     bool saveNextImage = false;
-    std::string calibFileName;
 
     //clang-format off
-    mat4 rotTransMat{
+    mat4 identity{
         1, 0, 0, 0,
         0, 1, 0, 0,
         0, 0, 1, 0,
@@ -251,10 +377,19 @@ int main(int argc, char* argv[]) {
     float3 lightPos = { 0.0f, 0.0f, 0.0f};
 
     //clang-format on
-    bool firstFrame = true;
 
+    // scratch memory for everything which only lives for one frame
+    FrameArena frameArena(64 * 1024);
+    AllocationCounter::Counts frameAllocations{0, 0};
+    uint64_t allocatingFrames = 0;
+
+    uint64_t processedFrames = 0;
+    auto loopStart = std::chrono::steady_clock::now();
     while (running) {
-        calibrateFrame = false;
+        auto frameStartAllocations = AllocationCounter::get();
+        AllocationCounter::Counts trackerAllocations{0, 0};
+        frameArena.reset();
+        auto& activeTracker = *trackers[std::min<size_t>(ui->ActiveCamera, trackers.size() - 1)];
         // input
         while (SDL_PollEvent(&event)) {
             ui->processEvent(event);
@@ -268,11 +403,13 @@ int main(int argc, char* argv[]) {
                     running = false;
                     break;
                 case SDLK_c:
-                    calibrateFrame = true;
+                    activeTracker.requestCalibrationView();
                     break;
                 case SDLK_r:
-                    if (std::strcmp(ui->CalibrationDirectoryPath, "") != 0)
-                        calibration.LoadFromDirectory(ui->CalibrationDirectoryPath);
+                    if (std::strcmp(ui->CalibrationDirectoryPath, "") != 0) {
+                        auto lock = activeTracker.lockCalibration();
+                        activeTracker.getCalibration().StartLoadFromDirectory(ui->CalibrationDirectoryPath);
+                    }
                     break;
                 case SDLK_s:
                     saveNextImage = true;
@@ -281,54 +418,155 @@ int main(int argc, char* argv[]) {
             }
         }
 
-        // Get frame from webcam
-        videoSource >> frame;
-        if (frame.empty()) {
-            std::fprintf(stderr,
-                         "Camera returned an empty frame... Quitting.\n");
-            return EXIT_FAILURE;
+        // Get newest results of every camera. Replays are waited for so every
+        // recorded frame gets rendered, live cameras keep their last result
+        // until the next one is ready.
+        bool allFinished = true;
+        for (size_t i = 0; i < trackers.size(); ++i) {
+            auto result = trackers[i]->acquireLatest(replay || results[i] == nullptr);
+            freshResults[i] = result != nullptr;
+            if (result != nullptr) {
+                results[i] = result;
+                const cv::Mat* image = &result->Image;
+                if (ui->UndistortBackground) {
+                    // rebuilding the maps after a calibration is part of the stage
+                    const auto undistortStart = FrameTiming::Clock::now();
+                    if (undistorters[i].update(trackers[i]->getCalibration().GetIntrinsics(), result->Image.size())) {
+                        result->Timing.UndistortStart = undistortStart;
+                        if (undistorters[i].apply(result->Image, undistortedFrames[i])) {
+                            image = &undistortedFrames[i];
+                        }
+                        result->Timing.UndistortEnd = FrameTiming::Clock::now();
+                    }
+                }
+                result->Timing.UploadStart = FrameTiming::Clock::now();
+                textures[i]->upload(*image);
+                result->Timing.UploadEnd = FrameTiming::Clock::now();
+                trackerAllocations.Owned += result->Allocations.Owned;
+                trackerAllocations.External += result->Allocations.External;
+            }
+            allFinished = allFinished && trackers[i]->isFinished();
+            if (results[i] == nullptr || (!replay && trackers[i]->isFinished())) {
+                std::fprintf(stderr, "Camera %s returned an empty frame... Quitting.\n", trackers[i]->getSource().getName().c_str());
+                return replay ? EXIT_SUCCESS : EXIT_FAILURE;
+            }
+        }
+        if (replay && allFinished) {
+            // end of recording
+            break;
         }
 
-        if (saveNextImage) {
-            calibration.TakeCapture(ui->CalibrationDirectoryPath, frame);
-            saveNextImage = false;
+        // calibration images are loaded in the background, merge them once all are searched
+        for (auto& tracker : trackers) {
+            const auto loadProgress = tracker->getCalibration().GetLoadProgress();
+            if (loadProgress.Loading && loadProgress.Processed == loadProgress.Total) {
+                auto lock = tracker->lockCalibration();
+                tracker->getCalibration().FinishLoad();
+            }
         }
 
-        calibration.DetectPattern(frame, calibrateFrame,
-                                  false); // write calibration colors to image
+        auto activeResult = results[std::min<size_t>(ui->ActiveCamera, trackers.size() - 1)];
+        // like calibration views, captures wait for a frame which passes the quality gate
+        if (saveNextImage && activeResult->QualityAccepted) {
+            auto lock = activeTracker.lockCalibration();
+            activeTracker.getCalibration().TakeCapture(ui->CalibrationDirectoryPath, activeResult->Image);
+            saveNextImage = false;
+        }
 
-        texture->upload(frame);
+        clearPass->bind();
         cubePipeline->setUniform( "lightPos", lightPos);
-        bool drawObjects = false;
-        if (calibration.UpdateRotTransMat(rotTransMat, squareSideLengthM, !firstFrame)) {
-            axisPipeline->setUniform("rotTransMat", rotTransMat);
-            axisPipeline->setUniform("cameraMat", calibration.ProjMat);
-            axisPipeline->setUniform( "scaleFactor", 5.0f);
-            cubePipeline->setUniform( "rotTransMat", rotTransMat);
-            cubePipeline->setUniform( "cameraMat", calibration.ProjMat);
-            cubePipeline->setUniform( "scaleFactor", 2.0f);
-            drawObjects = true;
-        }
+        for (size_t i = 0; i < trackers.size(); ++i) {
+            const int32_t tileX = static_cast<int32_t>(i % tileColumns) * tileSize.width;
+            // OpenGL viewports start in the bottom left, tiles are laid out from the top left
+            const int32_t tileY = static_cast<int32_t>(tileRows - 1 - i / tileColumns) * tileSize.height;
+            bool drawObjects = false;
+            // snapshots are immutable and published atomically, no need to lock the calibration
+            const auto intrinsics = trackers[i]->getCalibration().GetIntrinsics();
+            if (results[i]->PoseValid && intrinsics) {
+                axisPipeline->setUniform("rotTransMat", results[i]->RotTransMat);
+                axisPipeline->setUniform("cameraMat", intrinsics->ProjMat);
+                axisPipeline->setUniform( "scaleFactor", 5.0f);
+                cubePipeline->setUniform( "rotTransMat", results[i]->RotTransMat);
+                cubePipeline->setUniform( "cameraMat", intrinsics->ProjMat);
+                cubePipeline->setUniform( "scaleFactor", 2.0f);
+                drawObjects = true;
+            }
+
+            // tell it you want to draw 2 triangles (2 vertices)
+            fullscreenPass->bind();
+            fullscreenPipeline->bind(tileX, tileY, tileSize.width, tileSize.height);
+            textures[i]->bind();
+            fullscreenQuad->draw();
 
-        // tell it you want to draw 2 triangles (2 vertices)
-        fullscreenPass->bind();
-        fullscreenPipeline->bind();
-        texture->bind();
-        fullscreenQuad->draw();
-
-        if (drawObjects) {
-            objectPass->bind();
-            cubePipeline->bind();
-            cube->draw();
-
-            axisPass->bind();
-            axisPipeline->bind();
-            axis->draw();
-            firstFrame = false;
+            if (drawObjects) {
+                objectPass->bind();
+                cubePipeline->bind(tileX, tileY, tileSize.width, tileSize.height);
+                cube->draw();
+
+                axisPass->bind();
+                axisPipeline->bind(tileX, tileY, tileSize.width, tileSize.height);
+                axis->draw();
+            }
         }
 
-        ui->draw(renderer->getNativeWindowHandle(), calibration, rotTransMat, lightPos, squareSideLengthM, saveNextImage);
+        {
+            // only the widgets touch the calibration, submitting and decoding previews happen after the lock
+            auto lock = activeTracker.lockCalibration();
+            ui->draw(renderer->getNativeWindowHandle(), frameArena, activeTracker.getCalibration(), activeResult->PoseValid ? activeResult->RotTransMat : identity,
+                     lightPos, squareSideLengthM, saveNextImage, frameAllocations, static_cast<uint32_t>(trackers.size()),
+                     latencies[std::min<size_t>(ui->ActiveCamera, trackers.size() - 1)]);
+        }
+        ui->render();
+        for (auto& tracker : trackers) {
+            tracker->setSquareSideLength(squareSideLengthM);
+        }
+        auto submitTime = FrameTiming::Clock::now();
         renderer->swapBuffers();
+        auto presentTime = FrameTiming::Clock::now();
+        for (size_t i = 0; i < trackers.size(); ++i) {
+            if (freshResults[i]) {
+                results[i]->Timing.Submit = submitTime;
+                results[i]->Timing.Present = presentTime;
+                latencies[i].record(results[i]->Timing);
+            }
+        }
+        ++processedFrames;
+
+        auto frameEndAllocations = AllocationCounter::get();
+        frameAllocations.Owned = frameEndAllocations.Owned - frameStartAllocations.Owned + trackerAllocations.Owned;
+        frameAllocations.External = frameEndAllocations.External - frameStartAllocations.External + trackerAllocations.External;
+        if (allocationCheckWarmup > 0 && processedFrames > allocationCheckWarmup && frameAllocations.Owned > 0) {
+            std::fprintf(stderr, "Frame %llu made %llu heap allocations after warm-up\n", static_cast<unsigned long long>(processedFrames),
+                         static_cast<unsigned long long>(frameAllocations.Owned));
+            ++allocatingFrames;
+        }
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - loopStart).count();
+    std::printf("Rendered %llu frames in %.3f s: %.2f fps\n", static_cast<unsigned long long>(processedFrames), seconds, processedFrames / seconds);
+    for (const auto& tracker : trackers) {
+        uint64_t trackedFrames = tracker->getProcessedFrames();
+        std::printf("Tracked %llu frames from %s: %.2f fps, %llu dropped\n", static_cast<unsigned long long>(trackedFrames),
+                    tracker->getSource().getName().c_str(), trackedFrames / seconds, static_cast<unsigned long long>(tracker->getDroppedFrames()));
+    }
+    if (!latencyDumpPath.empty()) {
+        FILE* dump = std::fopen(latencyDumpPath.c_str(), "w");
+        if (dump == nullptr) {
+            std::fprintf(stderr, "Could not open %s for writing\n", latencyDumpPath.c_str());
+            return EXIT_FAILURE;
+        }
+        std::fprintf(dump, "[");
+        for (size_t i = 0; i < trackers.size(); ++i) {
+            std::fprintf(dump, i == 0 ? "\n  " : ",\n  ");
+            latencies[i].dump(dump, trackers[i]->getSource().getName().c_str());
+        }
+        std::fprintf(dump, "\n]\n");
+        std::fclose(dump);
+    }
+    if (allocatingFrames > 0) {
+        std::fprintf(stderr, "%llu frames allocated after %llu warm-up frames\n", static_cast<unsigned long long>(allocatingFrames),
+                     static_cast<unsigned long long>(allocationCheckWarmup));
+        return EXIT_FAILURE;
     }
     return EXIT_SUCCESS;
 }
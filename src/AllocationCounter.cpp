@@ -0,0 +1,160 @@
+#include "AllocationCounter.h"
+
+#include <cstdlib>
+#include <new>
+
+#include <opencv2/core/mat.hpp>
+
+namespace
+{
+thread_local uint64_t ownedAllocations = 0;
+thread_local uint64_t externalAllocations = 0;
+thread_local uint32_t externalDepth = 0;
+/// Set while the Mat allocator runs, the buffer is counted once by it and
+/// not again for the bookkeeping OpenCV news alongside
+thread_local uint32_t matAllocationDepth = 0;
+
+inline void countAllocation()
+{
+    if (matAllocationDepth > 0) {
+        return;
+    }
+    if (externalDepth > 0) {
+        ++externalAllocations;
+    } else {
+        ++ownedAllocations;
+    }
+}
+
+void* allocate(std::size_t size)
+{
+    countAllocation();
+    void* ptr = std::malloc(size == 0 ? 1 : size);
+    if (ptr == nullptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void* allocateAligned(std::size_t size, std::align_val_t alignment)
+{
+    countAllocation();
+    auto align = static_cast<std::size_t>(alignment);
+    // aligned_alloc requires the size to be a multiple of the alignment
+    size = (size + align - 1) / align * align;
+#if defined(_WIN32)
+    void* ptr = _aligned_malloc(size == 0 ? align : size, align);
+#else
+    void* ptr = std::aligned_alloc(align, size == 0 ? align : size);
+#endif
+    if (ptr == nullptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void deallocateAligned(void* ptr)
+{
+#if defined(_WIN32)
+    _aligned_free(ptr);
+#else
+    std::free(ptr);
+#endif
+}
+/// Forwards to the allocator cv::Mat used before and counts every buffer it
+/// allocates. Deallocation goes to the allocator stored in the buffer, so
+/// only the allocations pass through here.
+class CountingMatAllocator final : public cv::MatAllocator
+{
+public:
+    explicit CountingMatAllocator(cv::MatAllocator* allocator)
+        : allocator_(allocator)
+    {
+    }
+
+    cv::UMatData* allocate(int dims, const int* sizes, int type, void* data, size_t* step, cv::AccessFlag flags,
+                           cv::UMatUsageFlags usageFlags) const override
+    {
+        // Mats wrapping memory given by the caller allocate no buffer
+        if (data == nullptr) {
+            countAllocation();
+        }
+        ++matAllocationDepth;
+        try {
+            cv::UMatData* result = allocator_->allocate(dims, sizes, type, data, step, flags, usageFlags);
+            --matAllocationDepth;
+            return result;
+        } catch (...) {
+            --matAllocationDepth;
+            throw;
+        }
+    }
+
+    bool allocate(cv::UMatData* data, cv::AccessFlag accessFlags, cv::UMatUsageFlags usageFlags) const override
+    {
+        return allocator_->allocate(data, accessFlags, usageFlags);
+    }
+
+    void deallocate(cv::UMatData* data) const override { allocator_->deallocate(data); }
+
+private:
+    cv::MatAllocator* allocator_;
+};
+} // namespace
+
+AllocationCounter::ExternalScope::ExternalScope()
+{
+    ++externalDepth;
+}
+
+AllocationCounter::ExternalScope::~ExternalScope()
+{
+    --externalDepth;
+}
+
+AllocationCounter::Counts AllocationCounter::get()
+{
+    return {ownedAllocations, externalAllocations};
+}
+
+void AllocationCounter::installMatAllocator()
+{
+    static CountingMatAllocator allocator(cv::Mat::getDefaultAllocator());
+    cv::Mat::setDefaultAllocator(&allocator);
+}
+
+void* operator new(std::size_t size) { return allocate(size); }
+void* operator new[](std::size_t size) { return allocate(size); }
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+    try {
+        return allocate(size);
+    } catch (const std::bad_alloc&) {
+        return nullptr;
+    }
+}
+void* operator new[](std::size_t size, const std::nothrow_t& tag) noexcept { return operator new(size, tag); }
+void* operator new(std::size_t size, std::align_val_t alignment) { return allocateAligned(size, alignment); }
+void* operator new[](std::size_t size, std::align_val_t alignment) { return allocateAligned(size, alignment); }
+void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+    try {
+        return allocateAligned(size, alignment);
+    } catch (const std::bad_alloc&) {
+        return nullptr;
+    }
+}
+void* operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t& tag) noexcept { return operator new(size, alignment, tag); }
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete[](void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete(void* ptr, const std::nothrow_t&) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::align_val_t) noexcept { deallocateAligned(ptr); }
+void operator delete[](void* ptr, std::align_val_t) noexcept { deallocateAligned(ptr); }
+void operator delete(void* ptr, std::size_t, std::align_val_t) noexcept { deallocateAligned(ptr); }
+void operator delete[](void* ptr, std::size_t, std::align_val_t) noexcept { deallocateAligned(ptr); }
+void operator delete(void* ptr, std::align_val_t, const std::nothrow_t&) noexcept { deallocateAligned(ptr); }
+void operator delete[](void* ptr, std::align_val_t, const std::nothrow_t&) noexcept { deallocateAligned(ptr); }
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+
+/// Counts heap allocations made through operator new on the calling thread.
+/// The global allocation functions are replaced in AllocationCounter.cpp,
+/// so every new, std::vector growth or std::string concatenation is seen.
+/// cv::Mat buffers come from cv::fastMalloc instead, they are seen once the
+/// counting allocator is installed with installMatAllocator.
+/// Used to verify that the steady-state frame loop does not allocate.
+class AllocationCounter
+{
+public:
+    struct Counts {
+        /// Allocations made by our own code
+        uint64_t Owned;
+        /// Allocations made inside library calls wrapped by an ExternalScope
+        uint64_t External;
+    };
+
+    /// Marks calls into libraries whose internal allocations we don't control
+    /// (OpenCV detection and pose solving). Allocations inside the scope are
+    /// counted separately from the ones our code makes.
+    class ExternalScope
+    {
+    public:
+        ExternalScope();
+        ~ExternalScope();
+        ExternalScope(const ExternalScope&) = delete;
+        ExternalScope& operator=(const ExternalScope&) = delete;
+    };
+
+    /// Total allocations made on the calling thread so far
+    static Counts get();
+    /// Make every cv::Mat which allocates a buffer count as one allocation,
+    /// Owned outside and External inside an ExternalScope. Call once at start.
+    static void installMatAllocator();
+};
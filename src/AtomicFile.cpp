@@ -0,0 +1,36 @@
+#include "AtomicFile.h"
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <thread>
+
+namespace
+{
+/// Numbers the temporary files so no two writes ever share one
+std::atomic<uint64_t> temporaryCounter(0);
+} // namespace
+
+bool AtomicFile::write(const std::string& path, const std::function<bool(FILE*)>& contents)
+{
+    // written next to the old file and swapped in so a crash never leaves half
+    // a file, under a name of its own in case another thread or process writes too
+    auto temporaryPath = std::filesystem::path(path);
+    temporaryPath += ".tmp" + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + "-" + std::to_string(temporaryCounter++);
+    FILE* file = std::fopen(temporaryPath.string().c_str(), "wb");
+    if (file == nullptr) {
+        return false;
+    }
+    bool written = contents(file);
+    written = std::fclose(file) == 0 && written;
+
+    std::error_code error;
+    if (written) {
+        std::filesystem::rename(temporaryPath, path, error);
+    }
+    if (!written || error) {
+        std::filesystem::remove(temporaryPath, error);
+        return false;
+    }
+    return true;
+}
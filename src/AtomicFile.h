@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstdio>
+#include <functional>
+#include <string>
+
+/// Replaces files in one step so readers and crashes never see half of one
+class AtomicFile
+{
+public:
+    /// Write the contents to a temporary file next to path and rename it over
+    /// path once contents returned true and the file was closed. The
+    /// temporary file is removed on failure. Returns false if the file could
+    /// not be written or renamed.
+    static bool write(const std::string& path, const std::function<bool(FILE*)>& contents);
+};
@@ -1,99 +1,266 @@
 #include "Calibration.h"
 
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <limits>
+#include <numeric>
 #include <vector>
 #include <iostream>
 #include <opencv2/calib3d.hpp>
+#include <opencv2/core/utility.hpp>
 #include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/video/tracking.hpp>
 
-#include "Texture.h"
+#include "AllocationCounter.h"
+#include "CornerCache.h"
+#include "FrameCache.h"
+#include "IntrinsicsStore.h"
+#include "PatternDetector.h"
+#include "ViewSelector.h"
 
-/// Transform an OpenCV Perspective matrix into a OpenGL space
-/// Projection matrix which is friendly to vertex shader transforms to
-/// OpenGL normalized device coordinates (NDC) space and clip space for culling.
-/// This removes the infinite far plane of OpenCV but points at infinity are
-/// Mapped to behind the camera.
-void fromCVPerspToGLProj(cv::Mat cvMat, mat4 &glMat) {
-    double fx = cvMat.at<double>(0, 0);
-    double fy = cvMat.at<double>(1, 1);
-    double cx = cvMat.at<double>(0, 2);
-    double cy = cvMat.at<double>(1, 2);
-
-    const float zfar = 200.f;
-    const float znear = 0.01f;
-
-    // Infinite projection
-    glMat[0] = -static_cast<float>(fx / cx);
-    glMat[1] = 0.0f;
-    glMat[2] = 0.0f;
-    glMat[3] = 0.0f;
-
-    glMat[4] = 0.0f;
-    glMat[5] = static_cast<float>(fy / cy);
-    glMat[6] = 0.0f;
-    glMat[7] = 0.0f;
+namespace
+{
+/// Width of the calibration image previews shown in the UI
+constexpr int previewWidth = 256;
+/// Pyramid levels and window of the optical flow corner tracking
+constexpr int flowPyramidLevels = 3;
+const cv::Size flowWindow(21, 21);
+/// Every how many rows the frame quality is measured
+constexpr int qualityRowStep = 2;
+/// Solver iterations of a calibration from scratch, the cv::calibrateCamera default
+constexpr uint32_t fullCalibrationIterations = 30;
 
-    glMat[8] = 0.0f;
-    glMat[9] = 0.0f;
-    glMat[10] = (zfar + znear) / (znear - zfar);
-    glMat[11] = -1.0f;
+/// Rotation matrix of a rotation vector by the same formula as cv::Rodrigues,
+/// without going through heap-backed cv::Mat
+cv::Matx33d rotationMatrix(const cv::Vec3d& rotationVector)
+{
+    const double angle = cv::norm(rotationVector);
+    if (angle < std::numeric_limits<double>::epsilon()) {
+        return cv::Matx33d::eye();
+    }
+    const cv::Vec3d axis = rotationVector * (1.0 / angle);
+    const double c = std::cos(angle);
+    const double s = std::sin(angle);
+    const cv::Matx33d cross(0.0, -axis[2], axis[1], axis[2], 0.0, -axis[0], -axis[1], axis[0], 0.0);
+    return c * cv::Matx33d::eye() + (1.0 - c) * (axis * axis.t()) + s * cross;
+}
 
-    glMat[12] = 0.0f;
-    glMat[13] = 0.0f;
-    glMat[14] = 2.0f * zfar * znear / (znear - zfar);
-    glMat[15] = 0.0f;
+/// Downscaled copy of a calibration image for the UI previews
+cv::Mat makePreview(const cv::Mat& image)
+{
+    cv::Mat preview;
+    cv::resize(image, preview, cv::Size(previewWidth, previewWidth * image.rows / image.cols), 0, 0, cv::INTER_AREA);
+    return preview;
 }
+} // namespace
 
 Calibration::Calibration(const cv::Size& patternSize, const cv::Size& cameraResolution, float sideSquare)
-    : CameraMatKnown(false)
-    , CameraMatrix(cv::Mat::eye(3, 3, CV_64F))
-    // Identity matrix
-    , ProjMat{1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f}
-    , patternSize_(patternSize)
+    : IncrementalCalibration(true)
+    , IncrementalMinViews(5)
+    , IncrementalIterations(5)
+    , ViewSelection(true)
+    , ViewBudget(40)
+    , ViewMinDistance(0.05f)
+    , Solver(CalibrationWorker::Solver::Sparse)
+    , CalibImagesVersion(0)
+    , CoarseScale(1.0f)
+    , CoarseFallback(true)
+    , RoiTracking(true)
+    , RoiPadding(0.25f)
+    , RoiMaxMisses(3)
+    , FlowTracking(false)
+    , FlowRedetectInterval(10)
+    , FlowMaxError(8.0f)
+    , QualityGating(true)
+    , MinSharpness(10.0f)
+    , MaxClippedRatio(0.5f)
     , cameraResolution_(cameraResolution)
-    , objectSpacePoints_(patternSize.width * patternSize.height)
-    , DistortionCoefficients(cv::Mat::zeros(8, 1, CV_64F))
+    , detector_(PatternDetector::create(PatternDetector::Type::Chessboard, patternSize))
+    , sideSquare_(sideSquare)
+    , roiMisses_(0)
+    , flowValid_(false)
+    , framesSinceDetection_(0)
+    , lastQuality_{0.0f, 0.0f}
+    , loadProcessed_(0)
+    , loadTotal_(0)
+    , loadReady_(false)
+    , loadActive_(false)
+    , worker_([this](const Intrinsics& intrinsics) { saveIntrinsics(intrinsics); })
 {
+    detector_->getObjectPoints(sideSquare_, objectSpacePoints_);
     initialObjectSpacetPoints_.reserve(10 * objectSpacePoints_.size());
     initialImageSpacePoints_.reserve(10 * objectSpacePoints_.size());
-    for (int j = 0; j < patternSize_.height; j++)
-    {
-        for (int i = 0; i < patternSize_.width; i++)
-        {
-            // real world coordinates in meters of the inner corners if Z = 0 (so only x and y coordinates).
-            objectSpacePoints_[i + j * patternSize_.width] = cv::Vec3f(i * sideSquare, j * sideSquare, 0);
-        }
+    // detection reuses the same storage every frame
+    imageSpacePoints_.reserve(objectSpacePoints_.size());
+    flowPoints_.reserve(objectSpacePoints_.size());
+    flowStatus_.reserve(objectSpacePoints_.size());
+    flowError_.reserve(objectSpacePoints_.size());
+}
+
+Calibration::~Calibration()
+{
+    if (loadThread_.joinable()) {
+        loadThread_.join();
     }
 }
 
-void Calibration::LoadFromDirectory(const std::string &path)
+void Calibration::LoadFromDirectory(const std::string &path, bool calibrate)
 {
-    CalibImages.clear();
-    CalibImageNames.clear();
-    int calibFileCounter = 0;
-    bool keepReading = true;
-    while (keepReading) {
-        std::string calibFileName = "calib" + std::to_string(calibFileCounter) + ".png";
-        cv::Mat image = cv::imread(path + calibFileName);
-        keepReading = image.data;
-        if (keepReading) {
-            if (DetectPattern(image, true))
-            {
-                std::cout << "Loaded " << calibFileName << std::endl;
-                CalibImageNames.push_back(calibFileName);
-                auto texture = Texture::create(image.cols, image.rows);
-                if (texture) {
-                    texture->upload(image);
+    if (!StartLoadFromDirectory(path)) {
+        return;
+    }
+    loadThread_.join();
+    FinishLoad(calibrate);
+    WaitForCalibration();
+}
+
+bool Calibration::StartLoadFromDirectory(const std::string &path)
+{
+    if (loadActive_) {
+        std::fprintf(stderr, "Calibration images are already being loaded\n");
+        return false;
+    }
+
+    // enumerate calibN.png once and sort by N, the order they were captured in
+    struct ImageFile {
+        uint64_t Number;
+        std::filesystem::path Path;
+        uint64_t Size;
+        int64_t ModifiedTime;
+    };
+    std::vector<ImageFile> files;
+    std::error_code error;
+    for (std::filesystem::directory_iterator it(path, error), end; !error && it != end; it.increment(error)) {
+        const auto name = it->path().filename().string();
+        if (name.size() <= 9 || name.compare(0, 5, "calib") != 0 || name.compare(name.size() - 4, 4, ".png") != 0) {
+            continue;
+        }
+        const auto number = name.substr(5, name.size() - 9);
+        if (std::all_of(number.begin(), number.end(), [](unsigned char c) { return std::isdigit(c); })) {
+            std::error_code statError;
+            const uint64_t size = it->file_size(statError);
+            const int64_t modifiedTime = it->last_write_time(statError).time_since_epoch().count();
+            files.push_back(ImageFile{std::stoull(number), it->path(), statError ? 0 : size, statError ? 0 : modifiedTime});
+        }
+    }
+    if (error) {
+        std::fprintf(stderr, "Could not read calibration directory %s: %s\n", path.c_str(), error.message().c_str());
+        return false;
+    }
+    std::sort(files.begin(), files.end(), [](const ImageFile& a, const ImageFile& b) { return a.Number < b.Number; });
+
+    loadedImages_.clear();
+    loadedImages_.resize(files.size());
+    for (size_t i = 0; i < files.size(); ++i) {
+        loadedImages_[i].Name = files[i].Path.filename().string();
+        loadedImages_[i].Path = files[i].Path.string();
+    }
+    loadProcessed_ = 0;
+    loadTotal_ = static_cast<uint32_t>(files.size());
+    loadReady_ = false;
+    loadActive_ = true;
+    // the settings may change on the UI thread while loading
+    loadObjectPoints_ = objectSpacePoints_;
+    auto detector = PatternDetector::create(detector_->getType(), detector_->getPatternSize());
+    detector->Flags = detector_->Flags;
+    const CornerCacheKey cacheKey{static_cast<int32_t>(detector->getType()), detector->Flags, detector->getPatternSize().width,
+                                  detector->getPatternSize().height, CoarseScale, CoarseFallback ? 1u : 0u};
+    loadThread_ = std::thread([this, path, files = std::move(files), detector = std::move(detector), cacheKey]() {
+        // unchanged images take their points from the sidecar and are neither decoded nor searched
+        CornerCache cache;
+        cache.read(path, cacheKey);
+        std::vector<int> misses;
+        for (size_t i = 0; i < files.size(); ++i) {
+            auto& loaded = loadedImages_[i];
+            if (auto cached = cache.find(loaded.Name, files[i].Size, files[i].ModifiedTime)) {
+                loaded.Found = cached->Found;
+                loaded.ImageSize = cached->ImageSize;
+                loaded.Corners = cached->Points;
+                ++loadProcessed_;
+            } else {
+                misses.push_back(static_cast<int>(i));
+            }
+        }
+
+        // every image is searched completely, the board of the previous one says nothing about it
+        cv::parallel_for_(cv::Range(0, static_cast<int>(misses.size())), [&](const cv::Range& range) {
+            FrameCache frame;
+            const FrameCache::Options options{cacheKey.CoarseScale, 0, cv::Size(), false};
+            for (int i = range.start; i < range.end; ++i) {
+                auto& loaded = loadedImages_[misses[i]];
+                cv::Mat image = cv::imread(loaded.Path);
+                if (!image.empty()) {
+                    frame.update(image, options);
                 }
-                CalibImages.emplace_back(std::move(texture));
+                loaded.Found = !image.empty() && detector->detect(frame, cv::Rect(0, 0, image.cols, image.rows), cacheKey.CoarseFallback != 0, loaded.Corners);
+                if (loaded.Found) {
+                    loaded.Preview = makePreview(image);
+                } else {
+                    loaded.Corners.clear();
+                }
+                loaded.ImageSize = image.size();
+                ++loadProcessed_;
             }
-            else
-            {
-                std::cout << "No pattern found in " << calibFileName << std::endl;
+        });
+
+        if (!misses.empty() || cache.getSize() != files.size()) {
+            CornerCache updated;
+            for (size_t i = 0; i < files.size(); ++i) {
+                const auto& loaded = loadedImages_[i];
+                updated.insert(loaded.Name, CornerCache::Entry{files[i].Size, files[i].ModifiedTime, loaded.ImageSize, loaded.Found, loaded.Corners});
             }
+            updated.write(path, cacheKey);
+        }
+        loadReady_ = true;
+    });
+    return true;
+}
+
+bool Calibration::FinishLoad(bool calibrate)
+{
+    if (!loadReady_) {
+        return false;
+    }
+    if (loadThread_.joinable()) {
+        loadThread_.join();
+    }
+    CalibImages.clear();
+    CalibImageNames.clear();
+    calibImagePaths_.clear();
+    for (auto& loaded : loadedImages_) {
+        if (loaded.Found)
+        {
+            initialObjectSpacetPoints_.push_back(loadObjectPoints_);
+            initialImageSpacePoints_.push_back(std::move(loaded.Corners));
+            std::cout << "Loaded " << loaded.Name << std::endl;
+            CalibImageNames.push_back(std::move(loaded.Name));
+            // empty for cached images, decoded by LoadPreview when shown
+            CalibImages.push_back(std::move(loaded.Preview));
+            calibImagePaths_.push_back(std::move(loaded.Path));
+        }
+        else
+        {
+            std::cout << "No pattern found in " << loaded.Name << std::endl;
         }
-        calibFileCounter++;
     }
-    CalcCameraMat();
+    ++CalibImagesVersion;
+    loadedImages_.clear();
+    loadReady_ = false;
+    loadActive_ = false;
+    if (calibrate) {
+        CalcCameraMat();
+    }
+    return true;
+}
+
+Calibration::LoadProgress Calibration::GetLoadProgress() const
+{
+    return LoadProgress{loadProcessed_, loadTotal_, loadActive_};
 }
 
 void Calibration::TakeCapture(const std::string &path, const cv::Mat& frame) {
@@ -103,59 +270,196 @@ void Calibration::TakeCapture(const std::string &path, const cv::Mat& frame) {
         std::cerr << "Failed to save " << path + calibFileName << std::endl;
     }
     CalibImageNames.push_back(calibFileName);
-    auto texture = Texture::create(frame.cols, frame.rows);
-    if (texture) {
-        texture->upload(frame);
-    }
-    CalibImages.emplace_back(std::move(texture));
+    calibImagePaths_.push_back(path + calibFileName);
+    addPreview(frame);
     std::cout << "Saved " << path + calibFileName << std::endl;
 
 }
 
-bool Calibration::DetectPattern(cv::Mat frame, bool addImage, bool drawCalibrationColors)
+cv::Mat Calibration::LoadPreview(const std::string& path)
 {
-    bool chessBoardDetected = cv::findChessboardCorners(frame, patternSize_, imageSpacePoints_, cv::CALIB_CB_ADAPTIVE_THRESH + cv::CALIB_CB_NORMALIZE_IMAGE + cv::CALIB_CB_FAST_CHECK);
+    cv::Mat image = cv::imread(path);
+    return image.empty() ? image : makePreview(image);
+}
+
+void Calibration::SetPreview(size_t index, cv::Mat preview)
+{
+    if (index < CalibImages.size()) {
+        CalibImages[index] = std::move(preview);
+    }
+}
+
+void Calibration::addPreview(const cv::Mat& image)
+{
+    CalibImages.emplace_back(makePreview(image));
+    ++CalibImagesVersion;
+}
+
+void Calibration::SetDetector(PatternDetector::Type type, const cv::Size& patternSize)
+{
+    if (type == detector_->getType() && patternSize == detector_->getPatternSize()) {
+        return;
+    }
+    auto detector = PatternDetector::create(type, patternSize);
+    if (!detector) {
+        std::fprintf(stderr, "Unknown pattern detector %d\n", static_cast<int>(type));
+        return;
+    }
+    detector_ = std::move(detector);
+    detector_->getObjectPoints(sideSquare_, objectSpacePoints_);
+    // the points of the old pattern can't be tracked or searched around
+    imageSpacePoints_.clear();
+    lastBoardBounds_ = cv::Rect();
+    roiMisses_ = 0;
+    flowValid_ = false;
+}
+
+FrameCache::Options Calibration::GetFrameCacheOptions() const
+{
+    return FrameCache::Options{CoarseScale, FlowTracking ? flowPyramidLevels : 0, flowWindow, false};
+}
+
+bool Calibration::trackCorners(const FrameCache& frame)
+{
+    if (frame.getPyramid().empty() || frame.getPreviousPyramid().empty()) {
+        return false;
+    }
+    {
+        AllocationCounter::ExternalScope opencv;
+        cv::calcOpticalFlowPyrLK(frame.getPreviousPyramid(), frame.getPyramid(), imageSpacePoints_, flowPoints_, flowStatus_, flowError_,
+                                 flowWindow, flowPyramidLevels);
+    }
+    float totalError = 0.0f;
+    for (size_t i = 0; i < flowPoints_.size(); ++i) {
+        if (flowStatus_[i] == 0) {
+            return false;
+        }
+        totalError += flowError_[i];
+    }
+    if (totalError > FlowMaxError * flowPoints_.size()) {
+        return false;
+    }
+    imageSpacePoints_.swap(flowPoints_);
+    return true;
+}
+
+bool Calibration::IsQualityAcceptable(const FrameQuality& quality) const
+{
+    return !QualityGating || (quality.Sharpness >= MinSharpness && quality.ClippedRatio <= MaxClippedRatio);
+}
+
+bool Calibration::DetectPattern(const FrameCache& frame, bool addImage, bool drawCalibrationColors)
+{
+    lastQuality_ = FrameQuality::measure(frame.getGray(), qualityRowStep);
+    if (!IsQualityAcceptable(lastQuality_)) {
+        // flow can't follow the corners through a blurred frame either
+        flowValid_ = false;
+        return false;
+    }
+    bool chessBoardDetected = false;
+    // calibration views always come from the detector, flow drifts
+    if (FlowTracking && !addImage && flowValid_ && framesSinceDetection_ < FlowRedetectInterval && trackCorners(frame)) {
+        chessBoardDetected = true;
+        ++framesSinceDetection_;
+        lastBoardBounds_ = cv::boundingRect(imageSpacePoints_) & cv::Rect(0, 0, frame.getGray().cols, frame.getGray().rows);
+    }
+    if (!chessBoardDetected) {
+        chessBoardDetected = detectInFrame(frame);
+        framesSinceDetection_ = 0;
+    }
+    flowValid_ = FlowTracking && chessBoardDetected;
 
     if (chessBoardDetected && addImage) {
         initialObjectSpacetPoints_.push_back(objectSpacePoints_); // push back the default real world positions
         initialImageSpacePoints_.push_back(imageSpacePoints_); // push back detected corner positions in 2D image
+        if (IncrementalCalibration) {
+            refineCameraMat();
+        }
+    }
+    if (drawCalibrationColors) {
+        // draws into the captured frame the cache was built from
+        cv::Mat image = frame.getColor();
+        AllocationCounter::ExternalScope opencv;
+        cv::drawChessboardCorners(image, detector_->getPatternSize(), imageSpacePoints_, chessBoardDetected);
+    }
+    return chessBoardDetected;
+}
+
+bool Calibration::detectInFrame(const FrameCache& frame)
+{
+    const cv::Rect frameBounds(0, 0, frame.getGray().cols, frame.getGray().rows);
+    bool chessBoardDetected = false;
+    bool searchFullFrame = true;
+    if (RoiTracking && !lastBoardBounds_.empty()) {
+        // the board rarely moves far between frames, search around where it was
+        const int padding = static_cast<int>(RoiPadding * std::max(lastBoardBounds_.width, lastBoardBounds_.height));
+        cv::Rect roi(lastBoardBounds_.x - padding, lastBoardBounds_.y - padding, lastBoardBounds_.width + 2 * padding, lastBoardBounds_.height + 2 * padding);
+        roi &= frameBounds;
+        chessBoardDetected = detector_->detect(frame, roi, CoarseFallback, imageSpacePoints_);
+        if (chessBoardDetected) {
+            searchFullFrame = false;
+        } else {
+            // keep trying the box for a few frames before paying for the full frame
+            searchFullFrame = ++roiMisses_ >= RoiMaxMisses;
+        }
+    }
+    if (searchFullFrame && !chessBoardDetected) {
+        chessBoardDetected = detector_->detect(frame, frameBounds, CoarseFallback, imageSpacePoints_);
+        if (!chessBoardDetected) {
+            lastBoardBounds_ = cv::Rect();
+        }
+    }
+    if (chessBoardDetected) {
+        lastBoardBounds_ = cv::boundingRect(imageSpacePoints_) & frameBounds;
+        roiMisses_ = 0;
     }
-    if (drawCalibrationColors)
-        cv::drawChessboardCorners(frame, patternSize_, imageSpacePoints_, chessBoardDetected);
     return chessBoardDetected;
 }
 
 bool Calibration::UpdateRotTransMat(mat4 &objectMatrix, float scaling_factor, bool usePrevFrame)
 {
-    if (CameraMatKnown) {
+    // a calibration finishing meanwhile publishes a new snapshot, this one stays intact
+    const auto intrinsics = worker_.getIntrinsics();
+    if (intrinsics) {
         if (!imageSpacePoints_.empty())
         {
             // calibrateCamera, when cameraMat and an approximation is already known
             try {
-                cv::solvePnP(objectSpacePoints_, imageSpacePoints_, CameraMatrix, DistortionCoefficients, rotationVec_, translationVec_, usePrevFrame);
+                AllocationCounter::ExternalScope opencv;
+                cv::solvePnP(objectSpacePoints_, imageSpacePoints_, intrinsics->CameraMatrix, intrinsics->DistortionCoefficients, rotationVec_, translationVec_,
+                             usePrevFrame);
             } catch (cv::Exception& e) {
                 return false;
             }
-
-            cv::Mat rotation = cv::Mat::eye(3, 3, rotationVec_.type());
-            cv::Rodrigues(rotationVec_, rotation);
-            cv::Mat finalMatrix = scaling_factor * cv::Mat::eye(4, 4, rotation.type());
-            finalMatrix.at<double>(3, 3) = 1.0;
-            finalMatrix(cv::Range(0, 3), cv::Range(0, 3) ) *= rotation;
-            finalMatrix(cv::Range(0, 3), cv::Range(3, 4) ) = translationVec_ * -1;
-
-            finalMatrix = finalMatrix.t();
-
-            for (int i = 0; i < 16; ++i)
-            {
-                objectMatrix[i] = finalMatrix.at<double>(i);
-            }
+            PoseToObjectMatrix(rotationVec_, translationVec_, scaling_factor, objectMatrix);
             return true;
         }
     }
     return false;
 }
 
+void Calibration::PoseToObjectMatrix(const cv::Vec3d& rotation, const cv::Vec3d& translation, float scaling_factor, mat4& objectMatrix)
+{
+    // [scale * R | -t] straight into the column-major mat4
+    const cv::Matx33d scaledRotation = scaling_factor * rotationMatrix(rotation);
+    for (int col = 0; col < 3; ++col) {
+        for (int row = 0; row < 3; ++row) {
+            objectMatrix[col * 4 + row] = static_cast<float>(scaledRotation(row, col));
+        }
+        objectMatrix[col * 4 + 3] = 0.0f;
+    }
+    for (int row = 0; row < 3; ++row) {
+        objectMatrix[12 + row] = static_cast<float>(-translation[row]);
+    }
+    objectMatrix[15] = 1.0f;
+}
+
+void Calibration::GetPose(cv::Vec3d& rotation, cv::Vec3d& translation) const
+{
+    rotation = rotationVec_;
+    translation = translationVec_;
+}
+
 void Calibration::CalcCameraMat()
 {
     if (initialImageSpacePoints_.empty())
@@ -164,7 +468,99 @@ void Calibration::CalcCameraMat()
                      "them from hard disk or capturing them\n";
         return;
     }
-    cv::calibrateCamera(initialObjectSpacetPoints_, initialImageSpacePoints_, cameraResolution_, CameraMatrix, DistortionCoefficients, InitialRotationVectors, InitialTranslationVectors);
-    fromCVPerspToGLProj(CameraMatrix, ProjMat);
-    CameraMatKnown = true;
+    auto views = selectViews();
+    if (views.size() < initialImageSpacePoints_.size()) {
+        std::cout << "Calibrating from " << views.size() << " of " << initialImageSpacePoints_.size() << " views" << std::endl;
+    }
+    worker_.submit(makeJob(std::move(views), false, fullCalibrationIterations));
+}
+
+void Calibration::CompareViewSelection()
+{
+    if (initialImageSpacePoints_.empty()) {
+        return;
+    }
+    // selection is part of the cost of the subset
+    const auto start = std::chrono::steady_clock::now();
+    auto views = selectViews();
+    const double selectionMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    worker_.submit(makeJob(std::move(views), false, fullCalibrationIterations, true, selectionMs));
+}
+
+std::vector<size_t> Calibration::selectViews() const
+{
+    if (!ViewSelection) {
+        std::vector<size_t> views(initialImageSpacePoints_.size());
+        std::iota(views.begin(), views.end(), size_t(0));
+        return views;
+    }
+    std::vector<ViewSelector::Features> features;
+    features.reserve(initialImageSpacePoints_.size());
+    for (size_t i = 0; i < initialImageSpacePoints_.size(); ++i) {
+        features.push_back(ViewSelector::describe(initialObjectSpacetPoints_[i], initialImageSpacePoints_[i], cameraResolution_));
+    }
+    return ViewSelector::select(features, ViewBudget, ViewMinDistance);
+}
+
+CalibrationWorker::Job Calibration::makeJob(std::vector<size_t>&& views, bool warmStart, uint32_t maxIterations,
+                                            bool compareAllViews, double selectionMs) const
+{
+    return CalibrationWorker::Job{initialObjectSpacetPoints_, initialImageSpacePoints_, std::move(views), cameraResolution_, warmStart, maxIterations,
+                                  Solver, compareAllViews, selectionMs};
+}
+
+void Calibration::refineCameraMat()
+{
+    // intrinsics loaded from the store are a fine guess, but still need
+    // enough views to not be pulled off by the first few
+    if (initialImageSpacePoints_.size() < IncrementalMinViews) {
+        return;
+    }
+    if (!worker_.getIntrinsics()) {
+        CalcCameraMat();
+        return;
+    }
+    // one more view barely moves the optimum of the previous ones, a few
+    // iterations from the newest intrinsics settle it
+    worker_.submit(makeJob(selectViews(), true, IncrementalIterations));
+}
+
+bool Calibration::SetIntrinsicsStore(const std::string& path, const std::string& cameraId)
+{
+    intrinsicsPath_ = path;
+    cameraId_ = cameraId;
+    IntrinsicsRecord record;
+    if (path.empty() || !IntrinsicsStore::find(path, cameraId, cameraResolution_, record)) {
+        return false;
+    }
+    auto intrinsics = std::make_shared<Intrinsics>();
+    intrinsics->CameraMatrix = cv::Matx33d(record.CameraMatrix);
+    intrinsics->DistortionCoefficients = cv::Mat(static_cast<int>(record.DistortionCount), 1, CV_64F, record.DistortionCoefficients).clone();
+    std::copy(std::begin(record.ProjMat), std::end(record.ProjMat), intrinsics->ProjMat);
+    intrinsics->ReprojectionError = record.ReprojectionError;
+    if (!worker_.publish(std::move(intrinsics))) {
+        // a calibration already started, its result replaces the stored one
+        return false;
+    }
+    std::cout << "Loaded intrinsics of " << cameraId << " from " << path << std::endl;
+    return true;
+}
+
+void Calibration::saveIntrinsics(const Intrinsics& intrinsics) const
+{
+    if (intrinsicsPath_.empty()) {
+        return;
+    }
+    IntrinsicsRecord record{};
+    IntrinsicsStore::setCameraId(record, cameraId_);
+    record.Width = cameraResolution_.width;
+    record.Height = cameraResolution_.height;
+    std::copy(intrinsics.CameraMatrix.val, intrinsics.CameraMatrix.val + 9, record.CameraMatrix);
+    record.DistortionCount = static_cast<uint32_t>(std::min<size_t>(intrinsics.DistortionCoefficients.total(), IntrinsicsMaxDistortion));
+    for (uint32_t i = 0; i < record.DistortionCount; ++i) {
+        record.DistortionCoefficients[i] = intrinsics.DistortionCoefficients.at<double>(static_cast<int>(i));
+    }
+    std::copy(std::begin(intrinsics.ProjMat), std::end(intrinsics.ProjMat), record.ProjMat);
+    record.ReprojectionError = intrinsics.ReprojectionError;
+    IntrinsicsStore::store(intrinsicsPath_, record);
 }
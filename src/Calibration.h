@@ -1,11 +1,17 @@
+#pragma once
+
+#include <atomic>
 #include <memory>
 #include <vector>
 #include <string>
+#include <thread>
 #include <opencv2/core/mat.hpp>
+#include <opencv2/core/matx.hpp>
 
-// mat4 is equivalent to float[16]
-typedef float mat4[16];
-class Texture;
+#include "CalibrationWorker.h"
+#include "FrameCache.h"
+#include "FrameQuality.h"
+#include "PatternDetector.h"
 
 /// python code adapted and translated:
 /// https://opencv-python-tutroals.readthedocs.io/en/latest/py_tutorials/py_calib3d/py_calibration/py_calibration.html
@@ -13,28 +19,138 @@ class Texture;
 /// https://docs.opencv.org/2.4/doc/tutorials/calib3d/camera_calibration/camera_calibration.html
 class Calibration {
   public:
-    bool CameraMatKnown;
-    cv::Mat CameraMatrix; // empty until calibration is complete
-    mat4 ProjMat;
+  /// Refine the intrinsics every time a calibration view is added instead of
+  /// only after loading a directory
+  bool IncrementalCalibration;
+  /// Views needed before the first calibration from scratch
+  uint32_t IncrementalMinViews;
+  /// Optimizer iterations per added view, warm started from the current intrinsics
+  uint32_t IncrementalIterations;
 
-  /// list of all vec3s, one for each calibrated image. Not updated after that.
-  cv::Mat InitialTranslationVectors;
-  /// list of all vec3s, one for each calibrated image. Not updated after that
-  cv::Mat InitialRotationVectors;
+  /// Calibrate from a diverse subset of the views, see ViewSelector
+  bool ViewSelection;
+  /// Most views handed to cv::calibrateCamera, 0 for no limit
+  uint32_t ViewBudget;
+  /// Views closer than this to a selected one in ViewSelector::Features are dropped
+  float ViewMinDistance;
 
-  cv::Mat DistortionCoefficients;
+  /// Solver used by CalcCameraMat, the incremental refinement always uses SparseCalibration
+  CalibrationWorker::Solver Solver;
 
   std::vector<std::string> CalibImageNames;
-  std::vector<std::unique_ptr<Texture>> CalibImages;
+  /// Downscaled copies of the calibration images for previews. Kept on the
+  /// CPU so calibration works without a GL context; the UI uploads them.
+  /// Images loaded from the corner cache are empty until SetPreview stores one LoadPreview decoded.
+  std::vector<cv::Mat> CalibImages;
+  /// Incremented whenever CalibImages changes so previews know to refresh
+  uint32_t CalibImagesVersion;
+
+  /// Coarse-to-fine detection: the board is searched in a copy downscaled by
+  /// this factor and the corners are refined at full resolution. 1 searches
+  /// the full resolution image directly.
+  float CoarseScale;
+  /// Search the full resolution image when the coarse pass misses the board
+  bool CoarseFallback;
+
+  /// Only search a padded box around the board of the previous frame
+  bool RoiTracking;
+  /// Padding added around the previous board on every side, relative to its size
+  float RoiPadding;
+  /// Consecutive misses inside the box after which the full frame is searched
+  uint32_t RoiMaxMisses;
+
+  /// Follow the corners of the last detection with pyramidal Lucas-Kanade
+  /// optical flow and only run the detector every few frames
+  bool FlowTracking;
+  /// Frames tracked by flow before the detector runs again
+  uint32_t FlowRedetectInterval;
+  /// Mean flow error above which tracking is considered lost
+  float FlowMaxError;
+
+  /// Skip detection and calibration views on blurred or badly exposed frames
+  bool QualityGating;
+  /// Laplacian variance below which a frame counts as blurred
+  float MinSharpness;
+  /// Fraction of clipped pixels above which a frame counts as badly exposed
+  float MaxClippedRatio;
+
+  /// Progress of a LoadFromDirectory running in the background
+  struct LoadProgress {
+      /// Images decoded and searched so far
+      uint32_t Processed;
+      /// Images found in the directory
+      uint32_t Total;
+      /// Whether a load is running or waiting for FinishLoad
+      bool Loading;
+  };
 
   private:
+    /// Outcome of loading one calibration image, merged in file order
+    struct LoadedImage {
+        std::string Name;
+        std::string Path;
+        bool Found;
+        cv::Size ImageSize;
+        std::vector<cv::Point2f> Corners;
+        /// empty if the points came from the corner cache
+        cv::Mat Preview;
+    };
+
+    /// Indices of the views to calibrate from, all of them without ViewSelection
+    std::vector<size_t> selectViews() const;
+    /// Copy the current views into a calibration job
+    CalibrationWorker::Job makeJob(std::vector<size_t>&& views, bool warmStart, uint32_t maxIterations,
+                                   bool compareAllViews = false, double selectionMs = 0.0) const;
+    /// Write the intrinsics to the store set with SetIntrinsicsStore, if any.
+    /// Runs on the calibration worker.
+    void saveIntrinsics(const Intrinsics& intrinsics) const;
+    /// Fold the newest calibration view into the intrinsics, calibrating from
+    /// scratch once enough views exist
+    void refineCameraMat();
+    /// Store a preview of a calibration image in CalibImages
+    void addPreview(const cv::Mat& image);
+    /// Run the detector on a live frame, restricted to the last board if enabled
+    bool detectInFrame(const FrameCache& frame);
+    /// Move imageSpacePoints_ from the previous frame to the current one with
+    /// optical flow. Returns false if tracking quality is too low.
+    bool trackCorners(const FrameCache& frame);
+
     cv::Size cameraResolution_;
-    cv::Size patternSize_;
+    /// IntrinsicsStore every calibration is saved to, empty if none
+    std::string intrinsicsPath_;
+    std::string cameraId_;
+    std::unique_ptr<PatternDetector> detector_;
+    /// side of a chessboard square or distance between circles in meters
+    float sideSquare_;
     // these values are for the extrinsics, so they only contain info on the
     // current frame.
-    cv::Mat rotationVec_;
-    cv::Mat translationVec_;
+    // fixed size so updating the pose does not allocate, solvePnP starts from them with usePrevFrame
+    cv::Vec3d rotationVec_;
+    cv::Vec3d translationVec_;
     std::vector<cv::Point2f> imageSpacePoints_;
+    /// bounding box of the board in the last frame it was found, empty if lost
+    cv::Rect lastBoardBounds_;
+    uint32_t roiMisses_;
+    std::vector<cv::Point2f> flowPoints_;
+    std::vector<unsigned char> flowStatus_;
+    std::vector<float> flowError_;
+    /// whether imageSpacePoints_ belong to the previous frame and can be followed
+    bool flowValid_;
+    uint32_t framesSinceDetection_;
+    /// quality of the frame DetectPattern saw last
+    FrameQuality lastQuality_;
+    /// background directory load, results are only touched by loadThread_
+    /// until loadReady_ is set
+    std::thread loadThread_;
+    std::vector<LoadedImage> loadedImages_;
+    /// file of every entry of CalibImages
+    std::vector<std::string> calibImagePaths_;
+    /// object points of the pattern the background load searches for
+    std::vector<cv::Vec3f> loadObjectPoints_;
+    std::atomic<uint32_t> loadProcessed_;
+    std::atomic<uint32_t> loadTotal_;
+    std::atomic<bool> loadReady_;
+    std::atomic<bool> loadActive_;
     /// 3d points in real world space with z = 0 (2D paper)
     std::vector<cv::Vec3f> objectSpacePoints_;
     // these are lists for each calibration image, only used at the start for
@@ -44,19 +160,83 @@ class Calibration {
     std::vector<std::vector<cv::Vec3f>> initialObjectSpacetPoints_;
     /// in each frame the capture is different, so different image coordinates for each frame
     std::vector<std::vector<cv::Point2f>> initialImageSpacePoints_;
+    /// declared last so it stops before the members its callback reads are destroyed
+    CalibrationWorker worker_;
 
 public:
     /// calibration with chessboard pattern. PatternWidth and height are the inner corners (squares - 1)
     Calibration(const cv::Size& patternSize, const cv::Size& cameraResolution, float sideSquare);
-    /// Load Calibration Images from selected directory and reject those which don't detect the board
-    void LoadFromDirectory(const std::string& path);
+    /// Switch the pattern detector backend and the pattern it searches for.
+    /// Calibration views taken so far keep the object points of their pattern.
+    void SetDetector(PatternDetector::Type type, const cv::Size& patternSize);
+    /// Detector backend in use, its Flags may be changed
+    inline PatternDetector& GetDetector() { return *detector_; };
+    ~Calibration();
+    /// Keep the intrinsics of this camera in the IntrinsicsStore at path: the
+    /// record of cameraId at the camera resolution is loaded right away and
+    /// every calibration from now on replaces it. Returns whether a record was
+    /// loaded. Call before the first calibration.
+    bool SetIntrinsicsStore(const std::string& path, const std::string& cameraId);
+    /// Load Calibration Images from selected directory and reject those which don't detect the board.
+    /// Blocks until the images are loaded and, with calibrate, the camera is calibrated.
+    void LoadFromDirectory(const std::string& path, bool calibrate = true);
+    /// Start loading the calibN.png images of a directory on background threads.
+    /// Decoding and detection are spread over all cores, images which did not
+    /// change since the last load take their points from the CornerCache
+    /// sidecar. Returns false if a load is already running.
+    bool StartLoadFromDirectory(const std::string& path);
+    /// Merge the images of a finished background load in file order and, with
+    /// calibrate, start calibrating. Returns false if no load has finished. Does not block.
+    bool FinishLoad(bool calibrate = true);
+    /// Progress of the background load, safe to call without holding the calibration lock
+    LoadProgress GetLoadProgress() const;
+    /// Decode the preview of the image at path, empty if it can't be read.
+    /// Reads the file, so call it without holding the calibration lock.
+    static cv::Mat LoadPreview(const std::string& path);
+    /// File of CalibImages[index], whose preview LoadPreview decodes
+    inline const std::string& GetImagePath(size_t index) const { return calibImagePaths_[index]; };
+    /// Store a preview LoadPreview decoded for CalibImages[index]. Does not
+    /// change CalibImagesVersion.
+    void SetPreview(size_t index, cv::Mat preview);
     /// Same the current frame in the the selected directory
     void TakeCapture(const std::string& path, const cv::Mat& frame);
-    /// Find corners of the chessboard and if so, optionally draw them. Returns if the pattern was detected
-    bool DetectPattern(cv::Mat frame, bool addImage, bool drawCalibrationColors = true);
-    /// update the rotation mat. Returns true if correctly updated.
+    /// Derived images DetectPattern needs in the frame cache with the current settings
+    FrameCache::Options GetFrameCacheOptions() const;
+    /// Whether a frame of this quality passes the gating thresholds, always true with QualityGating off
+    bool IsQualityAcceptable(const FrameQuality& quality) const;
+    /// Quality of the frame of the last DetectPattern
+    inline const FrameQuality& GetLastQuality() const { return lastQuality_; };
+    /// Find corners of the chessboard and if so, optionally draw them. Frames
+    /// which don't pass the quality gate are not searched. Returns if the pattern was detected
+    bool DetectPattern(const FrameCache& frame, bool addImage, bool drawCalibrationColors = true);
+    /// update the rotation mat with the newest intrinsics. Returns true if correctly updated.
     bool UpdateRotTransMat(mat4 &objectMatrix, float scaling_factor, bool usePrevFrame);
-    /// get the camera matrix via opencv and copy it to a float16 mat4.
-    /// automatically also updates rotation and translation vectors
+    /// Object matrix [scale * R | -t] of a board pose as column-major mat4, computed on the stack
+    static void PoseToObjectMatrix(const cv::Vec3d& rotation, const cv::Vec3d& translation, float scaling_factor, mat4& objectMatrix);
+    /// Board pose of the last UpdateRotTransMat as OpenCV rotation and translation vectors
+    void GetPose(cv::Vec3d& rotation, cv::Vec3d& translation) const;
+    /// Corners found by the last DetectPattern, in the order of GetObjectPoints
+    inline const std::vector<cv::Point2f>& GetImagePoints() const { return imageSpacePoints_; };
+    /// Board positions of the pattern points in meters
+    inline const std::vector<cv::Vec3f>& GetObjectPoints() const { return objectSpacePoints_; };
+    /// Calibration views collected so far
+    inline size_t GetViewCount() const { return initialImageSpacePoints_.size(); };
+    /// Start calibrating from the views collected so far on the calibration
+    /// worker. Tracking keeps the previous intrinsics until it is done.
     void CalcCameraMat();
+    /// Newest intrinsics, null until the camera is calibrated. Safe to call
+    /// without holding the calibration lock, the snapshot never changes.
+    inline std::shared_ptr<const Intrinsics> GetIntrinsics() const { return worker_.getIntrinsics(); };
+    /// Progress of the calibration worker, safe to call without holding the calibration lock
+    inline CalibrationWorker::Progress GetCalibrationProgress() const { return worker_.getProgress(); };
+    /// Abandon the running calibration and keep the previous intrinsics
+    inline void CancelCalibration() { worker_.cancel(); };
+    /// Block until the calibration worker is idle
+    inline void WaitForCalibration() { worker_.wait(); };
+    /// Start calibrating from all views and from the selected ones on the
+    /// calibration worker, timing both. The result of the selected ones is
+    /// published, the comparison shows in GetViewSelectionReport once done.
+    void CompareViewSelection();
+    /// Result of the last CompareViewSelection, AllViews is 0 before the first
+    inline CalibrationWorker::ViewSelectionReport GetViewSelectionReport() const { return worker_.getViewSelectionReport(); };
 };
@@ -0,0 +1,345 @@
+#include "CalibrationWorker.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <numeric>
+
+#include <opencv2/calib3d.hpp>
+
+#include "SparseCalibration.h"
+
+namespace
+{
+/// Solver iterations of SparseCalibration between two progress updates and cancel checks
+constexpr uint32_t iterationsPerRound = 5;
+/// Share of the progress spent in the solver, the rest poses the skipped views
+constexpr float solverProgress = 0.9f;
+} // namespace
+
+CalibrationWorker::CalibrationWorker(std::function<void(const Intrinsics&)> onPublished)
+    : onPublished_(std::move(onPublished))
+    , busy_(false)
+    , stop_(false)
+    , viewSelectionReport_{0, 0, 0.0, 0.0, 0.0, 0.0}
+    , cancel_(false)
+    , progress_(0.0f)
+    , indeterminate_(false)
+    , running_(false)
+    , thread_(&CalibrationWorker::run, this)
+{
+}
+
+CalibrationWorker::~CalibrationWorker()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+        cancel_ = true;
+        pending_.reset();
+    }
+    condition_.notify_all();
+    thread_.join();
+}
+
+void CalibrationWorker::submit(Job&& job)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (pending_ && !pending_->WarmStart && job.WarmStart) {
+            // a warm start must not replace a calibration from scratch which did
+            // not run yet, calibrate the newer views from scratch instead
+            job.WarmStart = false;
+            job.MaxIterations = std::max(job.MaxIterations, pending_->MaxIterations);
+        }
+        if (pending_ && pending_->CompareAllViews && !job.CompareAllViews) {
+            // the requested comparison still runs, on the newer views
+            job.CompareAllViews = true;
+            job.SelectionMs = pending_->SelectionMs;
+        }
+        pending_ = std::move(job);
+        running_ = true;
+    }
+    condition_.notify_all();
+}
+
+void CalibrationWorker::cancel()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    pending_.reset();
+    if (busy_) {
+        cancel_ = true;
+    } else {
+        running_ = false;
+    }
+}
+
+void CalibrationWorker::wait()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    condition_.wait(lock, [this]() { return !busy_ && !pending_; });
+}
+
+CalibrationWorker::Progress CalibrationWorker::getProgress() const
+{
+    return Progress{progress_, running_, indeterminate_};
+}
+
+CalibrationWorker::ViewSelectionReport CalibrationWorker::getViewSelectionReport() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return viewSelectionReport_;
+}
+
+bool CalibrationWorker::publish(std::shared_ptr<const Intrinsics> intrinsics)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (busy_ || pending_) {
+        return false;
+    }
+    intrinsics_.store(std::move(intrinsics), std::memory_order_release);
+    return true;
+}
+
+void CalibrationWorker::run()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        condition_.wait(lock, [this]() { return stop_ || pending_; });
+        if (stop_) {
+            break;
+        }
+        Job job = std::move(*pending_);
+        pending_.reset();
+        busy_ = true;
+        cancel_ = false;
+        progress_ = 0.0f;
+        // only now, a calibration which ran until here is what the job continues from
+        const auto guess = job.WarmStart ? intrinsics_.load(std::memory_order_acquire) : nullptr;
+        indeterminate_ = job.Method == Solver::OpenCV && !job.WarmStart;
+        lock.unlock();
+
+        using Milliseconds = std::chrono::duration<double, std::milli>;
+        std::shared_ptr<const Intrinsics> all;
+        double allMs = 0.0;
+        if (job.CompareAllViews) {
+            std::vector<size_t> selected = std::move(job.Views);
+            job.Views.resize(job.ImagePoints.size());
+            std::iota(job.Views.begin(), job.Views.end(), size_t(0));
+            const auto start = std::chrono::steady_clock::now();
+            all = calibrate(job, guess, cancel_, progress_);
+            allMs = Milliseconds(std::chrono::steady_clock::now() - start).count();
+            job.Views = std::move(selected);
+        }
+        const auto start = std::chrono::steady_clock::now();
+        auto intrinsics = calibrate(job, guess, cancel_, progress_);
+        const double selectedMs = job.SelectionMs + Milliseconds(std::chrono::steady_clock::now() - start).count();
+        if (intrinsics) {
+            intrinsics_.store(intrinsics, std::memory_order_release);
+            if (onPublished_) {
+                onPublished_(*intrinsics);
+            }
+        }
+
+        lock.lock();
+        if (all && intrinsics) {
+            viewSelectionReport_ = ViewSelectionReport{static_cast<uint32_t>(job.ImagePoints.size()), static_cast<uint32_t>(job.Views.size()), allMs,
+                                                       selectedMs, all->ReprojectionError, intrinsics->ReprojectionError};
+            std::printf("All %u views: %.1f ms, %.3f px. Selected %u views: %.1f ms, %.3f px\n", viewSelectionReport_.AllViews, allMs,
+                        all->ReprojectionError, viewSelectionReport_.SelectedViews, selectedMs, intrinsics->ReprojectionError);
+        }
+        busy_ = false;
+        running_ = pending_.has_value();
+        condition_.notify_all();
+    }
+}
+
+std::shared_ptr<const Intrinsics> CalibrationWorker::calibrate(const Job& job, const std::shared_ptr<const Intrinsics>& guess, const std::atomic<bool>& cancel,
+                                                               std::atomic<float>& progress)
+{
+    const size_t viewCount = job.ImagePoints.size();
+    // a few warm start iterations are no calibration from scratch, refineCameraMat
+    // only warm starts once intrinsics were published
+    if (job.Views.empty() || viewCount != job.ObjectPoints.size() || job.MaxIterations == 0 || (job.WarmStart && !guess)) {
+        return nullptr;
+    }
+    // the solver only sees the selected views, copied only if they are a subset
+    const bool allViews = job.Views.size() == viewCount;
+    std::vector<std::vector<cv::Vec3f>> selectedObjectPoints;
+    std::vector<std::vector<cv::Point2f>> selectedImagePoints;
+    if (!allViews) {
+        selectedObjectPoints.reserve(job.Views.size());
+        selectedImagePoints.reserve(job.Views.size());
+        for (size_t view : job.Views) {
+            selectedObjectPoints.push_back(job.ObjectPoints[view]);
+            selectedImagePoints.push_back(job.ImagePoints[view]);
+        }
+    }
+    const auto& objectPoints = allViews ? job.ObjectPoints : selectedObjectPoints;
+    const auto& imagePoints = allViews ? job.ImagePoints : selectedImagePoints;
+
+    cv::Mat cameraMatrix = cv::Mat::eye(3, 3, CV_64F);
+    cv::Mat distortion = cv::Mat::zeros(8, 1, CV_64F);
+    cv::Mat rotations;
+    cv::Mat translations;
+    double error = 0.0;
+    try {
+        // a warm start always refines with SparseCalibration: it starts from the
+        // poses of the previous calibration, cv::calibrateCamera would pose
+        // every view again and solve the dense system over all of them
+        if (job.Method == Solver::Sparse || job.WarmStart) {
+            SparseCalibration solver(objectPoints, imagePoints, job.Resolution);
+            bool initialized = false;
+            if (job.WarmStart) {
+                // views are only ever appended, the ones the previous calibration posed come first
+                const int posedCount = std::min(guess->RotationVectors.rows, guess->TranslationVectors.rows);
+                const int seedCount = static_cast<int>(std::lower_bound(job.Views.begin(), job.Views.end(), static_cast<size_t>(posedCount)) - job.Views.begin());
+                cv::Mat seedRotations(seedCount, 1, CV_64FC3);
+                cv::Mat seedTranslations(seedCount, 1, CV_64FC3);
+                for (int i = 0; i < seedCount; ++i) {
+                    seedRotations.at<cv::Vec3d>(i) = guess->RotationVectors.at<cv::Vec3d>(static_cast<int>(job.Views[i]));
+                    seedTranslations.at<cv::Vec3d>(i) = guess->TranslationVectors.at<cv::Vec3d>(static_cast<int>(job.Views[i]));
+                }
+                initialized = solver.initialize(guess->CameraMatrix, guess->DistortionCoefficients, seedRotations, seedTranslations);
+            } else {
+                initialized = solver.initialize();
+            }
+            if (!initialized) {
+                return nullptr;
+            }
+            for (uint32_t iterations = 0; iterations < job.MaxIterations && !solver.hasConverged();) {
+                if (cancel) {
+                    return nullptr;
+                }
+                const uint32_t round = std::min(iterationsPerRound, job.MaxIterations - iterations);
+                solver.iterate(round);
+                iterations += round;
+                progress = solverProgress * iterations / job.MaxIterations;
+            }
+            cameraMatrix = cv::Mat(solver.getCameraMatrix(), true);
+            distortion = solver.getDistortion();
+            solver.getPoses(rotations, translations);
+            error = solver.getError();
+        } else {
+            // one call with every iteration: each call initializes the poses of
+            // all views and the damping again, rounds would not continue where
+            // the previous one stopped. OpenCV reports no progress meanwhile.
+            error = cv::calibrateCamera(objectPoints, imagePoints, job.Resolution, cameraMatrix, distortion, rotations, translations, 0,
+                                        cv::TermCriteria(cv::TermCriteria::COUNT + cv::TermCriteria::EPS, static_cast<int>(job.MaxIterations), DBL_EPSILON));
+            if (cancel) {
+                return nullptr;
+            }
+            progress = solverProgress;
+        }
+    } catch (cv::Exception& e) {
+        std::fprintf(stderr, "Calibration failed: %s\n", e.what());
+        return nullptr;
+    }
+
+    auto intrinsics = std::make_shared<Intrinsics>();
+    intrinsics->CameraMatrix = cameraMatrix;
+    intrinsics->DistortionCoefficients = distortion;
+    toProjection(intrinsics->CameraMatrix, intrinsics->ProjMat);
+    if (allViews) {
+        intrinsics->RotationVectors = rotations;
+        intrinsics->TranslationVectors = translations;
+        intrinsics->ReprojectionError = error;
+        progress = 1.0f;
+        return intrinsics;
+    }
+
+    // every view keeps a pose for the previews and counts in the error, the
+    // skipped ones are cheap to solve with known intrinsics
+    std::vector<int> selectedIndex(viewCount, -1);
+    for (size_t i = 0; i < job.Views.size(); ++i) {
+        selectedIndex[job.Views[i]] = static_cast<int>(i);
+    }
+    intrinsics->RotationVectors.create(static_cast<int>(viewCount), 1, CV_64FC3);
+    intrinsics->TranslationVectors.create(static_cast<int>(viewCount), 1, CV_64FC3);
+    std::vector<cv::Point2f> projected;
+    double squaredError = 0.0;
+    size_t pointCount = 0;
+    for (size_t i = 0; i < viewCount; ++i) {
+        if (cancel) {
+            return nullptr;
+        }
+        cv::Vec3d rotation;
+        cv::Vec3d translation;
+        if (selectedIndex[i] >= 0) {
+            rotation = rotations.at<cv::Vec3d>(selectedIndex[i]);
+            translation = translations.at<cv::Vec3d>(selectedIndex[i]);
+        } else {
+            cv::solvePnP(job.ObjectPoints[i], job.ImagePoints[i], cameraMatrix, distortion, rotation, translation);
+        }
+        intrinsics->RotationVectors.at<cv::Vec3d>(static_cast<int>(i)) = rotation;
+        intrinsics->TranslationVectors.at<cv::Vec3d>(static_cast<int>(i)) = translation;
+        cv::projectPoints(job.ObjectPoints[i], rotation, translation, cameraMatrix, distortion, projected);
+        for (size_t j = 0; j < projected.size(); ++j) {
+            const cv::Point2f offset = projected[j] - job.ImagePoints[i][j];
+            squaredError += offset.dot(offset);
+        }
+        pointCount += projected.size();
+        progress = solverProgress + (1.0f - solverProgress) * (i + 1) / viewCount;
+    }
+    intrinsics->ReprojectionError = pointCount > 0 ? std::sqrt(squaredError / pointCount) : 0.0;
+    return intrinsics;
+}
+
+const char* CalibrationWorker::getSolverName(Solver solver)
+{
+    switch (solver) {
+    case Solver::OpenCV:
+        return "opencv";
+    case Solver::Sparse:
+        return "sparse";
+    default:
+        return "unknown";
+    }
+}
+
+bool CalibrationWorker::parseSolver(std::string_view name, Solver& solver)
+{
+    for (int i = 0; i < static_cast<int>(Solver::Count); ++i) {
+        if (name == getSolverName(static_cast<Solver>(i))) {
+            solver = static_cast<Solver>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+/// This removes the infinite far plane of OpenCV but points at infinity are
+/// Mapped to behind the camera.
+void CalibrationWorker::toProjection(const cv::Matx33d& cameraMatrix, mat4& projection)
+{
+    const double fx = cameraMatrix(0, 0);
+    const double fy = cameraMatrix(1, 1);
+    const double cx = cameraMatrix(0, 2);
+    const double cy = cameraMatrix(1, 2);
+
+    const float zfar = 200.f;
+    const float znear = 0.01f;
+
+    // Infinite projection
+    projection[0] = -static_cast<float>(fx / cx);
+    projection[1] = 0.0f;
+    projection[2] = 0.0f;
+    projection[3] = 0.0f;
+
+    projection[4] = 0.0f;
+    projection[5] = static_cast<float>(fy / cy);
+    projection[6] = 0.0f;
+    projection[7] = 0.0f;
+
+    projection[8] = 0.0f;
+    projection[9] = 0.0f;
+    projection[10] = (zfar + znear) / (znear - zfar);
+    projection[11] = -1.0f;
+
+    projection[12] = 0.0f;
+    projection[13] = 0.0f;
+    projection[14] = 2.0f * zfar * znear / (znear - zfar);
+    projection[15] = 0.0f;
+}
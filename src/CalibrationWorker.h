@@ -0,0 +1,150 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <opencv2/core/mat.hpp>
+#include <opencv2/core/matx.hpp>
+
+// mat4 is equivalent to float[16]
+typedef float mat4[16];
+
+/// Result of one calibration. Published as a whole and never changed
+/// afterwards, so any thread can read it without holding a lock.
+struct Intrinsics {
+    cv::Matx33d CameraMatrix;
+    cv::Mat DistortionCoefficients;
+    /// CameraMatrix as OpenGL projection
+    mat4 ProjMat;
+    /// RMS reprojection error over all views in pixels
+    double ReprojectionError;
+    /// Board pose of every calibration view as rows of CV_64FC3, empty for
+    /// intrinsics which were loaded instead of calibrated
+    cv::Mat RotationVectors;
+    cv::Mat TranslationVectors;
+};
+
+/// Runs the calibration solver on its own thread so neither rendering nor
+/// tracking wait for it. Readers take the newest Intrinsics from an atomic
+/// shared pointer and keep using the previous ones until a calibration is
+/// done. std::atomic<std::shared_ptr> is not lock-free in libstdc++ or MSVC,
+/// both guard it with a short internal lock. A load only holds that lock for
+/// the reference count increment, so readers never wait for a calibration,
+/// only for a concurrent load or store. SparseCalibration runs in rounds of a
+/// few iterations so it can report progress and be cancelled between rounds.
+/// cv::calibrateCamera runs in one call, its progress is indeterminate and a
+/// cancel takes effect once it returns. WarmStart jobs always refine with
+/// SparseCalibration, starting from the poses of the newest intrinsics.
+class CalibrationWorker
+{
+public:
+    enum class Solver {
+        /// cv::calibrateCamera, dense normal equations over all views
+        OpenCV,
+        /// SparseCalibration, linear in the number of views
+        Sparse,
+        Count,
+    };
+
+    /// Everything a calibration needs, copied so views can be added meanwhile
+    struct Job {
+        std::vector<std::vector<cv::Vec3f>> ObjectPoints;
+        std::vector<std::vector<cv::Point2f>> ImagePoints;
+        /// Views handed to the solver in ascending order, the others only get a pose
+        std::vector<size_t> Views;
+        cv::Size Resolution;
+        /// Start from the intrinsics and view poses published when the job
+        /// starts rather than when it was submitted, so it continues from a
+        /// calibration which was still running meanwhile. Otherwise calibrate from scratch.
+        bool WarmStart;
+        uint32_t MaxIterations;
+        Solver Method;
+        /// Calibrate from every view first as well and time both, see getViewSelectionReport
+        bool CompareAllViews;
+        /// Time the caller spent selecting Views, counted as part of the selected calibration
+        double SelectionMs;
+    };
+
+    /// Cost and accuracy of calibrating from the selected views against all of
+    /// them. Both errors are measured over every view.
+    struct ViewSelectionReport {
+        uint32_t AllViews;
+        uint32_t SelectedViews;
+        double AllMs;
+        double SelectedMs;
+        double AllError;
+        double SelectedError;
+    };
+
+    struct Progress {
+        /// Share of the job done, a cancelled or converged job ends early
+        float Fraction;
+        /// Whether a job is queued or running
+        bool Running;
+        /// Whether the solver reports no progress, Fraction then stays put until it returns
+        bool Indeterminate;
+    };
+
+    /// onPublished is called on the worker thread with every new calibration
+    explicit CalibrationWorker(std::function<void(const Intrinsics&)> onPublished);
+    ~CalibrationWorker();
+
+    /// Calibrate on the worker thread, replacing a job which did not start yet.
+    /// A WarmStart job replacing one without calibrates from scratch with the
+    /// larger MaxIterations of both, so incremental refinement never drops a
+    /// queued full calibration.
+    void submit(Job&& job);
+    /// Stop the running job after its current round and drop the queued one.
+    /// The previous intrinsics stay published.
+    void cancel();
+    /// Block until no job is queued or running
+    void wait();
+    Progress getProgress() const;
+    /// Result of the last job with CompareAllViews, AllViews is 0 before the first
+    ViewSelectionReport getViewSelectionReport() const;
+
+    /// Newest intrinsics, null until the first calibration finished
+    inline std::shared_ptr<const Intrinsics> getIntrinsics() const { return intrinsics_.load(std::memory_order_acquire); };
+    /// Replace the intrinsics without calibrating, like ones loaded from disk.
+    /// Only the worker thread writes the snapshot and the store while a job is
+    /// queued or running, so this is dropped then and returns false: the job
+    /// publishes newer intrinsics anyway.
+    bool publish(std::shared_ptr<const Intrinsics> intrinsics);
+
+    /// Run a job on the calling thread, a WarmStart job starts from guess.
+    /// Returns null if it failed or cancel was set.
+    static std::shared_ptr<const Intrinsics> calibrate(const Job& job, const std::shared_ptr<const Intrinsics>& guess, const std::atomic<bool>& cancel,
+                                                       std::atomic<float>& progress);
+    /// Human readable name, also accepted by parseSolver
+    static const char* getSolverName(Solver solver);
+    /// Parse a name returned by getSolverName. Returns false if it is unknown.
+    static bool parseSolver(std::string_view name, Solver& solver);
+    /// Transform an OpenCV camera matrix into an OpenGL projection matrix
+    static void toProjection(const cv::Matx33d& cameraMatrix, mat4& projection);
+
+private:
+    void run();
+
+    const std::function<void(const Intrinsics&)> onPublished_;
+    std::atomic<std::shared_ptr<const Intrinsics>> intrinsics_;
+    /// guards pending_, busy_, stop_ and viewSelectionReport_
+    mutable std::mutex mutex_;
+    std::condition_variable condition_;
+    std::optional<Job> pending_;
+    bool busy_;
+    bool stop_;
+    ViewSelectionReport viewSelectionReport_;
+    std::atomic<bool> cancel_;
+    std::atomic<float> progress_;
+    std::atomic<bool> indeterminate_;
+    std::atomic<bool> running_;
+    std::thread thread_;
+};
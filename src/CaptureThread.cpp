@@ -0,0 +1,53 @@
+#include "CaptureThread.h"
+
+#include "FrameSource.h"
+
+std::unique_ptr<CaptureThread> CaptureThread::create(std::unique_ptr<FrameSource>&& source) {
+    if (!source) {
+        return nullptr;
+    }
+    cv::Size frameSize = source->getFrameSize();
+    return std::unique_ptr<CaptureThread>(new CaptureThread(std::move(source), frameSize));
+}
+
+CaptureThread::CaptureThread(std::unique_ptr<FrameSource>&& source, const cv::Size& frameSize)
+    : source_(std::move(source))
+    , frameSize_(frameSize)
+    , dropStaleFrames_(source_->isLive())
+    , running_(true)
+{
+    // allocate every slot up front so the source decodes into reused memory
+    for (auto& slot : frames_.getSlots()) {
+        slot.Image.create(frameSize_, CV_8UC3);
+        slot.Index = 0;
+    }
+    thread_ = std::thread(&CaptureThread::run, this);
+}
+
+CaptureThread::~CaptureThread()
+{
+    running_ = false;
+    frames_.close();
+    thread_.join();
+}
+
+void CaptureThread::run()
+{
+    uint64_t index = 0;
+    while (running_) {
+        Frame& slot = frames_.getBack();
+        if (!source_->read(slot.Image, slot.CaptureTime)) {
+            break;
+        }
+        slot.Index = index++;
+        if (!frames_.publish(!dropStaleFrames_)) {
+            break;
+        }
+    }
+    frames_.close();
+}
+
+CaptureThread::Frame* CaptureThread::acquireLatest()
+{
+    return frames_.acquire(true);
+}
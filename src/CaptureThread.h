@@ -0,0 +1,68 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <thread>
+
+#include <opencv2/core/mat.hpp>
+
+#include "TripleBuffer.h"
+
+class FrameSource;
+
+/// Reads frames from a frame source on a dedicated thread so capture stalls
+/// never end up in the frame time of the render loop.
+/// Frames are written into a fixed pool of preallocated slots (triple
+/// buffering): the capture thread always owns one slot, one slot holds the
+/// newest complete frame and the consumer owns the last one. Consumers always
+/// take the newest frame, stale frames are overwritten and counted as dropped.
+/// Recorded sources are never dropped: the capture thread waits for the
+/// consumer instead so every frame of a replay gets processed.
+class CaptureThread
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Frame {
+        cv::Mat Image;
+        /// Monotonic time at which the frame was grabbed from the source
+        Clock::time_point CaptureTime;
+        /// Sequence number of the frame as read from the source
+        uint64_t Index;
+    };
+
+    /// Factory function which takes ownership of an opened frame source and
+    /// starts capturing. Returns null if there is no source.
+    static std::unique_ptr<CaptureThread> create(std::unique_ptr<FrameSource>&& source);
+    virtual ~CaptureThread();
+
+    /// Block until a frame newer than the last acquired one is available and
+    /// return it. The frame stays valid and owned by the caller until the next
+    /// call. Returns null once the source stops producing frames.
+    Frame* acquireLatest();
+
+    /// Size of the frames produced by the source
+    inline cv::Size getFrameSize() const { return frameSize_; };
+    /// The source frames are read from
+    inline const FrameSource& getSource() const { return *source_; };
+    /// Number of frames which were overwritten before a consumer acquired them
+    inline uint64_t getDroppedFrames() const { return frames_.getDropped(); };
+
+private:
+    /// Private unique constructor forcing the use of factory function which
+    /// can return null unlike constructor.
+    CaptureThread(std::unique_ptr<FrameSource>&& source, const cv::Size& frameSize);
+
+    /// Body of the capture thread
+    void run();
+
+    const std::unique_ptr<FrameSource> source_;
+    const cv::Size frameSize_;
+    /// Whether stale frames may be overwritten before they are consumed
+    const bool dropStaleFrames_;
+    TripleBuffer<Frame> frames_;
+    std::atomic<bool> running_;
+    std::thread thread_;
+};
@@ -0,0 +1,111 @@
+#include "CornerCache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+
+#include "AtomicFile.h"
+#include "MappedFile.h"
+
+namespace
+{
+/// Records start 4 byte aligned so the points can be read in place
+constexpr size_t paddedNameLength(uint32_t length)
+{
+    return (length + 3u) & ~size_t(3);
+}
+} // namespace
+
+bool CornerCache::read(const std::string& directory, const CornerCacheKey& key)
+{
+    entries_.clear();
+    const auto path = (std::filesystem::path(directory) / CornerCacheFileName).string();
+    std::error_code error;
+    if (!std::filesystem::exists(path, error)) {
+        return false;
+    }
+    auto file = MappedFile::open(path, MappedFile::Access::ReadCopyOnWrite);
+    if (!file || file->getSize() < sizeof(CornerCacheHeader)) {
+        return false;
+    }
+
+    CornerCacheHeader header;
+    std::memcpy(&header, file->getData(), sizeof(header));
+    if (std::memcmp(header.Magic, CornerCacheMagic, sizeof(header.Magic)) != 0 || header.Version != CornerCacheVersion ||
+        std::memcmp(&header.Key, &key, sizeof(key)) != 0) {
+        return false;
+    }
+
+    const uint8_t* data = file->getData();
+    size_t offset = sizeof(header);
+    entries_.reserve(header.EntryCount);
+    for (uint32_t i = 0; i < header.EntryCount; ++i) {
+        CornerCacheRecord record;
+        if (offset + sizeof(record) > file->getSize()) {
+            break;
+        }
+        std::memcpy(&record, data + offset, sizeof(record));
+        offset += sizeof(record);
+        const size_t nameLength = paddedNameLength(record.NameLength);
+        const size_t pointsSize = record.PointCount * sizeof(cv::Point2f);
+        if (offset + nameLength + pointsSize > file->getSize()) {
+            break;
+        }
+        std::string name(reinterpret_cast<const char*>(data + offset), record.NameLength);
+        offset += nameLength;
+
+        Entry entry{record.FileSize, record.ModifiedTime, cv::Size(record.Width, record.Height), record.Found != 0,
+                    std::vector<cv::Point2f>(record.PointCount)};
+        std::memcpy(entry.Points.data(), data + offset, pointsSize);
+        offset += pointsSize;
+        entries_.emplace(std::move(name), std::move(entry));
+    }
+    if (entries_.size() != header.EntryCount) {
+        std::fprintf(stderr, "Corner cache %s is truncated, ignoring it\n", path.c_str());
+        entries_.clear();
+        return false;
+    }
+    return true;
+}
+
+bool CornerCache::write(const std::string& directory, const CornerCacheKey& key) const
+{
+    const auto path = (std::filesystem::path(directory) / CornerCacheFileName).string();
+    const bool written = AtomicFile::write(path, [this, &key](FILE* file) {
+        CornerCacheHeader header;
+        std::memcpy(header.Magic, CornerCacheMagic, sizeof(header.Magic));
+        header.Version = CornerCacheVersion;
+        header.EntryCount = static_cast<uint32_t>(entries_.size());
+        header.Key = key;
+        bool written = std::fwrite(&header, sizeof(header), 1, file) == 1;
+        const char padding[4] = {};
+        for (const auto& [name, entry] : entries_) {
+            CornerCacheRecord record{entry.FileSize, entry.ModifiedTime, entry.ImageSize.width, entry.ImageSize.height, entry.Found ? 1u : 0u,
+                                     static_cast<uint32_t>(entry.Points.size()), static_cast<uint32_t>(name.size()), 0};
+            written = written && std::fwrite(&record, sizeof(record), 1, file) == 1;
+            written = written && std::fwrite(name.data(), 1, name.size(), file) == name.size();
+            written = written && std::fwrite(padding, 1, paddedNameLength(record.NameLength) - name.size(), file) == paddedNameLength(record.NameLength) - name.size();
+            written = written && std::fwrite(entry.Points.data(), sizeof(cv::Point2f), entry.Points.size(), file) == entry.Points.size();
+        }
+        return written;
+    });
+    if (!written) {
+        std::fprintf(stderr, "Could not write corner cache %s\n", path.c_str());
+        return false;
+    }
+    return true;
+}
+
+const CornerCache::Entry* CornerCache::find(const std::string& name, uint64_t fileSize, int64_t modifiedTime) const
+{
+    auto entry = entries_.find(name);
+    if (entry == entries_.end() || entry->second.FileSize != fileSize || entry->second.ModifiedTime != modifiedTime) {
+        return nullptr;
+    }
+    return &entry->second;
+}
+
+void CornerCache::insert(const std::string& name, Entry&& entry)
+{
+    entries_[name] = std::move(entry);
+}
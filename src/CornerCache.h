@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <opencv2/core/types.hpp>
+
+/// Sidecar file next to a directory of calibration images holding the
+/// detected points of every image, so images which did not change since the
+/// last load are neither decoded nor searched again.
+///
+/// Layout: a CornerCacheHeader followed by EntryCount records. A record is a
+/// CornerCacheRecord, the file name padded to 4 bytes and PointCount x/y float
+/// pairs. Images are considered unchanged while their size and modification
+/// time match; the whole cache is dropped when the detection settings differ.
+struct CornerCacheKey {
+    int32_t DetectorType;
+    int32_t DetectorFlags;
+    int32_t PatternWidth;
+    int32_t PatternHeight;
+    float CoarseScale;
+    uint32_t CoarseFallback;
+};
+
+struct CornerCacheHeader {
+    char Magic[8];
+    uint32_t Version;
+    uint32_t EntryCount;
+    CornerCacheKey Key;
+};
+
+struct CornerCacheRecord {
+    uint64_t FileSize;
+    int64_t ModifiedTime;
+    int32_t Width;
+    int32_t Height;
+    uint32_t Found;
+    uint32_t PointCount;
+    uint32_t NameLength;
+    uint32_t Reserved;
+};
+
+constexpr char CornerCacheMagic[8] = {'C', 'V', 'C', 'O', 'R', 'N', '0', '1'};
+constexpr uint32_t CornerCacheVersion = 1;
+/// Name of the sidecar inside the image directory
+constexpr std::string_view CornerCacheFileName = "corners.cache";
+
+class CornerCache
+{
+public:
+    /// Detection result of one image
+    struct Entry {
+        uint64_t FileSize;
+        int64_t ModifiedTime;
+        cv::Size ImageSize;
+        bool Found;
+        std::vector<cv::Point2f> Points;
+    };
+
+    /// Read the sidecar of directory. Returns false and leaves the cache empty
+    /// if there is none, it is damaged or it was written with another key.
+    bool read(const std::string& directory, const CornerCacheKey& key);
+    /// Replace the sidecar of directory with the entries of this cache
+    bool write(const std::string& directory, const CornerCacheKey& key) const;
+
+    /// Entry of the image if it did not change since it was cached, null otherwise
+    const Entry* find(const std::string& name, uint64_t fileSize, int64_t modifiedTime) const;
+    void insert(const std::string& name, Entry&& entry);
+    inline size_t getSize() const { return entries_.size(); };
+
+private:
+    std::unordered_map<std::string, Entry> entries_;
+};
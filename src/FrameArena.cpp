@@ -0,0 +1,58 @@
+#include "FrameArena.h"
+
+#include <cstdarg>
+#include <cstdio>
+
+FrameArena::FrameArena(std::size_t capacity)
+    : block_(new uint8_t[capacity])
+    , capacity_(capacity)
+    , used_(0)
+    , overflowUsed_(0)
+{
+}
+
+FrameArena::~FrameArena() = default;
+
+void FrameArena::reset()
+{
+    if (!overflow_.empty()) {
+        // last frame did not fit: grow once so the next frames do
+        capacity_ = 2 * (capacity_ + overflowUsed_);
+        block_.reset(new uint8_t[capacity_]);
+        overflow_.clear();
+        overflowUsed_ = 0;
+    }
+    used_ = 0;
+}
+
+void* FrameArena::allocate(std::size_t size, std::size_t alignment)
+{
+    std::size_t offset = (used_ + alignment - 1) & ~(alignment - 1);
+    if (offset + size <= capacity_) {
+        used_ = offset + size;
+        return block_.get() + offset;
+    }
+    // new[] memory is aligned to max_align_t which covers all uses here
+    overflow_.emplace_back(new uint8_t[size + alignment]);
+    overflowUsed_ += size + alignment;
+    auto address = reinterpret_cast<std::uintptr_t>(overflow_.back().get());
+    return reinterpret_cast<void*>((address + alignment - 1) & ~(static_cast<std::uintptr_t>(alignment) - 1));
+}
+
+const char* FrameArena::format(const char* fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    va_list argsCopy;
+    va_copy(argsCopy, args);
+    int length = std::vsnprintf(nullptr, 0, fmt, argsCopy);
+    va_end(argsCopy);
+    if (length < 0) {
+        va_end(args);
+        return "";
+    }
+    auto text = allocate<char>(static_cast<std::size_t>(length) + 1);
+    std::vsnprintf(text, static_cast<std::size_t>(length) + 1, fmt, args);
+    va_end(args);
+    return text;
+}
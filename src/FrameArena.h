@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/// Bump allocator for scratch memory which only lives for one frame.
+/// Allocating is a pointer increment and reset() at the start of every frame
+/// releases everything at once. When a frame needs more than the capacity,
+/// overflow blocks are taken from the heap and on the next reset the arena
+/// grows to fit, so after warm-up the steady state never touches the heap.
+class FrameArena
+{
+public:
+    explicit FrameArena(std::size_t capacity);
+    ~FrameArena();
+    FrameArena(const FrameArena&) = delete;
+    FrameArena& operator=(const FrameArena&) = delete;
+
+    /// Release all allocations of the previous frame.
+    void reset();
+    /// Allocate uninitialized memory valid until the next reset.
+    void* allocate(std::size_t size, std::size_t alignment = alignof(std::max_align_t));
+    /// Allocate an uninitialized array of trivially destructible objects
+    template <typename T>
+    T* allocate(std::size_t count) { return static_cast<T*>(allocate(count * sizeof(T), alignof(T))); }
+    /// printf into arena memory, useful for widget labels which would
+    /// otherwise need std::string concatenation every frame.
+    const char* format(const char* fmt, ...);
+
+    /// Bytes handed out since the last reset
+    inline std::size_t getUsed() const { return used_ + overflowUsed_; };
+    inline std::size_t getCapacity() const { return capacity_; };
+
+private:
+    std::unique_ptr<uint8_t[]> block_;
+    std::size_t capacity_;
+    std::size_t used_;
+    std::vector<std::unique_ptr<uint8_t[]>> overflow_;
+    std::size_t overflowUsed_;
+};
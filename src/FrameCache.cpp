@@ -0,0 +1,49 @@
+#include "FrameCache.h"
+
+#include <opencv2/imgproc.hpp>
+#include <opencv2/video/tracking.hpp>
+
+#include "AllocationCounter.h"
+
+FrameCache::FrameCache()
+    : images_{}
+    , current_(0)
+{
+    images_[0].Scale = 1.0f;
+    images_[1].Scale = 1.0f;
+}
+
+void FrameCache::update(const cv::Mat& frame, const Options& options)
+{
+    current_ ^= 1;
+    Images& images = images_[current_];
+    AllocationCounter::ExternalScope opencv;
+
+    images.Color = frame;
+    if (frame.channels() == 1) {
+        images.Gray = frame;
+    } else {
+        cv::cvtColor(frame, images.Gray, cv::COLOR_BGR2GRAY);
+    }
+
+    if (options.Scale > 0.0f && options.Scale < 1.0f) {
+        cv::resize(images.Gray, images.Scaled, cv::Size(), options.Scale, options.Scale, cv::INTER_AREA);
+        images.Scale = options.Scale;
+    } else {
+        images.Scaled.release();
+        images.Scale = 1.0f;
+    }
+
+    if (options.PyramidLevels > 0) {
+        // derivatives are left to the consumers, not every one needs them
+        cv::buildOpticalFlowPyramid(images.Gray, images.Pyramid, options.PyramidWindow, options.PyramidLevels, false);
+    } else {
+        images.Pyramid.clear();
+    }
+
+    if (options.Integral) {
+        cv::integral(images.Gray, images.Integral, CV_32S);
+    } else {
+        images.Integral.release();
+    }
+}
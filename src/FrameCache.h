@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <opencv2/core/mat.hpp>
+
+/// Images derived from one captured frame. Built once per frame and handed to
+/// every vision stage, so the frame is converted to gray, downscaled and turned
+/// into a pyramid only once. The images of the previous frame are kept for
+/// stages comparing two frames, like optical flow, and all buffers are reused.
+class FrameCache
+{
+public:
+    /// Derived images a consumer needs besides the gray image
+    struct Options {
+        /// Factor of the downscaled gray image, 1 skips it
+        float Scale;
+        /// Levels of the pyramid above the gray image, 0 skips it
+        int PyramidLevels;
+        /// Window the pyramid borders are padded for, see cv::buildOpticalFlowPyramid
+        cv::Size PyramidWindow;
+        /// Build the integral image of the gray image
+        bool Integral;
+    };
+
+    FrameCache();
+
+    /// Build the images of frame, the images of the last update become the previous ones
+    void update(const cv::Mat& frame, const Options& options);
+
+    /// The frame as captured, shares its data
+    inline const cv::Mat& getColor() const { return images_[current_].Color; };
+    inline const cv::Mat& getGray() const { return images_[current_].Gray; };
+    /// Gray image downscaled by getScale(), empty if not requested
+    inline const cv::Mat& getScaled() const { return images_[current_].Scaled; };
+    inline float getScale() const { return images_[current_].Scale; };
+    /// Gaussian pyramid in the layout of cv::buildOpticalFlowPyramid, level 0
+    /// is the gray image. Empty if not requested.
+    inline const std::vector<cv::Mat>& getPyramid() const { return images_[current_].Pyramid; };
+    /// Pyramid of the previous update, empty if it had none
+    inline const std::vector<cv::Mat>& getPreviousPyramid() const { return images_[current_ ^ 1].Pyramid; };
+    /// Integral image of the gray image, empty if not requested
+    inline const cv::Mat& getIntegral() const { return images_[current_].Integral; };
+
+private:
+    struct Images {
+        cv::Mat Color;
+        cv::Mat Gray;
+        cv::Mat Scaled;
+        float Scale;
+        std::vector<cv::Mat> Pyramid;
+        cv::Mat Integral;
+    };
+
+    /// current and previous frame, swapped on every update
+    Images images_[2];
+    uint32_t current_;
+};
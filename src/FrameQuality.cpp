@@ -0,0 +1,114 @@
+#include "FrameQuality.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define QUALITY_SSE2 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define QUALITY_NEON 1
+#endif
+
+namespace
+{
+/// Sums of one row, the Laplacian is at most 4 * 255 in magnitude so the
+/// squares of a row fit 32 bit lanes for rows up to 8192 pixels
+struct RowSums {
+    int64_t Sum;
+    int64_t SquareSum;
+    int64_t Clipped;
+};
+
+RowSums measureRow(const uint8_t* above, const uint8_t* row, const uint8_t* below, int width)
+{
+    RowSums sums{0, 0, 0};
+    int x = 1;
+
+#if QUALITY_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i low = _mm_set1_epi8(static_cast<char>(FrameQuality::ClipLow));
+    const __m128i high = _mm_set1_epi8(static_cast<char>(FrameQuality::ClipHigh));
+    const __m128i one = _mm_set1_epi8(1);
+    __m128i sum = zero;
+    __m128i squareSum = zero;
+    __m128i clipped = zero;
+    for (; x + 8 < width; x += 8) {
+        auto load = [zero](const uint8_t* pixels) { return _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(pixels)), zero); };
+        const __m128i centerBytes = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(row + x));
+        const __m128i center = _mm_unpacklo_epi8(centerBytes, zero);
+        const __m128i neighbours = _mm_add_epi16(_mm_add_epi16(load(row + x - 1), load(row + x + 1)), _mm_add_epi16(load(above + x), load(below + x)));
+        const __m128i laplacian = _mm_sub_epi16(_mm_slli_epi16(center, 2), neighbours);
+        // pairwise sums of the 16 bit lanes, sign extended
+        sum = _mm_add_epi32(sum, _mm_madd_epi16(laplacian, _mm_set1_epi16(1)));
+        squareSum = _mm_add_epi32(squareSum, _mm_madd_epi16(laplacian, laplacian));
+        // unsigned compares through min and max, only the low 8 bytes are pixels of this step
+        const __m128i dark = _mm_cmpeq_epi8(_mm_min_epu8(centerBytes, low), centerBytes);
+        const __m128i bright = _mm_cmpeq_epi8(_mm_max_epu8(centerBytes, high), centerBytes);
+        const __m128i clippedBytes = _mm_and_si128(_mm_or_si128(dark, bright), one);
+        clipped = _mm_add_epi64(clipped, _mm_sad_epu8(_mm_unpacklo_epi64(clippedBytes, zero), zero));
+    }
+    int32_t lanes[4];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), sum);
+    sums.Sum += static_cast<int64_t>(lanes[0]) + lanes[1] + lanes[2] + lanes[3];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), squareSum);
+    sums.SquareSum += static_cast<int64_t>(static_cast<uint32_t>(lanes[0])) + static_cast<uint32_t>(lanes[1]) + static_cast<uint32_t>(lanes[2]) +
+                      static_cast<uint32_t>(lanes[3]);
+    int64_t clippedLanes[2];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(clippedLanes), clipped);
+    sums.Clipped += clippedLanes[0] + clippedLanes[1];
+#elif QUALITY_NEON
+    int32x4_t sum = vdupq_n_s32(0);
+    uint32x4_t squareSum = vdupq_n_u32(0);
+    uint16x8_t clipped = vdupq_n_u16(0);
+    const uint8x8_t low = vdup_n_u8(FrameQuality::ClipLow);
+    const uint8x8_t high = vdup_n_u8(FrameQuality::ClipHigh);
+    for (; x + 8 < width; x += 8) {
+        auto load = [](const uint8_t* pixels) { return vreinterpretq_s16_u16(vmovl_u8(vld1_u8(pixels))); };
+        const uint8x8_t centerBytes = vld1_u8(row + x);
+        const int16x8_t center = vreinterpretq_s16_u16(vmovl_u8(centerBytes));
+        const int16x8_t neighbours = vaddq_s16(vaddq_s16(load(row + x - 1), load(row + x + 1)), vaddq_s16(load(above + x), load(below + x)));
+        const int16x8_t laplacian = vsubq_s16(vshlq_n_s16(center, 2), neighbours);
+        sum = vpadalq_s16(sum, laplacian);
+        squareSum = vaddq_u32(squareSum, vreinterpretq_u32_s32(vmull_s16(vget_low_s16(laplacian), vget_low_s16(laplacian))));
+        squareSum = vaddq_u32(squareSum, vreinterpretq_u32_s32(vmull_s16(vget_high_s16(laplacian), vget_high_s16(laplacian))));
+        const uint8x8_t clippedBytes = vand_u8(vorr_u8(vcle_u8(centerBytes, low), vcge_u8(centerBytes, high)), vdup_n_u8(1));
+        clipped = vaddw_u8(clipped, clippedBytes);
+    }
+    sums.Sum += vaddvq_s32(sum);
+    sums.SquareSum += vaddvq_u32(squareSum);
+    sums.Clipped += vaddvq_u16(clipped);
+#endif
+
+    for (; x < width - 1; ++x) {
+        const int laplacian = 4 * row[x] - row[x - 1] - row[x + 1] - above[x] - below[x];
+        sums.Sum += laplacian;
+        sums.SquareSum += laplacian * laplacian;
+        sums.Clipped += row[x] <= FrameQuality::ClipLow || row[x] >= FrameQuality::ClipHigh ? 1 : 0;
+    }
+    return sums;
+}
+} // namespace
+
+FrameQuality FrameQuality::measure(const cv::Mat& gray, int rowStep)
+{
+    if (gray.rows < 3 || gray.cols < 3 || gray.type() != CV_8UC1) {
+        return FrameQuality{0.0f, 0.0f};
+    }
+    rowStep = std::max(rowStep, 1);
+    int64_t sum = 0;
+    int64_t squareSum = 0;
+    int64_t clipped = 0;
+    int64_t count = 0;
+    for (int y = 1; y < gray.rows - 1; y += rowStep) {
+        const RowSums row = measureRow(gray.ptr<uint8_t>(y - 1), gray.ptr<uint8_t>(y), gray.ptr<uint8_t>(y + 1), gray.cols);
+        sum += row.Sum;
+        squareSum += row.SquareSum;
+        clipped += row.Clipped;
+        count += gray.cols - 2;
+    }
+    const double mean = static_cast<double>(sum) / count;
+    return FrameQuality{static_cast<float>(static_cast<double>(squareSum) / count - mean * mean), static_cast<float>(static_cast<double>(clipped) / count)};
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <opencv2/core/mat.hpp>
+
+/// Sharpness and exposure of a frame, cheap enough to measure on every frame
+/// before deciding whether it is worth searching for the pattern.
+struct FrameQuality {
+    /// Variance of the Laplacian, low for blurred or out of focus frames
+    float Sharpness;
+    /// Fraction of pixels at or below ClipLow or at or above ClipHigh
+    float ClippedRatio;
+
+    static constexpr uint8_t ClipLow = 5;
+    static constexpr uint8_t ClipHigh = 250;
+
+    /// Measure a gray image on every rowStep-th row, using SSE2 or NEON where
+    /// available
+    static FrameQuality measure(const cv::Mat& gray, int rowStep);
+};
@@ -0,0 +1,195 @@
+#include "FrameRecording.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include "MappedFile.h"
+
+namespace
+{
+/// Pixels of a record start this far into it so rows stay cache line aligned
+constexpr uint64_t recordPixelOffset = 64;
+/// Number of frames the file grows by when it is full
+constexpr uint64_t growFrames = 32;
+
+uint64_t frameStride(const cv::Size& frameSize, int type)
+{
+    uint64_t pixelBytes = static_cast<uint64_t>(frameSize.width) * frameSize.height * CV_ELEM_SIZE(type);
+    return (recordPixelOffset + pixelBytes + 63) & ~uint64_t(63);
+}
+} // namespace
+
+std::unique_ptr<FrameRecorder> FrameRecorder::create(const std::string& path, const cv::Size& frameSize, int type, uint32_t queueLength)
+{
+    auto file = MappedFile::open(path, MappedFile::Access::ReadWrite);
+    if (!file || !file->resize(RecordingHeaderSize + growFrames * frameStride(frameSize, type))) {
+        std::fprintf(stderr, "Could not create recording %s\n", path.c_str());
+        return nullptr;
+    }
+    return std::unique_ptr<FrameRecorder>(new FrameRecorder(std::move(file), frameSize, type, queueLength));
+}
+
+FrameRecorder::FrameRecorder(std::unique_ptr<MappedFile>&& file, const cv::Size& frameSize, int type, uint32_t queueLength)
+    : file_(std::move(file))
+    , frameSize_(frameSize)
+    , type_(type)
+    , frameStride_(frameStride(frameSize, type))
+    , slots_(queueLength)
+    , head_(0)
+    , count_(0)
+    , stopping_(false)
+    , nextIndex_(0)
+    , recordedFrames_(0)
+    , droppedFrames_(0)
+{
+    for (auto& slot : slots_) {
+        slot.Image.create(frameSize_, type_);
+    }
+    RecordingHeader header = {};
+    std::memcpy(header.Magic, RecordingMagic, sizeof(header.Magic));
+    header.Version = RecordingVersion;
+    header.Width = static_cast<uint32_t>(frameSize_.width);
+    header.Height = static_cast<uint32_t>(frameSize_.height);
+    header.Type = static_cast<uint32_t>(type_);
+    header.FrameStride = frameStride_;
+    header.FrameCount = 0;
+    std::memcpy(file_->getData(), &header, sizeof(header));
+    thread_ = std::thread(&FrameRecorder::run, this);
+}
+
+FrameRecorder::~FrameRecorder()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    queued_.notify_one();
+    thread_.join();
+    file_->resize(RecordingHeaderSize + recordedFrames_ * frameStride_);
+}
+
+bool FrameRecorder::push(const cv::Mat& image, Clock::time_point captureTime)
+{
+    if (image.size() != frameSize_ || image.type() != type_) {
+        droppedFrames_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    uint32_t slotIndex;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (count_ == slots_.size()) {
+            droppedFrames_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        // only this thread queues, so the slot after the queued ones stays free
+        slotIndex = (head_ + count_) % static_cast<uint32_t>(slots_.size());
+    }
+    if (nextIndex_ == 0) {
+        firstCaptureTime_ = captureTime;
+    }
+    Slot& slot = slots_[slotIndex];
+    image.copyTo(slot.Image);
+    slot.Header.Index = nextIndex_++;
+    slot.Header.TimestampNs = std::chrono::duration_cast<std::chrono::nanoseconds>(captureTime - firstCaptureTime_).count();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ++count_;
+    }
+    queued_.notify_one();
+    return true;
+}
+
+void FrameRecorder::run()
+{
+    while (true) {
+        uint32_t slotIndex;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            queued_.wait(lock, [this] { return count_ > 0 || stopping_; });
+            if (count_ == 0) {
+                break;
+            }
+            slotIndex = head_;
+        }
+        bool written = append(slots_[slotIndex]);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            head_ = (head_ + 1) % static_cast<uint32_t>(slots_.size());
+            --count_;
+        }
+        if (!written) {
+            droppedFrames_.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+}
+
+bool FrameRecorder::append(const Slot& slot)
+{
+    uint64_t frameIndex = recordedFrames_.load(std::memory_order_relaxed);
+    uint64_t offset = RecordingHeaderSize + frameIndex * frameStride_;
+    if (offset + frameStride_ > file_->getSize()) {
+        if (!file_->resize(offset + growFrames * frameStride_)) {
+            return false;
+        }
+    }
+    uint8_t* record = file_->getData() + offset;
+    std::memcpy(record, &slot.Header, sizeof(slot.Header));
+    uint8_t* pixels = record + recordPixelOffset;
+    const size_t rowBytes = static_cast<size_t>(frameSize_.width) * slot.Image.elemSize();
+    for (int row = 0; row < frameSize_.height; ++row) {
+        std::memcpy(pixels + row * rowBytes, slot.Image.ptr(row), rowBytes);
+    }
+    // publish the frame only once its pixels are in place
+    auto header = reinterpret_cast<RecordingHeader*>(file_->getData());
+    header->FrameCount = frameIndex + 1;
+    recordedFrames_.store(frameIndex + 1, std::memory_order_relaxed);
+    return true;
+}
+
+std::unique_ptr<RecordingReader> RecordingReader::open(const std::string& path)
+{
+    auto file = MappedFile::open(path, MappedFile::Access::ReadCopyOnWrite);
+    if (!file) {
+        return nullptr;
+    }
+    RecordingHeader header;
+    if (file->getSize() < RecordingHeaderSize) {
+        std::fprintf(stderr, "%s is not a raw recording\n", path.c_str());
+        return nullptr;
+    }
+    std::memcpy(&header, file->getData(), sizeof(header));
+    if (std::memcmp(header.Magic, RecordingMagic, sizeof(header.Magic)) != 0 || header.Version != RecordingVersion ||
+        header.FrameStride != frameStride(cv::Size(header.Width, header.Height), static_cast<int>(header.Type))) {
+        std::fprintf(stderr, "%s is not a raw recording\n", path.c_str());
+        return nullptr;
+    }
+    // a recording cut short by a crash keeps every frame which was completed
+    uint64_t frameCount = std::min(header.FrameCount, (file->getSize() - RecordingHeaderSize) / header.FrameStride);
+    return std::unique_ptr<RecordingReader>(new RecordingReader(std::move(file), header, frameCount));
+}
+
+RecordingReader::RecordingReader(std::unique_ptr<MappedFile>&& file, const RecordingHeader& header, uint64_t frameCount)
+    : file_(std::move(file))
+    , frameSize_(static_cast<int>(header.Width), static_cast<int>(header.Height))
+    , type_(static_cast<int>(header.Type))
+    , frameStride_(header.FrameStride)
+    , frameCount_(frameCount)
+{
+}
+
+RecordingReader::~RecordingReader() = default;
+
+bool RecordingReader::getFrame(uint64_t index, cv::Mat& image, std::chrono::nanoseconds& timestamp) const
+{
+    if (index >= frameCount_) {
+        return false;
+    }
+    uint8_t* record = file_->getData() + RecordingHeaderSize + index * frameStride_;
+    RecordedFrameHeader header;
+    std::memcpy(&header, record, sizeof(header));
+    timestamp = std::chrono::nanoseconds(header.TimestampNs);
+    // the mapping is copy-on-write, drawing into the frame never touches the file
+    image = cv::Mat(frameSize_, type_, record + recordPixelOffset);
+    return true;
+}
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <opencv2/core/mat.hpp>
+
+class MappedFile;
+
+/// Raw frame recordings: an append-only container of uncompressed frames and
+/// their capture timestamps, so misbehaving tracking can be replayed on the
+/// exact pixels the detector saw instead of a lossy re-encoding.
+///
+/// Layout: a RecordingHeader padded to RecordingHeaderSize, followed by
+/// FrameCount records of FrameStride bytes each. A record is a
+/// RecordedFrameHeader followed by the rows of the frame. Every record has the
+/// same size so the offset of frame i is RecordingHeaderSize + i * FrameStride,
+/// giving random access without a separate index table.
+struct RecordingHeader {
+    char Magic[8];
+    uint32_t Version;
+    uint32_t Width;
+    uint32_t Height;
+    /// OpenCV type of the frames, CV_8UC3 for BGR
+    uint32_t Type;
+    uint64_t FrameStride;
+    /// Number of complete frames, updated after every appended frame
+    uint64_t FrameCount;
+};
+
+struct RecordedFrameHeader {
+    uint64_t Index;
+    /// Capture time relative to the first recorded frame
+    int64_t TimestampNs;
+};
+
+constexpr char RecordingMagic[8] = {'C', 'V', 'C', 'R', 'A', 'W', '0', '1'};
+constexpr uint32_t RecordingVersion = 1;
+/// Frame records start page aligned
+constexpr uint64_t RecordingHeaderSize = 4096;
+
+/// Appends frames to a raw recording from a background thread.
+/// push() copies the frame into one of a few preallocated queue slots and
+/// returns immediately; if the disk can't keep up frames are dropped rather
+/// than stalling the caller.
+class FrameRecorder
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    /// Factory function creating (truncating) the recording at path for frames
+    /// of the given size and type. Returns null if the file can't be created.
+    static std::unique_ptr<FrameRecorder> create(const std::string& path, const cv::Size& frameSize, int type, uint32_t queueLength = 8);
+    /// Writes out the queued frames and trims the file to its final size
+    virtual ~FrameRecorder();
+
+    /// Queue a frame for writing without blocking. Returns false if the
+    /// frame was dropped because the queue is full.
+    bool push(const cv::Mat& image, Clock::time_point captureTime);
+
+    inline uint64_t getRecordedFrames() const { return recordedFrames_.load(std::memory_order_relaxed); };
+    inline uint64_t getDroppedFrames() const { return droppedFrames_.load(std::memory_order_relaxed); };
+
+private:
+    struct Slot {
+        cv::Mat Image;
+        RecordedFrameHeader Header;
+    };
+
+    /// Private unique constructor forcing the use of factory function which
+    /// can return null unlike constructor.
+    FrameRecorder(std::unique_ptr<MappedFile>&& file, const cv::Size& frameSize, int type, uint32_t queueLength);
+
+    /// Body of the writer thread
+    void run();
+    /// Copy a slot to the end of the file, growing the mapping if needed
+    bool append(const Slot& slot);
+
+    const std::unique_ptr<MappedFile> file_;
+    const cv::Size frameSize_;
+    const int type_;
+    const uint64_t frameStride_;
+    std::vector<Slot> slots_;
+    /// first queued slot, only advanced by the writer
+    uint32_t head_;
+    /// number of queued slots
+    uint32_t count_;
+    bool stopping_;
+    uint64_t nextIndex_;
+    Clock::time_point firstCaptureTime_;
+    std::atomic<uint64_t> recordedFrames_;
+    std::atomic<uint64_t> droppedFrames_;
+
+    std::mutex mutex_;
+    std::condition_variable queued_;
+    std::thread thread_;
+};
+
+/// Reads a raw recording through a copy-on-write memory mapping. Frames are
+/// returned as cv::Mat headers pointing straight into the mapping, so
+/// replaying costs no decode and no copy, and any frame can be accessed by
+/// its number.
+class RecordingReader
+{
+public:
+    /// Factory function mapping the recording at path.
+    /// Returns null if it is not a valid recording.
+    static std::unique_ptr<RecordingReader> open(const std::string& path);
+    virtual ~RecordingReader();
+
+    /// Zero-copy view of frame number index and its timestamp relative to the
+    /// first frame. The view stays valid as long as the reader.
+    /// Returns false if index is out of range.
+    bool getFrame(uint64_t index, cv::Mat& image, std::chrono::nanoseconds& timestamp) const;
+
+    inline uint64_t getFrameCount() const { return frameCount_; };
+    inline cv::Size getFrameSize() const { return frameSize_; };
+
+private:
+    /// Private unique constructor forcing the use of factory function which
+    /// can return null unlike constructor.
+    RecordingReader(std::unique_ptr<MappedFile>&& file, const RecordingHeader& header, uint64_t frameCount);
+
+    const std::unique_ptr<MappedFile> file_;
+    const cv::Size frameSize_;
+    const int type_;
+    const uint64_t frameStride_;
+    const uint64_t frameCount_;
+};
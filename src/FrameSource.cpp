@@ -0,0 +1,246 @@
+#include "FrameSource.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <thread>
+
+#include <opencv2/videoio.hpp>
+
+#include "FrameRecording.h"
+
+namespace
+{
+/// Live camera, frames are produced at the rate of the driver
+class CameraSource final : public FrameSource
+{
+public:
+    CameraSource(const std::string& name, std::unique_ptr<cv::VideoCapture>&& capture)
+        : FrameSource(name)
+        , capture_(std::move(capture))
+        , frameSize_(static_cast<int>(capture_->get(cv::CAP_PROP_FRAME_WIDTH)), static_cast<int>(capture_->get(cv::CAP_PROP_FRAME_HEIGHT)))
+    {
+    }
+
+    bool read(cv::Mat& image, Clock::time_point& captureTime) override
+    {
+        // grab first so the timestamp is as close to the exposure as possible
+        if (!capture_->grab()) {
+            return false;
+        }
+        captureTime = Clock::now();
+        return capture_->retrieve(image) && !image.empty();
+    }
+
+    cv::Size getFrameSize() const override { return frameSize_; }
+    bool isLive() const override { return true; }
+
+private:
+    const std::unique_ptr<cv::VideoCapture> capture_;
+    const cv::Size frameSize_;
+};
+
+/// Delivers recorded frames at the rate given by their media timestamps when
+/// pacing in real time, otherwise immediately.
+class ReplayClock
+{
+public:
+    using Clock = FrameSource::Clock;
+
+    explicit ReplayClock(FrameSource::Pacing pacing)
+        : pacing_(pacing)
+        , started_(false)
+        , firstMediaTimeMs_(0.0)
+    {
+    }
+
+    /// Wait until a frame with the given media time is due, returns its capture time
+    Clock::time_point pace(double mediaTimeMs)
+    {
+        auto now = Clock::now();
+        if (!started_) {
+            start_ = now;
+            firstMediaTimeMs_ = mediaTimeMs;
+            started_ = true;
+        }
+        if (pacing_ == FrameSource::Pacing::RealTime) {
+            auto due = start_ + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli>(mediaTimeMs - firstMediaTimeMs_));
+            if (due > now) {
+                std::this_thread::sleep_until(due);
+                now = due;
+            }
+        }
+        return now;
+    }
+
+    /// Start pacing over, e.g. after seeking
+    inline void restart() { started_ = false; };
+
+private:
+    const FrameSource::Pacing pacing_;
+    bool started_;
+    Clock::time_point start_;
+    double firstMediaTimeMs_;
+};
+
+/// Video file or image sequence decoded by OpenCV, optionally paced to the
+/// original timestamps of the recording.
+class RecordedSource final : public FrameSource
+{
+public:
+    RecordedSource(const std::string& name, std::unique_ptr<cv::VideoCapture>&& capture, Pacing pacing, double frameIntervalMs, bool useMediaTimestamps)
+        : FrameSource(name)
+        , capture_(std::move(capture))
+        , clock_(pacing)
+        , frameIntervalMs_(frameIntervalMs)
+        , useMediaTimestamps_(useMediaTimestamps)
+        , frameIndex_(0)
+    {
+        // Decode the first frame up front: image sequences only know their
+        // size once a file has been read.
+        capture_->read(pending_);
+        frameSize_ = pending_.size();
+    }
+
+    bool read(cv::Mat& image, Clock::time_point& captureTime) override
+    {
+        if (!pending_.empty()) {
+            pending_.copyTo(image);
+            pending_.release();
+        } else if (!capture_->read(image)) {
+            return false;
+        }
+        if (image.empty()) {
+            return false;
+        }
+
+        double mediaTimeMs = frameIndex_ * frameIntervalMs_;
+        if (useMediaTimestamps_) {
+            mediaTimeMs = std::max(0.0, capture_->get(cv::CAP_PROP_POS_MSEC));
+        }
+        ++frameIndex_;
+        captureTime = clock_.pace(mediaTimeMs);
+        return true;
+    }
+
+    bool seek(uint64_t frameIndex) override
+    {
+        if (!capture_->set(cv::CAP_PROP_POS_FRAMES, static_cast<double>(frameIndex))) {
+            return false;
+        }
+        pending_.release();
+        frameIndex_ = frameIndex;
+        clock_.restart();
+        return true;
+    }
+
+    cv::Size getFrameSize() const override { return frameSize_; }
+    bool isLive() const override { return false; }
+
+private:
+    const std::unique_ptr<cv::VideoCapture> capture_;
+    ReplayClock clock_;
+    const double frameIntervalMs_;
+    const bool useMediaTimestamps_;
+    cv::Size frameSize_;
+    cv::Mat pending_;
+    uint64_t frameIndex_;
+};
+
+/// Raw recording written by FrameRecorder. Frames are handed out as views
+/// into the memory mapping without decoding or copying.
+class RawRecordingSource final : public FrameSource
+{
+public:
+    RawRecordingSource(const std::string& name, std::unique_ptr<RecordingReader>&& reader, Pacing pacing)
+        : FrameSource(name)
+        , reader_(std::move(reader))
+        , clock_(pacing)
+        , frameIndex_(0)
+    {
+    }
+
+    bool read(cv::Mat& image, Clock::time_point& captureTime) override
+    {
+        std::chrono::nanoseconds timestamp;
+        if (!reader_->getFrame(frameIndex_, image, timestamp)) {
+            return false;
+        }
+        ++frameIndex_;
+        captureTime = clock_.pace(std::chrono::duration<double, std::milli>(timestamp).count());
+        return true;
+    }
+
+    bool seek(uint64_t frameIndex) override
+    {
+        if (frameIndex >= reader_->getFrameCount()) {
+            return false;
+        }
+        frameIndex_ = frameIndex;
+        clock_.restart();
+        return true;
+    }
+
+    cv::Size getFrameSize() const override { return reader_->getFrameSize(); }
+    bool isLive() const override { return false; }
+
+private:
+    const std::unique_ptr<RecordingReader> reader_;
+    ReplayClock clock_;
+    uint64_t frameIndex_;
+};
+} // namespace
+
+std::unique_ptr<FrameSource> FrameSource::create(const std::string& uri, Pacing pacing, double sequenceFps)
+{
+    if (!uri.empty() && std::all_of(uri.begin(), uri.end(), [](char c) { return std::isdigit(static_cast<unsigned char>(c)); })) {
+        int index = std::stoi(uri);
+        auto capture = std::make_unique<cv::VideoCapture>();
+        if (!capture->open(index)) {
+            std::fprintf(stderr, "Could not open video source on index %d\n", index);
+            return nullptr;
+        }
+        return std::make_unique<CameraSource>("camera:" + uri, std::move(capture));
+    }
+
+    if (uri.size() > RawRecordingExtension.size() && uri.compare(uri.size() - RawRecordingExtension.size(), RawRecordingExtension.size(), RawRecordingExtension) == 0) {
+        auto reader = RecordingReader::open(uri);
+        if (!reader) {
+            return nullptr;
+        }
+        return std::make_unique<RawRecordingSource>(uri, std::move(reader), pacing);
+    }
+
+    bool isSequence = uri.find('%') != std::string::npos;
+    auto capture = std::make_unique<cv::VideoCapture>();
+    if (!capture->open(uri, isSequence ? cv::CAP_IMAGES : cv::CAP_ANY)) {
+        std::fprintf(stderr, "Could not open %s %s\n", isSequence ? "image sequence" : "video file", uri.c_str());
+        return nullptr;
+    }
+
+    double frameIntervalMs = 1000.0 / sequenceFps;
+    if (!isSequence) {
+        double fps = capture->get(cv::CAP_PROP_FPS);
+        if (fps > 0.0) {
+            frameIntervalMs = 1000.0 / fps;
+        }
+    }
+    auto source = std::make_unique<RecordedSource>(uri, std::move(capture), pacing, frameIntervalMs, !isSequence);
+    if (source->getFrameSize().empty()) {
+        std::fprintf(stderr, "No frames could be decoded from %s\n", uri.c_str());
+        return nullptr;
+    }
+    return source;
+}
+
+FrameSource::FrameSource(std::string name)
+    : name_(std::move(name))
+{
+}
+
+FrameSource::~FrameSource() = default;
+
+bool FrameSource::seek(uint64_t /*frameIndex*/)
+{
+    return false;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include <opencv2/core/mat.hpp>
+
+/// File extension of raw recordings written by FrameRecorder
+constexpr std::string_view RawRecordingExtension = ".cvraw";
+
+/// Abstraction over everything which produces camera frames: live cameras,
+/// recorded video files, numbered image sequences and raw recordings.
+/// Recorded sources can either be paced to their original timestamps or be
+/// replayed as fast as possible for measuring the maximum throughput of the
+/// tracking loop.
+class FrameSource
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    enum class Pacing {
+        /// Deliver recorded frames at the rate they were recorded at
+        RealTime,
+        /// Deliver recorded frames as fast as they can be decoded
+        Unthrottled,
+    };
+
+    /// Factory function which picks the source type from the uri:
+    /// an integer opens the camera at that index, a path containing a printf
+    /// style index (e.g. "captures/frame%04d.png") opens a numbered image
+    /// sequence, a .cvraw path opens a raw recording and any other path is
+    /// opened as a video file.
+    /// Image sequences carry no timestamps and are paced at sequenceFps.
+    /// Returns null if the source could not be opened.
+    static std::unique_ptr<FrameSource> create(const std::string& uri, Pacing pacing, double sequenceFps = 30.0);
+    virtual ~FrameSource();
+
+    /// Read the next frame into image, reusing its memory when the size
+    /// matches, and stamp it with the monotonic time it was captured.
+    /// Returns false once the source has no more frames.
+    virtual bool read(cv::Mat& image, Clock::time_point& captureTime) = 0;
+    /// Continue reading at the given frame number. Only recorded sources can
+    /// seek, must be called before the source is handed to a capture thread.
+    virtual bool seek(uint64_t frameIndex);
+    /// Size of the frames produced by the source
+    virtual cv::Size getFrameSize() const = 0;
+    /// Live sources keep producing frames regardless of the consumer so stale
+    /// frames may be dropped. Recorded sources must deliver every frame.
+    virtual bool isLive() const = 0;
+    /// Human readable identifier of the source
+    inline const std::string& getName() const { return name_; };
+
+protected:
+    explicit FrameSource(std::string name);
+
+private:
+    const std::string name_;
+};
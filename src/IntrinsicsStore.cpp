@@ -0,0 +1,115 @@
+#include "IntrinsicsStore.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "AtomicFile.h"
+#include "MappedFile.h"
+
+namespace
+{
+/// Every camera saves from its own calibration worker, usually into the same
+/// store. Held across the read, rewrite and rename so no record gets lost.
+std::mutex storeMutex;
+
+/// Map the store at path and check its header. Returns null if there is no valid store.
+std::unique_ptr<MappedFile> openStore(const std::string& path, IntrinsicsStoreHeader& header)
+{
+    std::error_code error;
+    if (!std::filesystem::exists(path, error)) {
+        return nullptr;
+    }
+    auto file = MappedFile::open(path, MappedFile::Access::ReadCopyOnWrite);
+    if (!file || file->getSize() < sizeof(header)) {
+        return nullptr;
+    }
+    std::memcpy(&header, file->getData(), sizeof(header));
+    if (std::memcmp(header.Magic, IntrinsicsStoreMagic, sizeof(header.Magic)) != 0 || header.Version != IntrinsicsStoreVersion) {
+        std::fprintf(stderr, "%s is no intrinsics store, ignoring it\n", path.c_str());
+        return nullptr;
+    }
+    if (sizeof(header) + header.RecordCount * sizeof(IntrinsicsRecord) > file->getSize()) {
+        std::fprintf(stderr, "Intrinsics store %s is truncated, ignoring it\n", path.c_str());
+        return nullptr;
+    }
+    return file;
+}
+
+const IntrinsicsRecord* getRecords(const MappedFile& file)
+{
+    return reinterpret_cast<const IntrinsicsRecord*>(file.getData() + sizeof(IntrinsicsStoreHeader));
+}
+
+bool matches(const IntrinsicsRecord& record, const char* cameraId, int32_t width, int32_t height)
+{
+    return record.Width == width && record.Height == height && std::strncmp(record.CameraId, cameraId, IntrinsicsCameraIdLength) == 0;
+}
+} // namespace
+
+void IntrinsicsStore::setCameraId(IntrinsicsRecord& record, const std::string& cameraId)
+{
+    std::memset(record.CameraId, 0, sizeof(record.CameraId));
+    std::memcpy(record.CameraId, cameraId.data(), std::min(cameraId.size(), IntrinsicsCameraIdLength - 1));
+}
+
+bool IntrinsicsStore::find(const std::string& path, const std::string& cameraId, const cv::Size& resolution, IntrinsicsRecord& record)
+{
+    std::lock_guard<std::mutex> lock(storeMutex);
+    IntrinsicsStoreHeader header;
+    auto file = openStore(path, header);
+    if (!file) {
+        return false;
+    }
+    // compare with the identifier as it was truncated on store
+    IntrinsicsRecord key;
+    setCameraId(key, cameraId);
+    const IntrinsicsRecord* records = getRecords(*file);
+    for (uint32_t i = 0; i < header.RecordCount; ++i) {
+        if (matches(records[i], key.CameraId, resolution.width, resolution.height)) {
+            record = records[i];
+            record.DistortionCount = std::min<uint32_t>(record.DistortionCount, IntrinsicsMaxDistortion);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool IntrinsicsStore::store(const std::string& path, const IntrinsicsRecord& record)
+{
+    std::lock_guard<std::mutex> lock(storeMutex);
+    std::vector<IntrinsicsRecord> records;
+    {
+        IntrinsicsStoreHeader header;
+        auto file = openStore(path, header);
+        if (file) {
+            records.reserve(header.RecordCount + 1);
+            const IntrinsicsRecord* existing = getRecords(*file);
+            for (uint32_t i = 0; i < header.RecordCount; ++i) {
+                if (!matches(existing[i], record.CameraId, record.Width, record.Height)) {
+                    records.push_back(existing[i]);
+                }
+            }
+        }
+    }
+    records.push_back(record);
+
+    const bool written = AtomicFile::write(path, [&records](FILE* file) {
+        IntrinsicsStoreHeader header;
+        std::memcpy(header.Magic, IntrinsicsStoreMagic, sizeof(header.Magic));
+        header.Version = IntrinsicsStoreVersion;
+        header.RecordCount = static_cast<uint32_t>(records.size());
+        return std::fwrite(&header, sizeof(header), 1, file) == 1 &&
+               std::fwrite(records.data(), sizeof(IntrinsicsRecord), records.size(), file) == records.size();
+    });
+    if (!written) {
+        std::fprintf(stderr, "Could not write intrinsics store %s\n", path.c_str());
+        return false;
+    }
+    return true;
+}
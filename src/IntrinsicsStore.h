@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include <opencv2/core/types.hpp>
+
+/// File holding the calibrated intrinsics of any number of cameras side by
+/// side, so a camera seen before tracks from its very first frame.
+///
+/// Layout: an IntrinsicsStoreHeader followed by RecordCount fixed size
+/// IntrinsicsRecords, one per camera identifier and resolution. Records are 8
+/// byte aligned and read in place from the mapped file.
+struct IntrinsicsStoreHeader {
+    char Magic[8];
+    uint32_t Version;
+    uint32_t RecordCount;
+};
+
+/// Longest camera identifier including the terminating zero
+constexpr size_t IntrinsicsCameraIdLength = 128;
+/// Most distortion coefficients OpenCV produces (rational, thin prism and tilted models)
+constexpr size_t IntrinsicsMaxDistortion = 14;
+
+struct IntrinsicsRecord {
+    /// zero terminated, longer identifiers are truncated
+    char CameraId[IntrinsicsCameraIdLength];
+    int32_t Width;
+    int32_t Height;
+    uint32_t DistortionCount;
+    uint32_t Reserved;
+    /// row major
+    double CameraMatrix[9];
+    double DistortionCoefficients[IntrinsicsMaxDistortion];
+    float ProjMat[16];
+    double ReprojectionError;
+};
+
+constexpr char IntrinsicsStoreMagic[8] = {'C', 'V', 'I', 'N', 'T', 'R', '0', '1'};
+constexpr uint32_t IntrinsicsStoreVersion = 1;
+/// Store used when no other one is given, in the working directory
+constexpr std::string_view IntrinsicsStoreDefaultPath = "intrinsics.store";
+
+class IntrinsicsStore
+{
+public:
+    /// Copy the record of cameraId at resolution out of the store at path.
+    /// Returns false if the store or the record doesn't exist.
+    static bool find(const std::string& path, const std::string& cameraId, const cv::Size& resolution, IntrinsicsRecord& record);
+    /// Add the record to the store at path, replacing the one of the same
+    /// camera and resolution. Creates the store if needed. Safe to call from
+    /// several threads at once, the writes to a store are serialized.
+    static bool store(const std::string& path, const IntrinsicsRecord& record);
+    /// Fill in the CameraId of record, truncating it if needed
+    static void setCameraId(IntrinsicsRecord& record, const std::string& cameraId);
+};
@@ -0,0 +1,134 @@
+#include "LatencyStats.h"
+
+#include <algorithm>
+
+namespace
+{
+/// Milliseconds between two stamps, negative if either stage did not run
+double elapsedMs(const FrameTiming::Clock::time_point& from, const FrameTiming::Clock::time_point& to)
+{
+    if (from.time_since_epoch().count() == 0 || to.time_since_epoch().count() == 0) {
+        return -1.0;
+    }
+    return std::chrono::duration<double, std::milli>(to - from).count();
+}
+} // namespace
+
+LatencyStats::LatencyStats(uint32_t windowSize)
+    : windowSize_(windowSize)
+    , scratch_(windowSize)
+{
+    for (auto& samples : stages_) {
+        samples.Values.resize(windowSize_);
+        samples.Next = 0;
+        samples.Count = 0;
+    }
+}
+
+void LatencyStats::record(const FrameTiming& timing)
+{
+    const FrameTiming::Clock::time_point* last = &timing.Present;
+    for (auto stamp : {&timing.Present, &timing.Submit, &timing.UploadEnd, &timing.PoseEnd, &timing.DetectEnd}) {
+        last = stamp;
+        if (stamp->time_since_epoch().count() != 0) {
+            break;
+        }
+    }
+
+    std::array<double, StageCount> latencies;
+    latencies[Queue] = elapsedMs(timing.Capture, timing.DetectStart);
+    latencies[Detect] = elapsedMs(timing.DetectStart, timing.DetectEnd);
+    latencies[Pose] = elapsedMs(timing.DetectEnd, timing.PoseEnd);
+    const bool undistorted = timing.UndistortStart.time_since_epoch().count() != 0;
+    latencies[Handoff] = elapsedMs(timing.PoseEnd, undistorted ? timing.UndistortStart : timing.UploadStart);
+    latencies[Undistort] = elapsedMs(timing.UndistortStart, timing.UndistortEnd);
+    latencies[Upload] = elapsedMs(timing.UploadStart, timing.UploadEnd);
+    latencies[Render] = elapsedMs(timing.UploadEnd, timing.Submit);
+    latencies[Present] = elapsedMs(timing.Submit, timing.Present);
+    latencies[EndToEnd] = elapsedMs(timing.Capture, *last);
+
+    for (uint32_t stage = 0; stage < StageCount; ++stage) {
+        if (latencies[stage] < 0.0) {
+            continue;
+        }
+        auto& samples = stages_[stage];
+        samples.Values[samples.Next] = latencies[stage];
+        samples.Next = (samples.Next + 1) % windowSize_;
+        samples.Count = std::min(samples.Count + 1, windowSize_);
+    }
+}
+
+LatencyStats::Percentiles LatencyStats::get(Stage stage) const
+{
+    const auto& samples = stages_[stage];
+    if (samples.Count == 0) {
+        return {0.0, 0.0, 0.0};
+    }
+    auto begin = scratch_.begin();
+    auto end = std::copy_n(samples.Values.begin(), samples.Count, begin);
+    auto percentile = [&](double fraction) {
+        auto nth = begin + static_cast<ptrdiff_t>(fraction * (samples.Count - 1) + 0.5);
+        std::nth_element(begin, nth, end);
+        return *nth;
+    };
+    Percentiles result;
+    result.P50 = percentile(0.50);
+    result.P95 = percentile(0.95);
+    result.P99 = percentile(0.99);
+    return result;
+}
+
+uint32_t LatencyStats::getSampleCount(Stage stage) const
+{
+    return stages_[stage].Count;
+}
+
+const char* LatencyStats::getStageName(Stage stage)
+{
+    switch (stage) {
+    case Queue:
+        return "queue";
+    case Detect:
+        return "detect";
+    case Pose:
+        return "pose";
+    case Handoff:
+        return "handoff";
+    case Undistort:
+        return "undistort";
+    case Upload:
+        return "upload";
+    case Render:
+        return "render";
+    case Present:
+        return "present";
+    case EndToEnd:
+        return "end_to_end";
+    default:
+        return "unknown";
+    }
+}
+
+void LatencyStats::dump(FILE* file, const char* name) const
+{
+    std::fprintf(file, "{\"source\": \"");
+    for (const char* c = name; *c != '\0'; ++c) {
+        if (*c == '"' || *c == '\\') {
+            std::fputc('\\', file);
+        }
+        std::fputc(*c, file);
+    }
+    std::fprintf(file, "\", \"window\": %u, \"stages\": {", windowSize_);
+    bool first = true;
+    for (uint32_t i = 0; i < StageCount; ++i) {
+        auto stage = static_cast<Stage>(i);
+        if (getSampleCount(stage) == 0) {
+            continue;
+        }
+        auto percentiles = get(stage);
+        std::fprintf(file, "%s\"%s\": {\"samples\": %u, \"p50_ms\": %.4f, \"p95_ms\": %.4f, \"p99_ms\": %.4f}", first ? "" : ", ", getStageName(stage),
+                     getSampleCount(stage), percentiles.P50, percentiles.P95, percentiles.P99);
+        first = false;
+    }
+    std::fprintf(file, "}}");
+}
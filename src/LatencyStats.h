@@ -0,0 +1,85 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+/// Timestamps of one frame through every stage from capture to present.
+/// Stages which did not run (e.g. upload and present when headless) stay at
+/// the epoch and are left out of the statistics.
+struct FrameTiming {
+    using Clock = std::chrono::steady_clock;
+
+    Clock::time_point Capture;
+    Clock::time_point DetectStart;
+    Clock::time_point DetectEnd;
+    Clock::time_point PoseEnd;
+    /// Lens distortion removed from the displayed frame, see Undistorter
+    Clock::time_point UndistortStart;
+    Clock::time_point UndistortEnd;
+    Clock::time_point UploadStart;
+    Clock::time_point UploadEnd;
+    /// All draw calls of the frame were issued
+    Clock::time_point Submit;
+    /// The frame was swapped to the screen
+    Clock::time_point Present;
+};
+
+/// Rolling p50/p95/p99 latency per stage over the last frames of one camera.
+/// Recording and querying never allocate after construction.
+class LatencyStats
+{
+public:
+    enum Stage {
+        /// Capture until the tracker picked up the frame
+        Queue,
+        Detect,
+        Pose,
+        /// Pose until the render loop picked up the result
+        Handoff,
+        /// Remapping the frame for display, only when undistortion is on
+        Undistort,
+        Upload,
+        /// Upload until all draw calls were issued
+        Render,
+        /// Submit until the swap returned
+        Present,
+        /// Capture until present, or until the last stamped stage
+        EndToEnd,
+        StageCount,
+    };
+
+    struct Percentiles {
+        double P50;
+        double P95;
+        double P99;
+    };
+
+    /// Keeps the latencies of the last windowSize frames
+    explicit LatencyStats(uint32_t windowSize = 600);
+
+    /// Add the stage latencies of a frame
+    void record(const FrameTiming& timing);
+    /// Percentiles in milliseconds of a stage over the window
+    Percentiles get(Stage stage) const;
+    /// Number of frames a stage has in the window
+    uint32_t getSampleCount(Stage stage) const;
+
+    static const char* getStageName(Stage stage);
+    /// Write the percentiles of every stage as a JSON object
+    void dump(FILE* file, const char* name) const;
+
+private:
+    struct Samples {
+        std::vector<double> Values;
+        uint32_t Next;
+        uint32_t Count;
+    };
+
+    const uint32_t windowSize_;
+    std::array<Samples, StageCount> stages_;
+    /// sorting buffer for the percentiles
+    mutable std::vector<double> scratch_;
+};
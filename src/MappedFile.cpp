@@ -0,0 +1,143 @@
+#include "MappedFile.h"
+
+#include <cstdio>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(_WIN32)
+struct MappedFile::Handles {
+    HANDLE File;
+    HANDLE Mapping;
+};
+#else
+struct MappedFile::Handles {
+    int File;
+};
+#endif
+
+std::unique_ptr<MappedFile> MappedFile::open(const std::string& path, Access access)
+{
+    auto handles = std::make_unique<Handles>();
+    std::size_t size = 0;
+#if defined(_WIN32)
+    if (access == Access::ReadWrite) {
+        handles->File = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    } else {
+        handles->File = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    }
+    handles->Mapping = nullptr;
+    if (handles->File == INVALID_HANDLE_VALUE) {
+        std::fprintf(stderr, "Could not open %s\n", path.c_str());
+        return nullptr;
+    }
+    LARGE_INTEGER fileSize;
+    if (GetFileSizeEx(handles->File, &fileSize)) {
+        size = static_cast<std::size_t>(fileSize.QuadPart);
+    }
+#else
+    handles->File = ::open(path.c_str(), access == Access::ReadWrite ? O_RDWR | O_CREAT | O_TRUNC : O_RDONLY, 0644);
+    if (handles->File < 0) {
+        std::fprintf(stderr, "Could not open %s\n", path.c_str());
+        return nullptr;
+    }
+    struct stat status;
+    if (fstat(handles->File, &status) == 0) {
+        size = static_cast<std::size_t>(status.st_size);
+    }
+#endif
+    auto file = std::unique_ptr<MappedFile>(new MappedFile(std::move(handles), access));
+    if (size > 0 && !file->map(size)) {
+        std::fprintf(stderr, "Could not map %s\n", path.c_str());
+        return nullptr;
+    }
+    return file;
+}
+
+MappedFile::MappedFile(std::unique_ptr<Handles>&& handles, Access access)
+    : handles_(std::move(handles))
+    , access_(access)
+    , data_(nullptr)
+    , size_(0)
+{
+}
+
+MappedFile::~MappedFile()
+{
+    unmap();
+#if defined(_WIN32)
+    CloseHandle(handles_->File);
+#else
+    ::close(handles_->File);
+#endif
+}
+
+bool MappedFile::resize(std::size_t size)
+{
+    if (access_ != Access::ReadWrite) {
+        return false;
+    }
+    unmap();
+#if defined(_WIN32)
+    LARGE_INTEGER position;
+    position.QuadPart = static_cast<LONGLONG>(size);
+    if (!SetFilePointerEx(handles_->File, position, nullptr, FILE_BEGIN) || !SetEndOfFile(handles_->File)) {
+        return false;
+    }
+#else
+    if (ftruncate(handles_->File, static_cast<off_t>(size)) != 0) {
+        return false;
+    }
+#endif
+    return size == 0 || map(size);
+}
+
+bool MappedFile::map(std::size_t size)
+{
+#if defined(_WIN32)
+    const bool write = access_ == Access::ReadWrite;
+    handles_->Mapping = CreateFileMappingA(handles_->File, nullptr, write ? PAGE_READWRITE : PAGE_WRITECOPY, static_cast<DWORD>(static_cast<uint64_t>(size) >> 32),
+                                           static_cast<DWORD>(size & 0xFFFFFFFFu), nullptr);
+    if (handles_->Mapping == nullptr) {
+        return false;
+    }
+    void* data = MapViewOfFile(handles_->Mapping, write ? FILE_MAP_WRITE : FILE_MAP_COPY, 0, 0, size);
+    if (data == nullptr) {
+        CloseHandle(handles_->Mapping);
+        handles_->Mapping = nullptr;
+        return false;
+    }
+#else
+    void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, access_ == Access::ReadWrite ? MAP_SHARED : MAP_PRIVATE, handles_->File, 0);
+    if (data == MAP_FAILED) {
+        return false;
+    }
+#endif
+    data_ = static_cast<uint8_t*>(data);
+    size_ = size;
+    return true;
+}
+
+void MappedFile::unmap()
+{
+    if (data_ == nullptr) {
+        return;
+    }
+#if defined(_WIN32)
+    UnmapViewOfFile(data_);
+    CloseHandle(handles_->Mapping);
+    handles_->Mapping = nullptr;
+#else
+    munmap(data_, size_);
+#endif
+    data_ = nullptr;
+    size_ = 0;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+/// RAII wrapper around a memory-mapped file (mmap on POSIX, file mapping
+/// objects on Windows).
+class MappedFile
+{
+public:
+    enum class Access {
+        /// Map an existing file. Pages can be written but changes stay
+        /// private to the process (copy-on-write) and never reach the file.
+        ReadCopyOnWrite,
+        /// Create or truncate the file and map it shared for writing
+        ReadWrite,
+    };
+
+    /// Factory function opening and mapping the file at path.
+    /// Returns null if the file could not be opened or mapped.
+    static std::unique_ptr<MappedFile> open(const std::string& path, Access access);
+    virtual ~MappedFile();
+
+    /// Change the size of the file and remap it. Only for ReadWrite files.
+    /// Pointers into the previous mapping are invalidated.
+    bool resize(std::size_t size);
+
+    inline uint8_t* getData() const { return data_; };
+    inline std::size_t getSize() const { return size_; };
+
+private:
+    /// Native file and mapping handles
+    struct Handles;
+
+    /// Private unique constructor forcing the use of factory function which
+    /// can return null unlike constructor.
+    MappedFile(std::unique_ptr<Handles>&& handles, Access access);
+    bool map(std::size_t size);
+    void unmap();
+
+    const std::unique_ptr<Handles> handles_;
+    const Access access_;
+    uint8_t* data_;
+    std::size_t size_;
+};
@@ -0,0 +1,214 @@
+#include "PatternDetector.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <opencv2/calib3d.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include "AllocationCounter.h"
+#include "FrameCache.h"
+#include "SaddlePointDetector.h"
+
+namespace
+{
+/// Corners of a chessboard with the classic quad based detector
+class ChessboardDetector final : public PatternDetector
+{
+public:
+    explicit ChessboardDetector(const cv::Size& patternSize)
+        : PatternDetector(Type::Chessboard, patternSize, cv::CALIB_CB_ADAPTIVE_THRESH + cv::CALIB_CB_NORMALIZE_IMAGE + cv::CALIB_CB_FAST_CHECK)
+    {
+    }
+
+protected:
+    bool find(const cv::Mat& gray, std::vector<cv::Point2f>& points) const override
+    {
+        return cv::findChessboardCorners(gray, getPatternSize(), points, Flags);
+    }
+
+    void refine(const cv::Mat& gray, int halfWindow, std::vector<cv::Point2f>& points) const override
+    {
+        cv::cornerSubPix(gray, points, cv::Size(halfWindow, halfWindow), cv::Size(-1, -1),
+                         cv::TermCriteria(cv::TermCriteria::EPS + cv::TermCriteria::COUNT, 30, 0.01));
+    }
+};
+
+/// Corners of a chessboard with the sector based detector, which is more
+/// robust to blur and noise and returns sub-pixel accurate corners
+class ChessboardSBDetector final : public PatternDetector
+{
+public:
+    explicit ChessboardSBDetector(const cv::Size& patternSize)
+        : PatternDetector(Type::ChessboardSB, patternSize, cv::CALIB_CB_NORMALIZE_IMAGE)
+    {
+    }
+
+protected:
+    bool find(const cv::Mat& gray, std::vector<cv::Point2f>& points) const override
+    {
+        return cv::findChessboardCornersSB(gray, getPatternSize(), points, Flags);
+    }
+
+    void refine(const cv::Mat& gray, int halfWindow, std::vector<cv::Point2f>& points) const override
+    {
+        cv::cornerSubPix(gray, points, cv::Size(halfWindow, halfWindow), cv::Size(-1, -1),
+                         cv::TermCriteria(cv::TermCriteria::EPS + cv::TermCriteria::COUNT, 30, 0.01));
+    }
+};
+
+/// Centers of a symmetric or asymmetric grid of circles
+class CircleGridDetector final : public PatternDetector
+{
+public:
+    CircleGridDetector(const cv::Size& patternSize, bool asymmetric)
+        : PatternDetector(asymmetric ? Type::AsymmetricCircleGrid : Type::CircleGrid, patternSize, 0)
+        , gridFlag_(asymmetric ? cv::CALIB_CB_ASYMMETRIC_GRID : cv::CALIB_CB_SYMMETRIC_GRID)
+    {
+    }
+
+    void getObjectPoints(float spacing, std::vector<cv::Vec3f>& points) const override
+    {
+        if (gridFlag_ == cv::CALIB_CB_SYMMETRIC_GRID) {
+            PatternDetector::getObjectPoints(spacing, points);
+            return;
+        }
+        // every other row is shifted by half the distance between two circles of a row
+        const cv::Size& patternSize = getPatternSize();
+        points.resize(patternSize.area());
+        for (int j = 0; j < patternSize.height; j++) {
+            for (int i = 0; i < patternSize.width; i++) {
+                points[i + j * patternSize.width] = cv::Vec3f((2 * i + j % 2) * spacing, j * spacing, 0);
+            }
+        }
+    }
+
+protected:
+    bool find(const cv::Mat& gray, std::vector<cv::Point2f>& points) const override
+    {
+        return cv::findCirclesGrid(gray, getPatternSize(), points, gridFlag_ | Flags);
+    }
+
+    void refine(const cv::Mat& gray, int halfWindow, std::vector<cv::Point2f>& points) const override
+    {
+        // circle centers can't be refined like corners, search again at full
+        // resolution around the coarse grid and keep the coarse centers if that fails
+        const cv::Rect bounds = cv::boundingRect(points);
+        const cv::Rect roi = cv::Rect(bounds.x - 4 * halfWindow, bounds.y - 4 * halfWindow, bounds.width + 8 * halfWindow,
+                                      bounds.height + 8 * halfWindow) & cv::Rect(0, 0, gray.cols, gray.rows);
+        std::vector<cv::Point2f> centers;
+        if (cv::findCirclesGrid(gray(roi), getPatternSize(), centers, gridFlag_ | Flags)) {
+            const cv::Point2f offset(static_cast<float>(roi.x), static_cast<float>(roi.y));
+            for (size_t i = 0; i < centers.size(); ++i) {
+                points[i] = centers[i] + offset;
+            }
+        }
+    }
+
+private:
+    const int gridFlag_;
+};
+} // namespace
+
+std::unique_ptr<PatternDetector> PatternDetector::create(Type type, const cv::Size& patternSize)
+{
+    switch (type) {
+    case Type::Chessboard:
+        return std::make_unique<ChessboardDetector>(patternSize);
+    case Type::ChessboardSB:
+        return std::make_unique<ChessboardSBDetector>(patternSize);
+    case Type::CircleGrid:
+        return std::make_unique<CircleGridDetector>(patternSize, false);
+    case Type::AsymmetricCircleGrid:
+        return std::make_unique<CircleGridDetector>(patternSize, true);
+    case Type::SaddlePoint:
+        return std::make_unique<SaddlePointDetector>(patternSize);
+    default:
+        return nullptr;
+    }
+}
+
+PatternDetector::PatternDetector(Type type, const cv::Size& patternSize, int flags)
+    : Flags(flags)
+    , type_(type)
+    , patternSize_(patternSize)
+{
+}
+
+PatternDetector::~PatternDetector() = default;
+
+const char* PatternDetector::getTypeName(Type type)
+{
+    switch (type) {
+    case Type::Chessboard:
+        return "chessboard";
+    case Type::ChessboardSB:
+        return "chessboard-sb";
+    case Type::CircleGrid:
+        return "circles";
+    case Type::AsymmetricCircleGrid:
+        return "asymmetric-circles";
+    case Type::SaddlePoint:
+        return "saddle";
+    default:
+        return "unknown";
+    }
+}
+
+bool PatternDetector::parseType(std::string_view name, Type& type)
+{
+    for (int i = 0; i < static_cast<int>(Type::Count); ++i) {
+        if (name == getTypeName(static_cast<Type>(i))) {
+            type = static_cast<Type>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool PatternDetector::detect(const FrameCache& frame, const cv::Rect& roi, bool coarseFallback, std::vector<cv::Point2f>& points) const
+{
+    AllocationCounter::ExternalScope opencv;
+    const float scale = frame.getScale();
+    if (scale < 1.0f) {
+        const cv::Mat& coarse = frame.getScaled();
+        const int left = static_cast<int>(std::floor(roi.x * scale));
+        const int top = static_cast<int>(std::floor(roi.y * scale));
+        const int right = std::min(coarse.cols, static_cast<int>(std::ceil(roi.br().x * scale)));
+        const int bottom = std::min(coarse.rows, static_cast<int>(std::ceil(roi.br().y * scale)));
+        if (find(coarse(cv::Rect(left, top, right - left, bottom - top)), points)) {
+            // map the points back to full resolution, pixel centers sit at +0.5
+            const float inverseScale = 1.0f / scale;
+            const cv::Point2f offset(left + 0.5f, top + 0.5f);
+            for (auto& point : points) {
+                point = (point + offset) * inverseScale - cv::Point2f(0.5f, 0.5f);
+            }
+            // the search window has to cover the error of the coarse point
+            refine(frame.getGray(), std::max(5, static_cast<int>(std::ceil(2.0f * inverseScale))), points);
+            return true;
+        }
+        if (!coarseFallback) {
+            return false;
+        }
+    }
+
+    if (!find(frame.getGray()(roi), points)) {
+        return false;
+    }
+    const cv::Point2f offset(static_cast<float>(roi.x), static_cast<float>(roi.y));
+    for (auto& point : points) {
+        point += offset;
+    }
+    return true;
+}
+
+void PatternDetector::getObjectPoints(float spacing, std::vector<cv::Vec3f>& points) const
+{
+    points.resize(patternSize_.area());
+    for (int j = 0; j < patternSize_.height; j++) {
+        for (int i = 0; i < patternSize_.width; i++) {
+            // real world coordinates in meters if Z = 0 (so only x and y coordinates)
+            points[i + j * patternSize_.width] = cv::Vec3f(i * spacing, j * spacing, 0);
+        }
+    }
+}
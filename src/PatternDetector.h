@@ -0,0 +1,70 @@
+#pragma once
+
+#include <memory>
+#include <string_view>
+#include <vector>
+
+#include <opencv2/core/mat.hpp>
+#include <opencv2/core/matx.hpp>
+
+class FrameCache;
+
+/// Detector backend for the calibration pattern. The backends differ in the
+/// pattern they find and in their cost per frame, so the cheapest one which
+/// is reliable for a camera and its lighting can be picked at runtime.
+/// detect only reads the detector, one instance can be used from several
+/// threads at once.
+class PatternDetector
+{
+public:
+    enum class Type {
+        /// cv::findChessboardCorners
+        Chessboard,
+        /// cv::findChessboardCornersSB, sector based and sub-pixel accurate
+        ChessboardSB,
+        /// cv::findCirclesGrid on a symmetric grid
+        CircleGrid,
+        /// cv::findCirclesGrid on an asymmetric grid
+        AsymmetricCircleGrid,
+        /// SaddlePointDetector, vectorized and multi-threaded chessboard detector
+        SaddlePoint,
+        Count,
+    };
+
+    /// Factory function. patternSize counts the inner corners of a chessboard
+    /// or the circles per row and column of a circle grid.
+    static std::unique_ptr<PatternDetector> create(Type type, const cv::Size& patternSize);
+    virtual ~PatternDetector();
+
+    /// Human readable name, also accepted by parseType
+    static const char* getTypeName(Type type);
+    /// Parse a name returned by getTypeName. Returns false if it is unknown.
+    static bool parseType(std::string_view name, Type& type);
+
+    /// Search roi of the frame, on its downscaled image first if it has one.
+    /// If the coarse search misses, the full resolution image is searched when
+    /// coarseFallback is set. Points are returned in full frame coordinates.
+    bool detect(const FrameCache& frame, const cv::Rect& roi, bool coarseFallback, std::vector<cv::Point2f>& points) const;
+    /// Positions of the pattern points on the board with z = 0, spacing is the
+    /// side of a chessboard square or the distance between neighbouring circles
+    virtual void getObjectPoints(float spacing, std::vector<cv::Vec3f>& points) const;
+
+    inline Type getType() const { return type_; };
+    inline const cv::Size& getPatternSize() const { return patternSize_; };
+
+    /// Flags passed to the OpenCV detector, defaults depend on the backend
+    int Flags;
+
+protected:
+    PatternDetector(Type type, const cv::Size& patternSize, int flags);
+
+    /// Search a gray image, points relative to the image
+    virtual bool find(const cv::Mat& gray, std::vector<cv::Point2f>& points) const = 0;
+    /// Improve points mapped up from the downscaled image on the full
+    /// resolution gray image. halfWindow covers the error of the coarse points.
+    virtual void refine(const cv::Mat& gray, int halfWindow, std::vector<cv::Point2f>& points) const = 0;
+
+private:
+    const Type type_;
+    const cv::Size patternSize_;
+};
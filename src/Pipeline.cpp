@@ -89,7 +89,11 @@ Pipeline::Pipeline(uint32_t program, uint32_t viewportWidth, uint32_t viewportHe
 Pipeline::~Pipeline() { glDeleteProgram(program_); }
 
 void Pipeline::bind() {
-    glViewport(0, 0, viewportWidth_, viewportHeight_);
+    bind(0, 0, viewportWidth_, viewportHeight_);
+}
+
+void Pipeline::bind(int32_t x, int32_t y, uint32_t width, uint32_t height) {
+    glViewport(x, y, width, height);
     glUseProgram(program_);
     glLineWidth(lineWidth_);
 }
@@ -27,6 +27,9 @@ class Pipeline {
 
     /// Bind pipeline with which to draw
     void bind();
+    /// Bind pipeline drawing into a sub-rectangle of the viewport, e.g. one
+    /// tile when composing several cameras into one window.
+    void bind(int32_t x, int32_t y, uint32_t width, uint32_t height);
     /// Upload a uniform: data which is shared with all shader cores during dispatch.
     template <typename T>
     bool setUniform(const std::string_view& uniform_name, const T& uniform);
@@ -71,6 +71,10 @@ void Renderer::swapBuffers() {
     SDL_GL_SwapWindow(window_.get());
 }
 
+void Renderer::setVSync(bool enabled) {
+    SDL_GL_SetSwapInterval(enabled ? 1 : 0);
+}
+
 SDL_Window *Renderer::getNativeWindowHandle() const {
     return window_.get();
 }
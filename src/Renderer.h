@@ -27,6 +27,10 @@ public:
   /// backbuffer
   void swapBuffers();
 
+  /// Enable or disable waiting for the vertical blank when swapping.
+  /// Disabling it lets replays run as fast as the tracking loop allows.
+  void setVSync(bool enabled);
+
   /// Getter of the native window handle which is necessary for initializing
   /// the ui and other renderers.
   SDL_Window* getNativeWindowHandle() const;
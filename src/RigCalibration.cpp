@@ -0,0 +1,654 @@
+#include "RigCalibration.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <numeric>
+
+#include <opencv2/calib3d.hpp>
+#include <opencv2/core.hpp>
+
+namespace
+{
+constexpr double initialDamping = 1e-3;
+constexpr double minDamping = 1e-12;
+/// Damping at which a step is given up, the error no longer decreases
+constexpr double maxDamping = 1e12;
+/// Lower bound of a damped diagonal entry, keeps poses the observations do not constrain solvable
+constexpr double minDiagonal = 1e-9;
+/// Relative decrease of the squared error below which a step counts as converged
+constexpr double convergedImprovement = 1e-10;
+/// Largest rotation in radians between a camera placement and the consensus
+/// of the other observations for both to count as the same corner order
+constexpr double maxOrderDisagreement = 0.35;
+/// Half turn about the board normal, which the reverse corner order adds
+const cv::Matx33d halfTurn(-1.0, 0.0, 0.0, 0.0, -1.0, 0.0, 0.0, 0.0, 1.0);
+
+cv::Matx33d toRotation(const cv::Vec3d& rotationVector)
+{
+    cv::Matx33d rotation;
+    cv::Rodrigues(rotationVector, rotation);
+    return rotation;
+}
+
+/// Angle of the rotation between a and b
+double rotationDistance(const cv::Matx33d& a, const cv::Matx33d& b)
+{
+    return std::acos(std::clamp(0.5 * (cv::trace(a.t() * b) - 1.0), -1.0, 1.0));
+}
+
+/// Center of the board corners. Returns false if numbering the corners in
+/// reverse is not the board turned half around its normal through the
+/// center, then the order is never ambiguous.
+bool getReversalCenter(const std::vector<cv::Point3d>& points, cv::Vec3d& center)
+{
+    if (points.empty()) {
+        return false;
+    }
+    center = cv::Vec3d();
+    double extent = 0.0;
+    for (const auto& point : points) {
+        center += cv::Vec3d(point);
+        extent = std::max(extent, cv::norm(point));
+    }
+    center *= 1.0 / static_cast<double>(points.size());
+    const double tolerance = 1e-5 * (1.0 + extent);
+    for (size_t j = 0; j < points.size(); ++j) {
+        const cv::Vec3d turned = halfTurn * (cv::Vec3d(points[j]) - center) + center;
+        if (cv::norm(turned - cv::Vec3d(points[points.size() - 1 - j])) > tolerance) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/// Turn a board pose into the pose found from the corners in reverse order,
+/// and back again
+void reverseBoard(const cv::Vec3d& center, cv::Matx33d& rotation, cv::Vec3d& translation)
+{
+    translation += rotation * (center - halfTurn * center);
+    rotation = rotation * halfTurn;
+}
+
+cv::Vec<double, 6> toPoseVector(const cv::Matx33d& rotation, const cv::Vec3d& translation)
+{
+    cv::Vec3d rotationVector;
+    cv::Rodrigues(rotation, rotationVector);
+    return cv::Vec<double, 6>(rotationVector[0], rotationVector[1], rotationVector[2], translation[0], translation[1], translation[2]);
+}
+
+/// Mean of rigid transforms: the rotation closest to the sum of the rotation
+/// matrices (chordal mean) and the mean translation
+void averagePose(const std::vector<cv::Matx33d>& rotations, const std::vector<cv::Vec3d>& translations, cv::Matx33d& rotation, cv::Vec3d& translation)
+{
+    cv::Matx33d rotationSum = cv::Matx33d::zeros();
+    cv::Vec3d translationSum;
+    for (size_t i = 0; i < rotations.size(); ++i) {
+        rotationSum += rotations[i];
+        translationSum += translations[i];
+    }
+    cv::Matx33d u;
+    cv::Matx33d vt;
+    cv::Vec3d singularValues;
+    cv::SVD::compute(rotationSum, singularValues, u, vt);
+    // the closest orthogonal matrix may be a reflection
+    if (cv::determinant(u * vt) < 0.0) {
+        for (int row = 0; row < 3; ++row) {
+            u(row, 2) = -u(row, 2);
+        }
+    }
+    rotation = u * vt;
+    translation = translationSum * (1.0 / static_cast<double>(translations.size()));
+}
+
+/// Derivative of a composed pose (rotation, translation) by one of its parts
+/// from the blocks cv::composeRT returns
+cv::Matx<double, 6, 6> stackDerivatives(const cv::Matx33d& rotationByRotation, const cv::Matx33d& rotationByTranslation,
+                                        const cv::Matx33d& translationByRotation, const cv::Matx33d& translationByTranslation)
+{
+    cv::Matx<double, 6, 6> derivative;
+    for (int row = 0; row < 3; ++row) {
+        for (int col = 0; col < 3; ++col) {
+            derivative(row, col) = rotationByRotation(row, col);
+            derivative(row, col + 3) = rotationByTranslation(row, col);
+            derivative(row + 3, col) = translationByRotation(row, col);
+            derivative(row + 3, col + 3) = translationByTranslation(row, col);
+        }
+    }
+    return derivative;
+}
+
+void addBlock(cv::Mat& matrix, int row, int col, const cv::Matx<double, 6, 6>& block)
+{
+    for (int r = 0; r < 6; ++r) {
+        double* values = matrix.ptr<double>(row + r) + col;
+        for (int c = 0; c < 6; ++c) {
+            values[c] += block(r, c);
+        }
+    }
+}
+} // namespace
+
+RigCalibration::RigCalibration(size_t cameraCount, const std::vector<cv::Vec3f>& objectPoints)
+    : cameraCount_(cameraCount)
+    , observationCount_(0)
+    , pointCount_(0)
+    , damping_(initialDamping)
+    , error_(0.0)
+    , extrinsics_(cameraCount, Pose{cv::Vec3d(), cv::Vec3d()})
+{
+    objectPoints_.reserve(objectPoints.size());
+    for (const auto& point : objectPoints) {
+        objectPoints_.emplace_back(point[0], point[1], point[2]);
+    }
+    reversible_ = getReversalCenter(objectPoints_, boardCenter_);
+}
+
+bool RigCalibration::addObservation(const std::vector<std::vector<cv::Point2f>>& points)
+{
+    if (points.size() != cameraCount_) {
+        return false;
+    }
+    size_t seen = 0;
+    for (const auto& camera : points) {
+        seen += camera.size() == objectPoints_.size() ? 1 : 0;
+    }
+    if (seen < 2) {
+        return false;
+    }
+    for (const auto& camera : points) {
+        if (camera.size() == objectPoints_.size()) {
+            points_.push_back(camera);
+            pointCount_ += camera.size();
+        } else {
+            points_.emplace_back();
+        }
+    }
+    ++observationCount_;
+    return true;
+}
+
+bool RigCalibration::calibrate(const std::vector<std::shared_ptr<const Intrinsics>>& intrinsics, uint32_t maxIterations)
+{
+    if (intrinsics.size() != cameraCount_ || std::any_of(intrinsics.begin(), intrinsics.end(), [](const auto& camera) { return !camera; })) {
+        std::fprintf(stderr, "Every camera of the rig needs to be calibrated first\n");
+        return false;
+    }
+    if (observationCount_ == 0) {
+        std::fprintf(stderr, "No board was seen by two cameras at once\n");
+        return false;
+    }
+    intrinsics_ = intrinsics;
+    cameras_.assign(cameraCount_, PoseVector::all(0.0));
+    boards_.assign(observationCount_, PoseVector::all(0.0));
+    candidateCameras_.assign(cameraCount_, PoseVector::all(0.0));
+    candidateBoards_.assign(observationCount_, PoseVector::all(0.0));
+    observationErrors_.assign(observationCount_, 0.0);
+    blocks_.resize(observationCount_);
+    for (auto& block : blocks_) {
+        block.U.resize(cameraCount_);
+        block.W.resize(cameraCount_);
+        block.CameraGradient.resize(cameraCount_);
+    }
+    if (!initialize()) {
+        return false;
+    }
+
+    damping_ = initialDamping;
+    double squaredError = cost(cameras_, boards_);
+    for (uint32_t iteration = 0; iteration < maxIterations; ++iteration) {
+        squaredError = linearize();
+        // raise the damping until a step decreases the error
+        bool improved = false;
+        bool converged = false;
+        while (damping_ < maxDamping) {
+            if (solveStep(candidateCameras_, candidateBoards_)) {
+                const double candidateError = cost(candidateCameras_, candidateBoards_);
+                if (candidateError < squaredError) {
+                    converged = squaredError - candidateError < convergedImprovement * squaredError;
+                    squaredError = candidateError;
+                    std::swap(cameras_, candidateCameras_);
+                    std::swap(boards_, candidateBoards_);
+                    damping_ = std::max(damping_ * 0.1, minDamping);
+                    improved = true;
+                    break;
+                }
+            }
+            damping_ *= 10.0;
+        }
+        if (!improved || converged) {
+            break;
+        }
+    }
+    error_ = pointCount_ > 0 ? std::sqrt(squaredError / pointCount_) : 0.0;
+    for (size_t c = 0; c < cameraCount_; ++c) {
+        extrinsics_[c] = Pose{cv::Vec3d(cameras_[c][0], cameras_[c][1], cameras_[c][2]), cv::Vec3d(cameras_[c][3], cameras_[c][4], cameras_[c][5])};
+    }
+    return true;
+}
+
+bool RigCalibration::initialize()
+{
+    // board pose in every camera which saw it
+    std::vector<PoseVector> views(observationCount_ * cameraCount_);
+    std::vector<uint8_t> posed(observationCount_ * cameraCount_, 0);
+    cv::parallel_for_(cv::Range(0, static_cast<int>(observationCount_)), [this, &views, &posed](const cv::Range& range) {
+        for (int o = range.start; o < range.end; ++o) {
+            for (size_t c = 0; c < cameraCount_; ++c) {
+                const auto& points = getPoints(o, c);
+                cv::Vec3d rotation;
+                cv::Vec3d translation;
+                if (!points.empty() &&
+                    cv::solvePnP(objectPoints_, points, intrinsics_[c]->CameraMatrix, intrinsics_[c]->DistortionCoefficients, rotation, translation)) {
+                    views[o * cameraCount_ + c] = PoseVector(rotation[0], rotation[1], rotation[2], translation[0], translation[1], translation[2]);
+                    posed[o * cameraCount_ + c] = 1;
+                }
+            }
+        }
+    });
+    // views without a pose would only pull the solution off
+    pointCount_ = 0;
+    for (size_t i = 0; i < points_.size(); ++i) {
+        if (!posed[i]) {
+            points_[i].clear();
+        }
+        pointCount_ += points_[i].size();
+    }
+
+    // place the cameras relative to camera 0 through the cameras already
+    // placed, averaged over every observation they share
+    std::vector<uint8_t> placed(cameraCount_, 0);
+    std::vector<cv::Matx33d> cameraRotations(cameraCount_, cv::Matx33d::eye());
+    std::vector<cv::Vec3d> cameraTranslations(cameraCount_);
+    placed[0] = 1;
+    // placement of camera c by every shared observation, as found and with c's corners reversed
+    struct Placement {
+        size_t Observation;
+        cv::Matx33d Rotations[2];
+        cv::Vec3d Translations[2];
+    };
+    std::vector<Placement> placements;
+    std::vector<cv::Matx33d> rotations;
+    std::vector<cv::Vec3d> translations;
+    for (bool progress = true; progress;) {
+        progress = false;
+        for (size_t c = 1; c < cameraCount_; ++c) {
+            if (placed[c]) {
+                continue;
+            }
+            placements.clear();
+            for (size_t o = 0; o < observationCount_; ++o) {
+                if (!posed[o * cameraCount_ + c]) {
+                    continue;
+                }
+                for (size_t k = 0; k < cameraCount_; ++k) {
+                    if (k == c || !placed[k] || !posed[o * cameraCount_ + k]) {
+                        continue;
+                    }
+                    // camera 0 into k, into the board and into c
+                    const PoseVector& inC = views[o * cameraCount_ + c];
+                    const PoseVector& inK = views[o * cameraCount_ + k];
+                    const cv::Matx33d boardToK = toRotation(cv::Vec3d(inK[0], inK[1], inK[2]));
+                    Placement placement{o, {}, {}};
+                    for (int order = 0; order < (reversible_ ? 2 : 1); ++order) {
+                        cv::Matx33d boardToC = toRotation(cv::Vec3d(inC[0], inC[1], inC[2]));
+                        cv::Vec3d boardToCTranslation(inC[3], inC[4], inC[5]);
+                        if (order == 1) {
+                            reverseBoard(boardCenter_, boardToC, boardToCTranslation);
+                        }
+                        const cv::Matx33d kToC = boardToC * boardToK.t();
+                        const cv::Vec3d kToCTranslation = boardToCTranslation - kToC * cv::Vec3d(inK[3], inK[4], inK[5]);
+                        placement.Rotations[order] = kToC * cameraRotations[k];
+                        placement.Translations[order] = kToC * cameraTranslations[k] + kToCTranslation;
+                    }
+                    if (!reversible_) {
+                        placement.Rotations[1] = placement.Rotations[0];
+                        placement.Translations[1] = placement.Translations[0];
+                    }
+                    placements.push_back(placement);
+                    break;
+                }
+            }
+            if (placements.empty()) {
+                continue;
+            }
+
+            // only the right corner orders agree with each other on where c is,
+            // take the placement most others agree with as reference
+            const auto closest = [](const Placement& placement, const cv::Matx33d& rotation) {
+                const double distances[2] = {rotationDistance(placement.Rotations[0], rotation), rotationDistance(placement.Rotations[1], rotation)};
+                return distances[1] < distances[0] ? 1 : 0;
+            };
+            const cv::Matx33d* reference = &placements.front().Rotations[0];
+            size_t bestAgreement = 0;
+            for (const auto& candidate : placements) {
+                for (const auto& rotation : candidate.Rotations) {
+                    size_t agreement = 0;
+                    for (const auto& placement : placements) {
+                        agreement += rotationDistance(placement.Rotations[closest(placement, rotation)], rotation) < maxOrderDisagreement ? 1 : 0;
+                    }
+                    if (agreement > bestAgreement) {
+                        bestAgreement = agreement;
+                        reference = &rotation;
+                    }
+                }
+            }
+            rotations.clear();
+            translations.clear();
+            for (const auto& placement : placements) {
+                const int order = closest(placement, *reference);
+                rotations.push_back(placement.Rotations[order]);
+                translations.push_back(placement.Translations[order]);
+                if (order == 1) {
+                    // from now on c sees this board in the order of the rig
+                    PoseVector& view = views[placement.Observation * cameraCount_ + c];
+                    cv::Matx33d rotation = toRotation(cv::Vec3d(view[0], view[1], view[2]));
+                    cv::Vec3d translation(view[3], view[4], view[5]);
+                    reverseBoard(boardCenter_, rotation, translation);
+                    view = toPoseVector(rotation, translation);
+                    auto& points = points_[placement.Observation * cameraCount_ + c];
+                    std::reverse(points.begin(), points.end());
+                }
+            }
+            averagePose(rotations, translations, cameraRotations[c], cameraTranslations[c]);
+            placed[c] = 1;
+            progress = true;
+        }
+    }
+    for (size_t c = 0; c < cameraCount_; ++c) {
+        if (!placed[c]) {
+            std::fprintf(stderr, "Camera %zu never saw the board together with the other cameras\n", c);
+            return false;
+        }
+        cameras_[c] = toPoseVector(cameraRotations[c], cameraTranslations[c]);
+    }
+
+    // board of every observation in camera 0, from the first camera which posed it
+    for (size_t o = 0; o < observationCount_; ++o) {
+        for (size_t c = 0; c < cameraCount_; ++c) {
+            if (posed[o * cameraCount_ + c]) {
+                const PoseVector& view = views[o * cameraCount_ + c];
+                const cv::Matx33d cameraToZero = cameraRotations[c].t();
+                boards_[o] = toPoseVector(cameraToZero * toRotation(cv::Vec3d(view[0], view[1], view[2])),
+                                          cameraToZero * (cv::Vec3d(view[3], view[4], view[5]) - cameraTranslations[c]));
+                break;
+            }
+        }
+    }
+    return true;
+}
+
+double RigCalibration::linearize()
+{
+    cv::parallel_for_(cv::Range(0, static_cast<int>(observationCount_)), [this](const cv::Range& range) {
+        std::vector<cv::Point2d> projected;
+        cv::Mat jacobian;
+        for (int o = range.start; o < range.end; ++o) {
+            ObservationBlock& block = blocks_[o];
+            block.V = cv::Matx<double, 6, 6>::zeros();
+            block.BoardGradient = PoseVector::all(0.0);
+            const cv::Vec3d boardRotation(boards_[o][0], boards_[o][1], boards_[o][2]);
+            const cv::Vec3d boardTranslation(boards_[o][3], boards_[o][4], boards_[o][5]);
+            double squaredError = 0.0;
+            for (size_t c = 0; c < cameraCount_; ++c) {
+                block.U[c] = cv::Matx<double, 6, 6>::zeros();
+                block.W[c] = cv::Matx<double, 6, 6>::zeros();
+                block.CameraGradient[c] = PoseVector::all(0.0);
+                const auto& points = getPoints(o, c);
+                if (points.empty()) {
+                    continue;
+                }
+                // board into camera c and how the composed pose depends on both parts
+                cv::Vec3d rotation = boardRotation;
+                cv::Vec3d translation = boardTranslation;
+                cv::Matx<double, 6, 6> byBoard = cv::Matx<double, 6, 6>::eye();
+                cv::Matx<double, 6, 6> byCamera = cv::Matx<double, 6, 6>::zeros();
+                if (c > 0) {
+                    cv::Matx33d dr3dr1;
+                    cv::Matx33d dr3dt1;
+                    cv::Matx33d dr3dr2;
+                    cv::Matx33d dr3dt2;
+                    cv::Matx33d dt3dr1;
+                    cv::Matx33d dt3dt1;
+                    cv::Matx33d dt3dr2;
+                    cv::Matx33d dt3dt2;
+                    cv::composeRT(boardRotation, boardTranslation, cv::Vec3d(cameras_[c][0], cameras_[c][1], cameras_[c][2]),
+                                  cv::Vec3d(cameras_[c][3], cameras_[c][4], cameras_[c][5]), rotation, translation, dr3dr1, dr3dt1, dr3dr2, dr3dt2, dt3dr1,
+                                  dt3dt1, dt3dr2, dt3dt2);
+                    byBoard = stackDerivatives(dr3dr1, dr3dt1, dt3dr1, dt3dt1);
+                    byCamera = stackDerivatives(dr3dr2, dr3dt2, dt3dr2, dt3dt2);
+                }
+                cv::projectPoints(objectPoints_, rotation, translation, intrinsics_[c]->CameraMatrix, intrinsics_[c]->DistortionCoefficients, projected,
+                                  jacobian);
+                // J^T J and J^T r by the composed pose, the first 6 columns of the Jacobian
+                cv::Matx<double, 6, 6> normal = cv::Matx<double, 6, 6>::zeros();
+                PoseVector gradient = PoseVector::all(0.0);
+                for (size_t j = 0; j < projected.size(); ++j) {
+                    const double residuals[2] = {projected[j].x - points[j].x, projected[j].y - points[j].y};
+                    for (int axis = 0; axis < 2; ++axis) {
+                        const double* row = jacobian.ptr<double>(static_cast<int>(2 * j) + axis);
+                        for (int r = 0; r < 6; ++r) {
+                            gradient[r] += row[r] * residuals[axis];
+                            for (int k = r; k < 6; ++k) {
+                                normal(r, k) += row[r] * row[k];
+                            }
+                        }
+                        squaredError += residuals[axis] * residuals[axis];
+                    }
+                }
+                for (int r = 1; r < 6; ++r) {
+                    for (int k = 0; k < r; ++k) {
+                        normal(r, k) = normal(k, r);
+                    }
+                }
+                // chain rule through the composition
+                const cv::Matx<double, 6, 6> normalByBoard = normal * byBoard;
+                block.V += byBoard.t() * normalByBoard;
+                block.BoardGradient += byBoard.t() * gradient;
+                if (c > 0) {
+                    block.U[c] = byCamera.t() * normal * byCamera;
+                    block.W[c] = byCamera.t() * normalByBoard;
+                    block.CameraGradient[c] = byCamera.t() * gradient;
+                }
+            }
+            observationErrors_[o] = squaredError;
+        }
+    });
+    return std::accumulate(observationErrors_.begin(), observationErrors_.end(), 0.0);
+}
+
+bool RigCalibration::solveStep(std::vector<PoseVector>& cameras, std::vector<PoseVector>& boards)
+{
+    // invert the damped board block of every observation
+    cv::parallel_for_(cv::Range(0, static_cast<int>(observationCount_)), [this](const cv::Range& range) {
+        for (int o = range.start; o < range.end; ++o) {
+            ObservationBlock& block = blocks_[o];
+            cv::Matx<double, 6, 6> damped = block.V;
+            for (int k = 0; k < 6; ++k) {
+                damped(k, k) += damping_ * std::max(block.V(k, k), minDiagonal);
+            }
+            block.Solvable = false;
+            block.InverseV = damped.inv(cv::DECOMP_CHOLESKY, &block.Solvable);
+        }
+    });
+
+    // Schur complement over the poses of cameras 1 and up,
+    // S = U - sum W V^-1 W^T with right side -g_c + sum W V^-1 g_b
+    const int size = static_cast<int>(6 * (cameraCount_ - 1));
+    cv::Mat schur = cv::Mat::zeros(size, size, CV_64F);
+    cv::Mat rightSide = cv::Mat::zeros(size, 1, CV_64F);
+    std::vector<cv::Matx<double, 6, 6>> cameraBlocks(cameraCount_, cv::Matx<double, 6, 6>::zeros());
+    for (size_t o = 0; o < observationCount_; ++o) {
+        const ObservationBlock& block = blocks_[o];
+        if (!block.Solvable) {
+            return false;
+        }
+        for (size_t c = 1; c < cameraCount_; ++c) {
+            if (getPoints(o, c).empty()) {
+                continue;
+            }
+            cameraBlocks[c] += block.U[c];
+            const cv::Matx<double, 6, 6> wInverseV = block.W[c] * block.InverseV;
+            const PoseVector reduced = wInverseV * block.BoardGradient - block.CameraGradient[c];
+            for (int k = 0; k < 6; ++k) {
+                rightSide.at<double>(static_cast<int>(6 * (c - 1)) + k) += reduced[k];
+            }
+            for (size_t d = 1; d < cameraCount_; ++d) {
+                if (!getPoints(o, d).empty()) {
+                    addBlock(schur, static_cast<int>(6 * (c - 1)), static_cast<int>(6 * (d - 1)), -(wInverseV * block.W[d].t()));
+                }
+            }
+        }
+    }
+    for (size_t c = 1; c < cameraCount_; ++c) {
+        for (int k = 0; k < 6; ++k) {
+            cameraBlocks[c](k, k) += damping_ * std::max(cameraBlocks[c](k, k), minDiagonal);
+        }
+        addBlock(schur, static_cast<int>(6 * (c - 1)), static_cast<int>(6 * (c - 1)), cameraBlocks[c]);
+    }
+    cv::Mat cameraStep;
+    if (!cv::solve(schur, rightSide, cameraStep, cv::DECOMP_CHOLESKY)) {
+        return false;
+    }
+    cameras[0] = cameras_[0];
+    for (size_t c = 1; c < cameraCount_; ++c) {
+        cameras[c] = cameras_[c] + PoseVector(cameraStep.ptr<double>(static_cast<int>(6 * (c - 1))));
+    }
+
+    // back substitute the board of every observation
+    cv::parallel_for_(cv::Range(0, static_cast<int>(observationCount_)), [this, &cameraStep, &boards](const cv::Range& range) {
+        for (int o = range.start; o < range.end; ++o) {
+            const ObservationBlock& block = blocks_[o];
+            PoseVector coupled = block.BoardGradient;
+            for (size_t c = 1; c < cameraCount_; ++c) {
+                if (!getPoints(o, c).empty()) {
+                    coupled += block.W[c].t() * PoseVector(cameraStep.ptr<double>(static_cast<int>(6 * (c - 1))));
+                }
+            }
+            boards[o] = boards_[o] - block.InverseV * coupled;
+        }
+    });
+    return true;
+}
+
+double RigCalibration::cost(const std::vector<PoseVector>& cameras, const std::vector<PoseVector>& boards)
+{
+    cv::parallel_for_(cv::Range(0, static_cast<int>(observationCount_)), [this, &cameras, &boards](const cv::Range& range) {
+        std::vector<cv::Point2d> projected;
+        for (int o = range.start; o < range.end; ++o) {
+            const cv::Vec3d boardRotation(boards[o][0], boards[o][1], boards[o][2]);
+            const cv::Vec3d boardTranslation(boards[o][3], boards[o][4], boards[o][5]);
+            double squaredError = 0.0;
+            for (size_t c = 0; c < cameraCount_; ++c) {
+                const auto& points = getPoints(o, c);
+                if (points.empty()) {
+                    continue;
+                }
+                cv::Vec3d rotation = boardRotation;
+                cv::Vec3d translation = boardTranslation;
+                if (c > 0) {
+                    cv::composeRT(boardRotation, boardTranslation, cv::Vec3d(cameras[c][0], cameras[c][1], cameras[c][2]),
+                                  cv::Vec3d(cameras[c][3], cameras[c][4], cameras[c][5]), rotation, translation);
+                }
+                cv::projectPoints(objectPoints_, rotation, translation, intrinsics_[c]->CameraMatrix, intrinsics_[c]->DistortionCoefficients, projected);
+                for (size_t j = 0; j < projected.size(); ++j) {
+                    const double dx = projected[j].x - points[j].x;
+                    const double dy = projected[j].y - points[j].y;
+                    squaredError += dx * dx + dy * dy;
+                }
+            }
+            observationErrors_[o] = squaredError;
+        }
+    });
+    return std::accumulate(observationErrors_.begin(), observationErrors_.end(), 0.0);
+}
+
+bool RigCalibration::save(const std::string& path, const std::vector<std::string>& names) const
+{
+    cv::Mat rotations(static_cast<int>(cameraCount_), 3, CV_64F);
+    cv::Mat translations(static_cast<int>(cameraCount_), 3, CV_64F);
+    for (size_t c = 0; c < cameraCount_; ++c) {
+        for (int j = 0; j < 3; ++j) {
+            rotations.at<double>(static_cast<int>(c), j) = extrinsics_[c].RotationVector[j];
+            translations.at<double>(static_cast<int>(c), j) = extrinsics_[c].TranslationVector[j];
+        }
+    }
+    cv::FileStorage storage(path, cv::FileStorage::WRITE);
+    if (!storage.isOpened()) {
+        std::fprintf(stderr, "Could not write the rig extrinsics to %s\n", path.c_str());
+        return false;
+    }
+    storage << "names" << names;
+    storage << "rotations" << rotations;
+    storage << "translations" << translations;
+    storage << "reprojection_error" << error_;
+    storage << "observations" << static_cast<int>(observationCount_);
+    return true;
+}
+
+bool RigCalibration::load(const std::string& path, std::vector<std::string>& names, std::vector<Pose>& extrinsics)
+{
+    cv::FileStorage storage;
+    try {
+        if (!storage.open(path, cv::FileStorage::READ)) {
+            std::fprintf(stderr, "Could not read %s\n", path.c_str());
+            return false;
+        }
+    } catch (cv::Exception& e) {
+        std::fprintf(stderr, "Could not read %s: %s\n", path.c_str(), e.what());
+        return false;
+    }
+    cv::Mat rotations;
+    cv::Mat translations;
+    storage["names"] >> names;
+    storage["rotations"] >> rotations;
+    storage["translations"] >> translations;
+    if (rotations.cols != 3 || rotations.size() != translations.size() || static_cast<size_t>(rotations.rows) != names.size()) {
+        std::fprintf(stderr, "%s is incomplete\n", path.c_str());
+        return false;
+    }
+    extrinsics.resize(rotations.rows);
+    for (int i = 0; i < rotations.rows; ++i) {
+        extrinsics[i].RotationVector = cv::Vec3d(rotations.ptr<double>(i));
+        extrinsics[i].TranslationVector = cv::Vec3d(translations.ptr<double>(i));
+    }
+    return true;
+}
+
+bool RigCalibration::fusePoses(const std::vector<Pose>& extrinsics, const std::vector<std::optional<Pose>>& poses, const std::vector<cv::Vec3f>& objectPoints,
+                               Pose& fused)
+{
+    std::vector<cv::Point3d> points;
+    points.reserve(objectPoints.size());
+    for (const auto& point : objectPoints) {
+        points.emplace_back(point[0], point[1], point[2]);
+    }
+    cv::Vec3d center;
+    const bool reversible = getReversalCenter(points, center);
+    std::vector<cv::Matx33d> rotations;
+    std::vector<cv::Vec3d> translations;
+    for (size_t c = 0; c < std::min(extrinsics.size(), poses.size()); ++c) {
+        if (!poses[c]) {
+            continue;
+        }
+        // board into camera c, back into camera 0
+        const cv::Matx33d cameraToZero = toRotation(extrinsics[c].RotationVector).t();
+        cv::Matx33d rotation = cameraToZero * toRotation(poses[c]->RotationVector);
+        cv::Vec3d translation = cameraToZero * (poses[c]->TranslationVector - extrinsics[c].TranslationVector);
+        // the corner orders differ by a half turn, keep the one of the first camera
+        if (reversible && !rotations.empty() && rotationDistance(rotation, rotations.front()) > 0.5 * CV_PI) {
+            reverseBoard(center, rotation, translation);
+        }
+        rotations.push_back(rotation);
+        translations.push_back(translation);
+    }
+    if (rotations.empty()) {
+        return false;
+    }
+    cv::Matx33d rotation;
+    cv::Vec3d translation;
+    averagePose(rotations, translations, rotation, translation);
+    cv::Rodrigues(rotation, fused.RotationVector);
+    fused.TranslationVector = translation;
+    return true;
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <opencv2/core/mat.hpp>
+#include <opencv2/core/matx.hpp>
+
+#include "CalibrationWorker.h"
+
+/// Extrinsic calibration of several cameras on a rig from boards seen by
+/// more than one of them at the same time. Every observation holds the
+/// corners of one board position in each camera which detected it. The pose
+/// of every camera relative to camera 0 and the board pose of every
+/// observation are refined jointly by Levenberg-Marquardt on the reprojection
+/// error in all cameras, keeping the intrinsics of each camera fixed. Like in
+/// SparseCalibration, the board poses are eliminated per observation so only
+/// a system over the camera poses is solved, and observations are linearized
+/// in parallel. Chessboards are detected in either of two corner orders, the
+/// board turned half around, so the order of every camera is made to agree
+/// with the others before the poses are combined.
+class RigCalibration
+{
+public:
+    /// Rigid transform x' = R x + t
+    struct Pose {
+        cv::Vec3d RotationVector;
+        cv::Vec3d TranslationVector;
+    };
+
+    /// objectPoints are the board corners in the order the detections return them
+    RigCalibration(size_t cameraCount, const std::vector<cv::Vec3f>& objectPoints);
+
+    /// Add the corners of one board position, points[c] empty if camera c did
+    /// not detect it. Returns false if fewer than two cameras saw the board,
+    /// such observations do not relate the cameras and are dropped.
+    bool addObservation(const std::vector<std::vector<cv::Point2f>>& points);
+    inline size_t getObservationCount() const { return observationCount_; };
+    inline size_t getCameraCount() const { return cameraCount_; };
+
+    /// Solve for the pose of every camera relative to camera 0 with the
+    /// intrinsics of every camera. Returns false if a camera shares no
+    /// observation with the others or the intrinsics are missing.
+    bool calibrate(const std::vector<std::shared_ptr<const Intrinsics>>& intrinsics, uint32_t maxIterations);
+    /// Transform from camera 0 into every camera, identity for camera 0
+    inline const std::vector<Pose>& getExtrinsics() const { return extrinsics_; };
+    /// RMS reprojection error over every camera of every observation in pixels
+    inline double getError() const { return error_; };
+
+    /// Store the extrinsics of the cameras named names with the error as YAML
+    bool save(const std::string& path, const std::vector<std::string>& names) const;
+    /// Read extrinsics written by save
+    static bool load(const std::string& path, std::vector<std::string>& names, std::vector<Pose>& extrinsics);
+
+    /// Board pose in camera 0 from the board poses of the cameras which found
+    /// it, averaged over them. objectPoints are the board corners the poses
+    /// were solved with, poses of cameras which found the corners in reverse
+    /// order are turned to agree with the first camera. Returns false if no
+    /// camera has a pose.
+    static bool fusePoses(const std::vector<Pose>& extrinsics, const std::vector<std::optional<Pose>>& poses, const std::vector<cv::Vec3f>& objectPoints,
+                          Pose& fused);
+
+private:
+    using PoseVector = cv::Vec<double, 6>;
+
+    /// Normal equations of one observation. The board pose couples to every
+    /// camera seeing it, the camera blocks are indexed by camera and zero for
+    /// camera 0 and the cameras which did not see it.
+    struct ObservationBlock {
+        cv::Matx<double, 6, 6> V;
+        PoseVector BoardGradient;
+        std::vector<cv::Matx<double, 6, 6>> U;
+        std::vector<cv::Matx<double, 6, 6>> W;
+        std::vector<PoseVector> CameraGradient;
+        cv::Matx<double, 6, 6> InverseV;
+        bool Solvable;
+    };
+
+    /// Corners of an observation in a camera, empty if it did not see the board
+    inline const std::vector<cv::Point2f>& getPoints(size_t observation, size_t camera) const { return points_[observation * cameraCount_ + camera]; };
+    /// Initial camera and board poses from a pose of the board in every camera,
+    /// reversing the corners of views whose order disagrees with the rig
+    bool initialize();
+    /// Fill the blocks at the current parameters, returns the squared error
+    double linearize();
+    /// Solve the damped normal equations for the next parameters, false if singular
+    bool solveStep(std::vector<PoseVector>& cameras, std::vector<PoseVector>& boards);
+    /// Sum of squared reprojection errors at the given parameters
+    double cost(const std::vector<PoseVector>& cameras, const std::vector<PoseVector>& boards);
+
+    const size_t cameraCount_;
+    std::vector<cv::Point3d> objectPoints_;
+    /// Center the board turns around when its corners are found in reverse order
+    cv::Vec3d boardCenter_;
+    /// Whether the reverse order is the board turned half around, not for asymmetric grids
+    bool reversible_;
+    /// Corners of every observation in every camera, observation major
+    std::vector<std::vector<cv::Point2f>> points_;
+    size_t observationCount_;
+    size_t pointCount_;
+
+    std::vector<std::shared_ptr<const Intrinsics>> intrinsics_;
+    std::vector<PoseVector> cameras_;
+    std::vector<PoseVector> boards_;
+    std::vector<ObservationBlock> blocks_;
+    /// Squared error of every observation, summed in order so results do not depend on threading
+    std::vector<double> observationErrors_;
+    std::vector<PoseVector> candidateCameras_;
+    std::vector<PoseVector> candidateBoards_;
+    double damping_;
+    double error_;
+    std::vector<Pose> extrinsics_;
+};
@@ -0,0 +1,510 @@
+#include "SaddlePointDetector.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+
+#include <opencv2/core/utility.hpp>
+#include <opencv2/imgproc.hpp>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SADDLE_AVX2 1
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SADDLE_SSE2 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define SADDLE_NEON 1
+#endif
+
+namespace
+{
+/// Ring of 16 samples at radius 5 around the center, sample n + 8 lies
+/// opposite of sample n
+constexpr int ringRadius = 5;
+constexpr int ringX[16] = {5, 5, 4, 2, 0, -2, -4, -5, -5, -5, -4, -2, 0, 2, 4, 5};
+constexpr int ringY[16] = {0, 2, 4, 5, 5, 5, 4, 2, 0, -2, -4, -5, -5, -5, -4, -2};
+
+/// Side of the tiles maxima are searched in, each tile has its own threshold
+constexpr int tileSize = 32;
+/// Responses below this are never corners, keeps flat tiles from producing noise
+constexpr int minResponse = 96;
+/// Fraction of the strongest response of a tile a maximum needs
+constexpr float relativeThreshold = 0.3f;
+/// Maxima have to be the largest response within this distance
+constexpr int suppressionRadius = 2;
+/// Only the strongest candidates are considered for the grid
+constexpr int maxCandidatesPerCorner = 3;
+/// Strongest candidates tried as the start of the grid
+constexpr int maxSeeds = 16;
+/// Distance from the predicted position a corner may have, relative to the step
+constexpr float searchRadius = 0.4f;
+
+/// Response of one pixel, the reference for the vectorized versions.
+/// Opposite samples of an X-corner have the same intensity and samples a
+/// quarter turn apart differ, edges and blobs are penalized.
+inline int16_t saddleResponse(const uint8_t* center, const ptrdiff_t* offsets, ptrdiff_t stride)
+{
+    int samples[16];
+    int total = 0;
+    for (int n = 0; n < 16; ++n) {
+        samples[n] = center[offsets[n]];
+        total += samples[n];
+    }
+    int sum = 0;
+    for (int n = 0; n < 4; ++n) {
+        sum += std::abs(samples[n] + samples[n + 8] - samples[n + 4] - samples[n + 12]);
+    }
+    int diff = 0;
+    for (int n = 0; n < 8; ++n) {
+        diff += std::abs(samples[n] - samples[n + 8]);
+    }
+    // the mean of the ring has to match the mean around the center
+    const int local = center[-1] + center[1] + center[-stride] + center[stride];
+    const int response = sum - diff - std::abs(total - 4 * local);
+    return static_cast<int16_t>(std::max(response, 0));
+}
+
+/// Response of one row, borders closer than the ring radius are 0.
+/// All sums stay below 16 * 255 so 16 bit lanes don't overflow.
+void responseRow(const cv::Mat& gray, int y, int16_t* out)
+{
+    const uint8_t* row = gray.ptr<uint8_t>(y);
+    const ptrdiff_t stride = static_cast<ptrdiff_t>(gray.step);
+    ptrdiff_t offsets[16];
+    for (int n = 0; n < 16; ++n) {
+        offsets[n] = ringY[n] * stride + ringX[n];
+    }
+    const int end = gray.cols - ringRadius;
+    std::fill(out, out + ringRadius, static_cast<int16_t>(0));
+    int x = ringRadius;
+
+#if SADDLE_AVX2
+    const __m256i zero256 = _mm256_setzero_si256();
+    for (; x + 16 <= end; x += 16) {
+        const uint8_t* center = row + x;
+        auto load = [center](ptrdiff_t offset) {
+            return _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(center + offset)));
+        };
+        __m256i samples[16];
+        __m256i total = zero256;
+        for (int n = 0; n < 16; ++n) {
+            samples[n] = load(offsets[n]);
+            total = _mm256_add_epi16(total, samples[n]);
+        }
+        __m256i sum = zero256;
+        for (int n = 0; n < 4; ++n) {
+            const __m256i opposite = _mm256_add_epi16(samples[n], samples[n + 8]);
+            const __m256i quarter = _mm256_add_epi16(samples[n + 4], samples[n + 12]);
+            sum = _mm256_add_epi16(sum, _mm256_abs_epi16(_mm256_sub_epi16(opposite, quarter)));
+        }
+        __m256i diff = zero256;
+        for (int n = 0; n < 8; ++n) {
+            diff = _mm256_add_epi16(diff, _mm256_abs_epi16(_mm256_sub_epi16(samples[n], samples[n + 8])));
+        }
+        const __m256i local = _mm256_add_epi16(_mm256_add_epi16(load(-1), load(1)), _mm256_add_epi16(load(-stride), load(stride)));
+        const __m256i mean = _mm256_abs_epi16(_mm256_sub_epi16(total, _mm256_slli_epi16(local, 2)));
+        const __m256i response = _mm256_max_epi16(_mm256_sub_epi16(_mm256_sub_epi16(sum, diff), mean), zero256);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + x), response);
+    }
+#endif
+
+#if SADDLE_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    // SSE2 has no 16 bit absolute value
+    auto abs16 = [zero](__m128i value) { return _mm_max_epi16(value, _mm_sub_epi16(zero, value)); };
+    for (; x + 8 <= end; x += 8) {
+        const uint8_t* center = row + x;
+        auto load = [center, zero](ptrdiff_t offset) {
+            return _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(center + offset)), zero);
+        };
+        __m128i samples[16];
+        __m128i total = zero;
+        for (int n = 0; n < 16; ++n) {
+            samples[n] = load(offsets[n]);
+            total = _mm_add_epi16(total, samples[n]);
+        }
+        __m128i sum = zero;
+        for (int n = 0; n < 4; ++n) {
+            const __m128i opposite = _mm_add_epi16(samples[n], samples[n + 8]);
+            const __m128i quarter = _mm_add_epi16(samples[n + 4], samples[n + 12]);
+            sum = _mm_add_epi16(sum, abs16(_mm_sub_epi16(opposite, quarter)));
+        }
+        __m128i diff = zero;
+        for (int n = 0; n < 8; ++n) {
+            diff = _mm_add_epi16(diff, abs16(_mm_sub_epi16(samples[n], samples[n + 8])));
+        }
+        const __m128i local = _mm_add_epi16(_mm_add_epi16(load(-1), load(1)), _mm_add_epi16(load(-stride), load(stride)));
+        const __m128i mean = abs16(_mm_sub_epi16(total, _mm_slli_epi16(local, 2)));
+        const __m128i response = _mm_max_epi16(_mm_sub_epi16(_mm_sub_epi16(sum, diff), mean), zero);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x), response);
+    }
+#elif SADDLE_NEON
+    const int16x8_t zero = vdupq_n_s16(0);
+    for (; x + 8 <= end; x += 8) {
+        const uint8_t* center = row + x;
+        auto load = [center](ptrdiff_t offset) { return vreinterpretq_s16_u16(vmovl_u8(vld1_u8(center + offset))); };
+        int16x8_t samples[16];
+        int16x8_t total = zero;
+        for (int n = 0; n < 16; ++n) {
+            samples[n] = load(offsets[n]);
+            total = vaddq_s16(total, samples[n]);
+        }
+        int16x8_t sum = zero;
+        for (int n = 0; n < 4; ++n) {
+            const int16x8_t opposite = vaddq_s16(samples[n], samples[n + 8]);
+            const int16x8_t quarter = vaddq_s16(samples[n + 4], samples[n + 12]);
+            sum = vaddq_s16(sum, vabsq_s16(vsubq_s16(opposite, quarter)));
+        }
+        int16x8_t diff = zero;
+        for (int n = 0; n < 8; ++n) {
+            diff = vaddq_s16(diff, vabsq_s16(vsubq_s16(samples[n], samples[n + 8])));
+        }
+        const int16x8_t local = vaddq_s16(vaddq_s16(load(-1), load(1)), vaddq_s16(load(-stride), load(stride)));
+        const int16x8_t mean = vabsq_s16(vsubq_s16(total, vshlq_n_s16(local, 2)));
+        vst1q_s16(out + x, vmaxq_s16(vsubq_s16(vsubq_s16(sum, diff), mean), zero));
+    }
+#endif
+
+    for (; x < end; ++x) {
+        out[x] = saddleResponse(row + x, offsets, stride);
+    }
+    std::fill(out + std::max(end, ringRadius), out + gray.cols, static_cast<int16_t>(0));
+}
+
+/// Offset of the maximum of a parabola through three samples, in [-0.5, 0.5]
+inline float parabolaPeak(int before, int center, int after)
+{
+    const int curvature = before - 2 * center + after;
+    if (curvature >= 0) {
+        return 0.0f;
+    }
+    return std::clamp(0.5f * (before - after) / curvature, -0.5f, 0.5f);
+}
+
+/// Index of the candidate closest to position within radius which is not in the grid yet
+int findNearest(const std::vector<SaddlePointDetector::Corner>& candidates, const std::vector<int>& cells, const cv::Point2f& position, float radius)
+{
+    int nearest = -1;
+    float nearestDistance = radius * radius;
+    for (size_t i = 0; i < candidates.size(); ++i) {
+        if (cells[i] >= 0) {
+            continue;
+        }
+        const cv::Point2f offset = candidates[i].Position - position;
+        const float distance = offset.dot(offset);
+        if (distance < nearestDistance) {
+            nearestDistance = distance;
+            nearest = static_cast<int>(i);
+        }
+    }
+    return nearest;
+}
+
+/// Buffers of the grid assembly, reused between frames of the same thread
+struct GridScratch {
+    std::vector<SaddlePointDetector::Corner> Strongest;
+    /// candidate of every grid cell or -1
+    std::vector<int> Grid;
+    /// grid cell of every candidate or -1
+    std::vector<int> Cells;
+    std::vector<int> Queue;
+};
+} // namespace
+
+SaddlePointDetector::SaddlePointDetector(const cv::Size& patternSize)
+    : PatternDetector(Type::SaddlePoint, patternSize, 0)
+{
+}
+
+void SaddlePointDetector::computeResponse(const cv::Mat& gray, cv::Mat& response)
+{
+    response.create(gray.size(), CV_16S);
+    if (gray.rows <= 2 * ringRadius || gray.cols <= 2 * ringRadius) {
+        response.setTo(0);
+        return;
+    }
+    for (int y = 0; y < ringRadius; ++y) {
+        std::fill_n(response.ptr<int16_t>(y), gray.cols, static_cast<int16_t>(0));
+        std::fill_n(response.ptr<int16_t>(gray.rows - 1 - y), gray.cols, static_cast<int16_t>(0));
+    }
+    // stripes of rows on all cores
+    cv::parallel_for_(cv::Range(ringRadius, gray.rows - ringRadius), [&gray, &response](const cv::Range& rows) {
+        for (int y = rows.start; y < rows.end; ++y) {
+            responseRow(gray, y, response.ptr<int16_t>(y));
+        }
+    }, (gray.rows - 2 * ringRadius) / tileSize);
+}
+
+void SaddlePointDetector::findCandidates(const cv::Mat& response, std::vector<Corner>& corners)
+{
+    const int tilesX = (response.cols + tileSize - 1) / tileSize;
+    const int tilesY = (response.rows + tileSize - 1) / tileSize;
+    // reused between frames of the calling thread, the workers fill their tiles of it
+    thread_local std::vector<std::vector<Corner>> callerTileCorners;
+    auto& tileCorners = callerTileCorners;
+    tileCorners.resize(tilesX * tilesY);
+
+    cv::parallel_for_(cv::Range(0, tilesX * tilesY), [&response, &tileCorners, tilesX](const cv::Range& tiles) {
+        for (int tile = tiles.start; tile < tiles.end; ++tile) {
+            auto& found = tileCorners[tile];
+            found.clear();
+            const int left = std::max(suppressionRadius, (tile % tilesX) * tileSize);
+            const int top = std::max(suppressionRadius, (tile / tilesX) * tileSize);
+            const int right = std::min(response.cols - suppressionRadius, (tile % tilesX + 1) * tileSize);
+            const int bottom = std::min(response.rows - suppressionRadius, (tile / tilesX + 1) * tileSize);
+            // edge tiles can lie entirely inside the suppression border
+            if (right <= left || bottom <= top) {
+                continue;
+            }
+
+            // threshold relative to the tile so a dim part of the board isn't lost next to a bright one
+            int tileMax = 0;
+            for (int y = top; y < bottom; ++y) {
+                const int16_t* row = response.ptr<int16_t>(y);
+                tileMax = std::max<int>(tileMax, *std::max_element(row + left, row + right));
+            }
+            const int threshold = std::max(minResponse, static_cast<int>(relativeThreshold * tileMax));
+            if (tileMax < threshold) {
+                continue;
+            }
+
+            for (int y = top; y < bottom; ++y) {
+                const int16_t* row = response.ptr<int16_t>(y);
+                for (int x = left; x < right; ++x) {
+                    const int value = row[x];
+                    if (value < threshold) {
+                        continue;
+                    }
+                    bool maximum = true;
+                    for (int dy = -suppressionRadius; dy <= suppressionRadius && maximum; ++dy) {
+                        const int16_t* neighbours = response.ptr<int16_t>(y + dy);
+                        for (int dx = -suppressionRadius; dx <= suppressionRadius; ++dx) {
+                            const int neighbour = neighbours[x + dx];
+                            // plateaus keep their first pixel
+                            if (neighbour > value || (neighbour == value && (dy < 0 || (dy == 0 && dx < 0)))) {
+                                maximum = false;
+                                break;
+                            }
+                        }
+                    }
+                    if (maximum) {
+                        const int16_t* above = response.ptr<int16_t>(y - 1);
+                        const int16_t* below = response.ptr<int16_t>(y + 1);
+                        const cv::Point2f position(x + parabolaPeak(row[x - 1], value, row[x + 1]),
+                                                   y + parabolaPeak(above[x], value, below[x]));
+                        found.push_back(Corner{position, value});
+                    }
+                }
+            }
+        }
+    });
+
+    corners.clear();
+    for (const auto& found : tileCorners) {
+        corners.insert(corners.end(), found.begin(), found.end());
+    }
+}
+
+bool SaddlePointDetector::assembleGrid(const std::vector<Corner>& candidates, const cv::Size& patternSize, std::vector<cv::Point2f>& points)
+{
+    const int cornerCount = patternSize.area();
+    if (static_cast<int>(candidates.size()) < cornerCount) {
+        return false;
+    }
+    thread_local GridScratch scratch;
+    // weak candidates beyond a few times the pattern are noise
+    auto& strongest = scratch.Strongest;
+    strongest.assign(candidates.begin(), candidates.end());
+    std::sort(strongest.begin(), strongest.end(), [](const Corner& a, const Corner& b) { return a.Response > b.Response; });
+    if (static_cast<int>(strongest.size()) > maxCandidatesPerCorner * cornerCount) {
+        strongest.resize(maxCandidatesPerCorner * cornerCount);
+    }
+    const int candidateCount = static_cast<int>(strongest.size());
+
+    // grid coordinates relative to the seed, the seed may be any corner of the board
+    const int span = std::max(patternSize.width, patternSize.height) - 1;
+    const int side = 2 * span + 1;
+    auto& grid = scratch.Grid;
+    auto& cells = scratch.Cells;
+    auto& queue = scratch.Queue;
+    auto cellOf = [side, span](int i, int j) { return (j + span) * side + i + span; };
+    auto candidateAt = [&grid, &cellOf, span](int i, int j) {
+        return std::abs(i) > span || std::abs(j) > span ? -1 : grid[cellOf(i, j)];
+    };
+
+    for (int seed = 0; seed < std::min(candidateCount, maxSeeds); ++seed) {
+        grid.assign(side * side, -1);
+        cells.assign(candidateCount, -1);
+        queue.clear();
+        auto place = [&](int candidate, int i, int j) {
+            grid[cellOf(i, j)] = candidate;
+            cells[candidate] = cellOf(i, j);
+            queue.push_back(cellOf(i, j));
+        };
+
+        // the two axes of the grid from the closest neighbours in clearly different directions
+        const cv::Point2f origin = strongest[seed].Position;
+        cells[seed] = 0;
+        const int first = findNearest(strongest, cells, origin, std::numeric_limits<float>::max());
+        if (first < 0) {
+            break;
+        }
+        const cv::Point2f axisI = strongest[first].Position - origin;
+        int second = -1;
+        float secondDistance = std::numeric_limits<float>::max();
+        for (int i = 0; i < candidateCount; ++i) {
+            const cv::Point2f offset = strongest[i].Position - origin;
+            const float distance = offset.dot(offset);
+            if (i == seed || i == first || distance >= secondDistance) {
+                continue;
+            }
+            const float cosine = offset.dot(axisI) / std::sqrt(distance * axisI.dot(axisI));
+            if (std::abs(cosine) < 0.5f) {
+                second = i;
+                secondDistance = distance;
+            }
+        }
+        if (second < 0) {
+            continue;
+        }
+        const cv::Point2f axisJ = strongest[second].Position - origin;
+        cells[seed] = -1;
+        place(seed, 0, 0);
+        place(first, 1, 0);
+        place(second, 0, 1);
+
+        // grow the grid, predicting every neighbour from the step to the corner before
+        for (size_t next = 0; next < queue.size() && static_cast<int>(queue.size()) <= cornerCount; ++next) {
+            const int i = queue[next] % side - span;
+            const int j = queue[next] / side - span;
+            const cv::Point2f position = strongest[grid[queue[next]]].Position;
+            const int directions[4][2] = {{1, 0}, {-1, 0}, {0, 1}, {0, -1}};
+            for (const auto& direction : directions) {
+                const int di = direction[0];
+                const int dj = direction[1];
+                if (std::abs(i + di) > span || std::abs(j + dj) > span || grid[cellOf(i + di, j + dj)] >= 0) {
+                    continue;
+                }
+                cv::Point2f step = di != 0 ? axisI * static_cast<float>(di) : axisJ * static_cast<float>(dj);
+                const int behind = candidateAt(i - di, j - dj);
+                if (behind >= 0) {
+                    step = position - strongest[behind].Position;
+                } else {
+                    // the same step of a parallel row or column
+                    for (int sign = -1; sign <= 1; sign += 2) {
+                        const int from = candidateAt(i + dj * sign, j + di * sign);
+                        const int to = candidateAt(i + dj * sign + di, j + di * sign + dj);
+                        if (from >= 0 && to >= 0) {
+                            step = strongest[to].Position - strongest[from].Position;
+                            break;
+                        }
+                    }
+                }
+                const float radius = searchRadius * std::sqrt(step.dot(step));
+                const int found = findNearest(strongest, cells, position + step, radius);
+                if (found >= 0) {
+                    place(found, i + di, j + dj);
+                }
+            }
+        }
+        // a grid larger than the pattern grew into background corners
+        if (static_cast<int>(queue.size()) != cornerCount) {
+            continue;
+        }
+
+        int minI = span, maxI = -span, minJ = span, maxJ = -span;
+        for (int cell : queue) {
+            minI = std::min(minI, cell % side - span);
+            maxI = std::max(maxI, cell % side - span);
+            minJ = std::min(minJ, cell / side - span);
+            maxJ = std::max(maxJ, cell / side - span);
+        }
+        const int width = maxI - minI + 1;
+        const int height = maxJ - minJ + 1;
+        if (width * height != cornerCount) {
+            continue;
+        }
+        const bool transposed = width != patternSize.width;
+        if (transposed && (width != patternSize.height || height != patternSize.width)) {
+            continue;
+        }
+
+        // the board is seen from the front, so its x and y axes keep the
+        // handedness of the image axes. Mirror j if the grid grew the other way.
+        auto positionAt = [&](int i, int j) { return strongest[grid[cellOf(i, j)]].Position; };
+        const cv::Point2f alongI = positionAt(maxI, minJ) - positionAt(minI, minJ);
+        const cv::Point2f alongJ = positionAt(minI, maxJ) - positionAt(minI, minJ);
+        const bool mirrored = alongI.x * alongJ.y - alongI.y * alongJ.x < 0.0f;
+        auto cellAt = [&](int i, int j) { return positionAt(i, mirrored ? minJ + maxJ - j : j); };
+
+        // of the rotations matching the pattern size, start closest to the top left of the image
+        points.resize(cornerCount);
+        float bestStart = std::numeric_limits<float>::max();
+        for (int rotation = 0; rotation < 4; ++rotation) {
+            // rotations by a quarter turn swap the sides of the grid
+            if ((rotation % 2 == 1) != transposed) {
+                continue;
+            }
+            auto rotated = [&](int column, int row) {
+                switch (rotation) {
+                case 0:
+                    return cellAt(minI + column, minJ + row);
+                case 1:
+                    return cellAt(minI + row, maxJ - column);
+                case 2:
+                    return cellAt(maxI - column, maxJ - row);
+                default:
+                    return cellAt(maxI - row, minJ + column);
+                }
+            };
+            const cv::Point2f start = rotated(0, 0);
+            if (start.x + start.y >= bestStart) {
+                continue;
+            }
+            bestStart = start.x + start.y;
+            for (int row = 0; row < patternSize.height; ++row) {
+                for (int column = 0; column < patternSize.width; ++column) {
+                    points[column + row * patternSize.width] = rotated(column, row);
+                }
+            }
+        }
+        return true;
+    }
+    return false;
+}
+
+bool SaddlePointDetector::find(const cv::Mat& gray, std::vector<cv::Point2f>& points) const
+{
+    // buffers of the tracker threads are reused between frames
+    thread_local cv::Mat response;
+    thread_local std::vector<Corner> candidates;
+    computeResponse(gray, response);
+    findCandidates(response, candidates);
+    if (!assembleGrid(candidates, getPatternSize(), points)) {
+        return false;
+    }
+
+    // the refinement window has to stay inside the squares around a corner
+    float step = std::numeric_limits<float>::max();
+    for (int row = 0; row < getPatternSize().height; ++row) {
+        for (int column = 1; column < getPatternSize().width; ++column) {
+            const cv::Point2f offset = points[column + row * getPatternSize().width] - points[column - 1 + row * getPatternSize().width];
+            step = std::min(step, std::sqrt(offset.dot(offset)));
+        }
+    }
+    const int halfWindow = std::clamp(static_cast<int>(step / 4.0f), 2, 5);
+    cv::cornerSubPix(gray, points, cv::Size(halfWindow, halfWindow), cv::Size(-1, -1),
+                     cv::TermCriteria(cv::TermCriteria::EPS + cv::TermCriteria::COUNT, 20, 0.01));
+    return true;
+}
+
+void SaddlePointDetector::refine(const cv::Mat& gray, int halfWindow, std::vector<cv::Point2f>& points) const
+{
+    cv::cornerSubPix(gray, points, cv::Size(halfWindow, halfWindow), cv::Size(-1, -1),
+                     cv::TermCriteria(cv::TermCriteria::EPS + cv::TermCriteria::COUNT, 30, 0.01));
+}
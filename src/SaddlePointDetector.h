@@ -0,0 +1,40 @@
+#pragma once
+
+#include <vector>
+
+#include <opencv2/core/mat.hpp>
+
+#include "PatternDetector.h"
+
+/// Chessboard detector written for a known pattern size instead of the
+/// general purpose OpenCV one. Every pixel gets a saddle point (X-corner)
+/// response from a ring of 16 samples, computed with SSE2/AVX2/NEON where
+/// available and split over all cores in stripes. Local maxima are kept per
+/// tile with a threshold relative to the strongest response of the tile, and
+/// the grid is grown from the strongest corners by predicting the position of
+/// the next corner from its neighbours until exactly the pattern size is found.
+class SaddlePointDetector final : public PatternDetector
+{
+public:
+    explicit SaddlePointDetector(const cv::Size& patternSize);
+
+    /// Saddle point candidate
+    struct Corner {
+        cv::Point2f Position;
+        int Response;
+    };
+
+    /// Saddle response of every pixel of gray into response (CV_16S), 0 at
+    /// the border and wherever the pixel is no X-corner
+    static void computeResponse(const cv::Mat& gray, cv::Mat& response);
+    /// Local maxima of response above the threshold of their tile, with
+    /// sub-pixel positions, ordered by tile
+    static void findCandidates(const cv::Mat& response, std::vector<Corner>& corners);
+    /// Order the candidates into a grid of patternSize, row by row like
+    /// cv::findChessboardCorners. Returns false if no complete grid is found.
+    static bool assembleGrid(const std::vector<Corner>& candidates, const cv::Size& patternSize, std::vector<cv::Point2f>& points);
+
+protected:
+    bool find(const cv::Mat& gray, std::vector<cv::Point2f>& points) const override;
+    void refine(const cv::Mat& gray, int halfWindow, std::vector<cv::Point2f>& points) const override;
+};
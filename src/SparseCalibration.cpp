@@ -0,0 +1,489 @@
+#include "SparseCalibration.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <numeric>
+
+#include <opencv2/calib3d.hpp>
+#include <opencv2/core.hpp>
+
+namespace
+{
+/// Columns of the cv::projectPoints Jacobian: rotation, translation, fx, fy, cx, cy and distortion
+constexpr int jacobianColumns = 6 + SparseCalibration::IntrinsicCount;
+/// Index of k1 in the intrinsics
+constexpr int distortionOffset = SparseCalibration::IntrinsicCount - SparseCalibration::DistortionCount;
+/// Points a view needs for a homography
+constexpr size_t minViewPoints = 4;
+
+constexpr double initialDamping = 1e-3;
+constexpr double minDamping = 1e-12;
+/// Damping at which a step is given up, the error no longer decreases
+constexpr double maxDamping = 1e12;
+/// Lower bound of a damped diagonal entry, keeps parameters the views do not constrain solvable
+constexpr double minDiagonal = 1e-9;
+/// Relative decrease of the squared error below which a step counts as converged
+constexpr double convergedImprovement = 1e-10;
+/// RMS error in pixels of a given starting pose above which it is solved
+/// again, it then belongs to other views or very different intrinsics
+constexpr double maxSeedError = 4.0;
+
+cv::Matx33d toCameraMatrix(const cv::Vec<double, SparseCalibration::IntrinsicCount>& intrinsics)
+{
+    return cv::Matx33d(intrinsics[0], 0.0, intrinsics[2], 0.0, intrinsics[1], intrinsics[3], 0.0, 0.0, 1.0);
+}
+
+cv::Mat toDistortion(const cv::Vec<double, SparseCalibration::IntrinsicCount>& intrinsics)
+{
+    cv::Mat distortion(SparseCalibration::DistortionCount, 1, CV_64F);
+    for (int i = 0; i < SparseCalibration::DistortionCount; ++i) {
+        distortion.at<double>(i) = intrinsics[distortionOffset + i];
+    }
+    return distortion;
+}
+
+/// Row v_ij of Zhang's constraints on the image of the absolute conic,
+/// h_i^T B h_j = v_ij^T b with b = (B11, B12, B22, B13, B23, B33)
+cv::Vec6d conicRow(const cv::Matx33d& h, int i, int j)
+{
+    return cv::Vec6d(h(0, i) * h(0, j), h(0, i) * h(1, j) + h(1, i) * h(0, j), h(1, i) * h(1, j), h(2, i) * h(0, j) + h(0, i) * h(2, j),
+                     h(2, i) * h(1, j) + h(1, i) * h(2, j), h(2, i) * h(2, j));
+}
+
+/// Board pose from its homography, [r1 r2 t] is K^-1 H up to scale
+void decomposeHomography(const cv::Matx33d& inverseCameraMatrix, const cv::Matx33d& homography, cv::Vec3d& rotation, cv::Vec3d& translation)
+{
+    const cv::Matx33d m = inverseCameraMatrix * homography;
+    cv::Vec3d r1(m(0, 0), m(1, 0), m(2, 0));
+    cv::Vec3d r2(m(0, 1), m(1, 1), m(2, 1));
+    translation = cv::Vec3d(m(0, 2), m(1, 2), m(2, 2));
+    double scale = 2.0 / (cv::norm(r1) + cv::norm(r2));
+    // the board is in front of the camera
+    if (translation[2] < 0.0) {
+        scale = -scale;
+    }
+    r1 *= scale;
+    r2 *= scale;
+    translation *= scale;
+    const cv::Vec3d r3 = r1.cross(r2);
+    const cv::Matx33d approximation(r1[0], r2[0], r3[0], r1[1], r2[1], r3[1], r1[2], r2[2], r3[2]);
+    // closest rotation, noise keeps r1 and r2 from being orthonormal
+    cv::Matx33d u;
+    cv::Matx33d vt;
+    cv::Vec3d singularValues;
+    cv::SVD::compute(approximation, singularValues, u, vt);
+    cv::Rodrigues(u * vt, rotation);
+}
+} // namespace
+
+SparseCalibration::SparseCalibration(const std::vector<std::vector<cv::Vec3f>>& objectPoints, const std::vector<std::vector<cv::Point2f>>& imagePoints,
+                                     const cv::Size& resolution)
+    : imagePoints_(imagePoints)
+    , resolution_(resolution)
+    , pointCount_(0)
+    , intrinsics_()
+    , poses_(imagePoints.size())
+    , blocks_(imagePoints.size())
+    , viewErrors_(imagePoints.size(), 0.0)
+    , candidateIntrinsics_()
+    , candidatePoses_(imagePoints.size())
+    , damping_(initialDamping)
+    , squaredError_(0.0)
+    , error_(0.0)
+    , converged_(false)
+{
+    // projectPoints returns points in the precision of the board points
+    objectPoints_.resize(objectPoints.size());
+    for (size_t i = 0; i < objectPoints.size(); ++i) {
+        objectPoints_[i].reserve(objectPoints[i].size());
+        for (const auto& point : objectPoints[i]) {
+            objectPoints_[i].emplace_back(point[0], point[1], point[2]);
+        }
+    }
+    for (const auto& points : imagePoints) {
+        pointCount_ += points.size();
+    }
+}
+
+bool SparseCalibration::checkViews() const
+{
+    if (imagePoints_.empty() || objectPoints_.size() != imagePoints_.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < imagePoints_.size(); ++i) {
+        if (imagePoints_[i].size() < minViewPoints || objectPoints_[i].size() != imagePoints_[i].size()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool SparseCalibration::initialize()
+{
+    if (!checkViews()) {
+        return false;
+    }
+    const int viewCount = static_cast<int>(imagePoints_.size());
+    // homographies into image coordinates centered and scaled to about
+    // [-0.5, 0.5], in pixels the constraints differ by orders of magnitude
+    const double scale = std::max(resolution_.width, resolution_.height);
+    const cv::Point2d center(0.5 * (resolution_.width - 1), 0.5 * (resolution_.height - 1));
+    std::vector<cv::Matx33d> homographies(viewCount);
+    std::vector<uint8_t> found(viewCount, 0);
+    cv::parallel_for_(cv::Range(0, viewCount), [this, scale, &center, &homographies, &found](const cv::Range& range) {
+        std::vector<cv::Point2d> board;
+        std::vector<cv::Point2d> image;
+        for (int i = range.start; i < range.end; ++i) {
+            board.clear();
+            image.clear();
+            for (const auto& point : objectPoints_[i]) {
+                board.emplace_back(point.x, point.y);
+            }
+            for (const auto& point : imagePoints_[i]) {
+                image.emplace_back((point.x - center.x) / scale, (point.y - center.y) / scale);
+            }
+            const cv::Mat homography = cv::findHomography(board, image);
+            if (!homography.empty()) {
+                homographies[i] = cv::Matx33d(homography);
+                found[i] = 1;
+            }
+        }
+    });
+    const int homographyCount = std::accumulate(found.begin(), found.end(), 0);
+
+    double fx = 0.0;
+    double fy = 0.0;
+    double cx = 0.0;
+    double cy = 0.0;
+    bool solved = false;
+    // Zhang: r1 and r2 are orthogonal and of equal length, two constraints on
+    // B = K^-T K^-1 per view. With zero skew three views determine it.
+    if (homographyCount >= 3) {
+        cv::Mat_<double> constraints(2 * homographyCount, 6);
+        int row = 0;
+        for (int i = 0; i < viewCount; ++i) {
+            if (found[i]) {
+                const cv::Vec6d orthogonal = conicRow(homographies[i], 0, 1);
+                const cv::Vec6d equalLength = conicRow(homographies[i], 0, 0) - conicRow(homographies[i], 1, 1);
+                std::copy(orthogonal.val, orthogonal.val + 6, constraints.ptr<double>(row++));
+                std::copy(equalLength.val, equalLength.val + 6, constraints.ptr<double>(row++));
+            }
+        }
+        cv::Mat_<double> b;
+        cv::SVD::solveZ(constraints, b);
+        const double b11 = b(0);
+        const double b12 = b(1);
+        const double b22 = b(2);
+        const double b13 = b(3);
+        const double b23 = b(4);
+        const double b33 = b(5);
+        const double determinant = b11 * b22 - b12 * b12;
+        // B must be definite, b is only known up to sign
+        if (b11 != 0.0 && determinant > 0.0) {
+            cy = (b12 * b13 - b11 * b23) / determinant;
+            const double lambda = b33 - (b13 * b13 + cy * (b12 * b13 - b11 * b23)) / b11;
+            if (lambda / b11 > 0.0) {
+                fx = std::sqrt(lambda / b11);
+                fy = std::sqrt(lambda * b11 / determinant);
+                cx = -b13 * fx * fx / lambda;
+                solved = std::abs(cx) < 0.5 && std::abs(cy) < 0.5;
+            }
+        }
+    }
+    // too few or too similar views: principal point at the image center and
+    // only the focal lengths from the same constraints, like cv::initCameraMatrix2D
+    if (!solved && homographyCount > 0) {
+        cv::Mat_<double> constraints(2 * homographyCount, 2);
+        cv::Mat_<double> values(2 * homographyCount, 1);
+        int row = 0;
+        for (int i = 0; i < viewCount; ++i) {
+            if (found[i]) {
+                const cv::Matx33d& h = homographies[i];
+                constraints(row, 0) = h(0, 0) * h(0, 1);
+                constraints(row, 1) = h(1, 0) * h(1, 1);
+                values(row++) = -h(2, 0) * h(2, 1);
+                constraints(row, 0) = h(0, 0) * h(0, 0) - h(0, 1) * h(0, 1);
+                constraints(row, 1) = h(1, 0) * h(1, 0) - h(1, 1) * h(1, 1);
+                values(row++) = h(2, 1) * h(2, 1) - h(2, 0) * h(2, 0);
+            }
+        }
+        cv::Mat_<double> inverseSquaredFocal;
+        if (cv::solve(constraints, values, inverseSquaredFocal, cv::DECOMP_SVD) && inverseSquaredFocal(0) > 0.0 && inverseSquaredFocal(1) > 0.0) {
+            fx = 1.0 / std::sqrt(inverseSquaredFocal(0));
+            fy = 1.0 / std::sqrt(inverseSquaredFocal(1));
+            cx = 0.0;
+            cy = 0.0;
+            solved = true;
+        }
+    }
+    if (!solved) {
+        std::fprintf(stderr, "Calibration views do not constrain the focal length\n");
+        return false;
+    }
+
+    intrinsics_ = IntrinsicVector::all(0.0);
+    intrinsics_[0] = fx * scale;
+    intrinsics_[1] = fy * scale;
+    intrinsics_[2] = cx * scale + center.x;
+    intrinsics_[3] = cy * scale + center.y;
+    const cv::Matx33d inverseCameraMatrix = cv::Matx33d(fx, 0.0, cx, 0.0, fy, cy, 0.0, 0.0, 1.0).inv();
+    std::atomic<bool> posed(true);
+    cv::parallel_for_(cv::Range(0, viewCount), [this, &inverseCameraMatrix, &homographies, &found, &posed](const cv::Range& range) {
+        for (int i = range.start; i < range.end; ++i) {
+            if (found[i]) {
+                cv::Vec3d rotation;
+                cv::Vec3d translation;
+                decomposeHomography(inverseCameraMatrix, homographies[i], rotation, translation);
+                poses_[i] = PoseVector(rotation[0], rotation[1], rotation[2], translation[0], translation[1], translation[2]);
+            } else if (!solvePose(i, poses_[i])) {
+                posed = false;
+            }
+        }
+    });
+    if (!posed) {
+        std::fprintf(stderr, "Calibration views could not be posed\n");
+        return false;
+    }
+    damping_ = initialDamping;
+    converged_ = false;
+    squaredError_ = cost(intrinsics_, poses_);
+    error_ = std::sqrt(squaredError_ / pointCount_);
+    return true;
+}
+
+bool SparseCalibration::initialize(const cv::Matx33d& cameraMatrix, const cv::Mat& distortion, const cv::Mat& rotations, const cv::Mat& translations)
+{
+    if (!checkViews()) {
+        return false;
+    }
+    intrinsics_ = IntrinsicVector::all(0.0);
+    intrinsics_[0] = cameraMatrix(0, 0);
+    intrinsics_[1] = cameraMatrix(1, 1);
+    intrinsics_[2] = cameraMatrix(0, 2);
+    intrinsics_[3] = cameraMatrix(1, 2);
+    // higher order coefficients of a richer model are dropped
+    cv::Mat coefficients;
+    distortion.convertTo(coefficients, CV_64F);
+    for (int i = 0; i < std::min(static_cast<int>(coefficients.total()), DistortionCount); ++i) {
+        intrinsics_[distortionOffset + i] = coefficients.ptr<double>()[i];
+    }
+    const int seedCount = std::min({rotations.rows, translations.rows, static_cast<int>(imagePoints_.size())});
+    for (int i = 0; i < seedCount; ++i) {
+        const cv::Vec3d rotation = rotations.at<cv::Vec3d>(i);
+        const cv::Vec3d translation = translations.at<cv::Vec3d>(i);
+        poses_[i] = PoseVector(rotation[0], rotation[1], rotation[2], translation[0], translation[1], translation[2]);
+    }
+    if (seedCount > 0) {
+        // fills viewErrors_, the views without a pose yet are solved anyway
+        cost(intrinsics_, poses_);
+    }
+    std::atomic<bool> posed(true);
+    cv::parallel_for_(cv::Range(0, static_cast<int>(imagePoints_.size())), [this, seedCount, &posed](const cv::Range& range) {
+        for (int i = range.start; i < range.end; ++i) {
+            // the comparison also rejects NaN from a pose behind the camera
+            if (i < seedCount && viewErrors_[i] <= maxSeedError * maxSeedError * imagePoints_[i].size()) {
+                continue;
+            }
+            if (!solvePose(i, poses_[i])) {
+                posed = false;
+            }
+        }
+    });
+    if (!posed) {
+        std::fprintf(stderr, "Calibration views could not be posed\n");
+        return false;
+    }
+    damping_ = initialDamping;
+    converged_ = false;
+    squaredError_ = cost(intrinsics_, poses_);
+    error_ = std::sqrt(squaredError_ / pointCount_);
+    return true;
+}
+
+double SparseCalibration::iterate(uint32_t iterations)
+{
+    for (uint32_t iteration = 0; iteration < iterations && !converged_; ++iteration) {
+        squaredError_ = linearize();
+        // raise the damping until a step decreases the error
+        bool improved = false;
+        while (damping_ < maxDamping) {
+            if (solveStep(candidateIntrinsics_, candidatePoses_) && candidateIntrinsics_[0] > 0.0 && candidateIntrinsics_[1] > 0.0) {
+                const double candidateError = cost(candidateIntrinsics_, candidatePoses_);
+                if (candidateError < squaredError_) {
+                    converged_ = squaredError_ - candidateError < convergedImprovement * squaredError_;
+                    squaredError_ = candidateError;
+                    intrinsics_ = candidateIntrinsics_;
+                    std::swap(poses_, candidatePoses_);
+                    damping_ = std::max(damping_ * 0.1, minDamping);
+                    improved = true;
+                    break;
+                }
+            }
+            damping_ *= 10.0;
+        }
+        if (!improved) {
+            converged_ = true;
+        }
+    }
+    error_ = std::sqrt(squaredError_ / pointCount_);
+    return error_;
+}
+
+double SparseCalibration::linearize()
+{
+    const cv::Matx33d cameraMatrix = toCameraMatrix(intrinsics_);
+    const cv::Mat distortion = toDistortion(intrinsics_);
+    cv::parallel_for_(cv::Range(0, static_cast<int>(imagePoints_.size())), [this, &cameraMatrix, &distortion](const cv::Range& range) {
+        std::vector<cv::Point2d> projected;
+        cv::Mat jacobian;
+        for (int i = range.start; i < range.end; ++i) {
+            const PoseVector& pose = poses_[i];
+            cv::projectPoints(objectPoints_[i], cv::Vec3d(pose[0], pose[1], pose[2]), cv::Vec3d(pose[3], pose[4], pose[5]), cameraMatrix, distortion,
+                              projected, jacobian);
+            // J^T J and J^T r of the view, upper triangle only
+            cv::Matx<double, jacobianColumns, jacobianColumns> normal = cv::Matx<double, jacobianColumns, jacobianColumns>::zeros();
+            cv::Vec<double, jacobianColumns> gradient = cv::Vec<double, jacobianColumns>::all(0.0);
+            double squaredError = 0.0;
+            for (size_t j = 0; j < projected.size(); ++j) {
+                const double residuals[2] = {projected[j].x - imagePoints_[i][j].x, projected[j].y - imagePoints_[i][j].y};
+                for (int axis = 0; axis < 2; ++axis) {
+                    const double* row = jacobian.ptr<double>(static_cast<int>(2 * j) + axis);
+                    for (int r = 0; r < jacobianColumns; ++r) {
+                        gradient[r] += row[r] * residuals[axis];
+                        for (int c = r; c < jacobianColumns; ++c) {
+                            normal(r, c) += row[r] * row[c];
+                        }
+                    }
+                    squaredError += residuals[axis] * residuals[axis];
+                }
+            }
+            // pose columns come first in the Jacobian, the intrinsics after
+            ViewBlock& block = blocks_[i];
+            for (int r = 0; r < jacobianColumns; ++r) {
+                for (int c = 0; c < jacobianColumns; ++c) {
+                    const double value = r <= c ? normal(r, c) : normal(c, r);
+                    if (r < 6 && c < 6) {
+                        block.V(r, c) = value;
+                    } else if (r >= 6 && c >= 6) {
+                        block.U(r - 6, c - 6) = value;
+                    } else if (r >= 6) {
+                        block.W(r - 6, c) = value;
+                    }
+                }
+            }
+            for (int k = 0; k < 6; ++k) {
+                block.PoseGradient[k] = gradient[k];
+            }
+            for (int k = 0; k < IntrinsicCount; ++k) {
+                block.IntrinsicGradient[k] = gradient[6 + k];
+            }
+            viewErrors_[i] = squaredError;
+        }
+    });
+    return std::accumulate(viewErrors_.begin(), viewErrors_.end(), 0.0);
+}
+
+bool SparseCalibration::solveStep(IntrinsicVector& intrinsics, std::vector<PoseVector>& poses)
+{
+    const int viewCount = static_cast<int>(imagePoints_.size());
+    // invert the damped pose block of every view
+    cv::parallel_for_(cv::Range(0, viewCount), [this](const cv::Range& range) {
+        for (int i = range.start; i < range.end; ++i) {
+            ViewBlock& block = blocks_[i];
+            cv::Matx<double, 6, 6> damped = block.V;
+            for (int k = 0; k < 6; ++k) {
+                damped(k, k) += damping_ * std::max(block.V(k, k), minDiagonal);
+            }
+            block.Solvable = false;
+            block.InverseV = damped.inv(cv::DECOMP_CHOLESKY, &block.Solvable);
+            block.WInverseV = block.W * block.InverseV;
+        }
+    });
+
+    // Schur complement S = U - sum W V^-1 W^T with right side -g_a + sum W V^-1 g_b
+    cv::Matx<double, IntrinsicCount, IntrinsicCount> intrinsicBlock = cv::Matx<double, IntrinsicCount, IntrinsicCount>::zeros();
+    cv::Matx<double, IntrinsicCount, IntrinsicCount> schur = cv::Matx<double, IntrinsicCount, IntrinsicCount>::zeros();
+    IntrinsicVector rightSide = IntrinsicVector::all(0.0);
+    for (const auto& block : blocks_) {
+        if (!block.Solvable) {
+            return false;
+        }
+        intrinsicBlock += block.U;
+        schur -= block.WInverseV * block.W.t();
+        rightSide += block.WInverseV * block.PoseGradient - block.IntrinsicGradient;
+    }
+    for (int k = 0; k < IntrinsicCount; ++k) {
+        intrinsicBlock(k, k) += damping_ * std::max(intrinsicBlock(k, k), minDiagonal);
+    }
+    schur += intrinsicBlock;
+    cv::Vec<double, IntrinsicCount> intrinsicStep;
+    if (!cv::solve(schur, rightSide, intrinsicStep, cv::DECOMP_CHOLESKY)) {
+        return false;
+    }
+    intrinsics = intrinsics_ + intrinsicStep;
+
+    // back substitute the pose of every view
+    cv::parallel_for_(cv::Range(0, viewCount), [this, &intrinsicStep, &poses](const cv::Range& range) {
+        for (int i = range.start; i < range.end; ++i) {
+            const ViewBlock& block = blocks_[i];
+            poses[i] = poses_[i] - block.InverseV * (block.PoseGradient + block.W.t() * intrinsicStep);
+        }
+    });
+    return true;
+}
+
+double SparseCalibration::cost(const IntrinsicVector& intrinsics, const std::vector<PoseVector>& poses)
+{
+    const cv::Matx33d cameraMatrix = toCameraMatrix(intrinsics);
+    const cv::Mat distortion = toDistortion(intrinsics);
+    cv::parallel_for_(cv::Range(0, static_cast<int>(imagePoints_.size())), [this, &poses, &cameraMatrix, &distortion](const cv::Range& range) {
+        std::vector<cv::Point2d> projected;
+        for (int i = range.start; i < range.end; ++i) {
+            const PoseVector& pose = poses[i];
+            cv::projectPoints(objectPoints_[i], cv::Vec3d(pose[0], pose[1], pose[2]), cv::Vec3d(pose[3], pose[4], pose[5]), cameraMatrix, distortion,
+                              projected);
+            double squaredError = 0.0;
+            for (size_t j = 0; j < projected.size(); ++j) {
+                const double dx = projected[j].x - imagePoints_[i][j].x;
+                const double dy = projected[j].y - imagePoints_[i][j].y;
+                squaredError += dx * dx + dy * dy;
+            }
+            viewErrors_[i] = squaredError;
+        }
+    });
+    return std::accumulate(viewErrors_.begin(), viewErrors_.end(), 0.0);
+}
+
+bool SparseCalibration::solvePose(size_t view, PoseVector& pose) const
+{
+    cv::Vec3d rotation;
+    cv::Vec3d translation;
+    if (!cv::solvePnP(objectPoints_[view], imagePoints_[view], toCameraMatrix(intrinsics_), toDistortion(intrinsics_), rotation, translation)) {
+        return false;
+    }
+    pose = PoseVector(rotation[0], rotation[1], rotation[2], translation[0], translation[1], translation[2]);
+    return true;
+}
+
+cv::Matx33d SparseCalibration::getCameraMatrix() const
+{
+    return toCameraMatrix(intrinsics_);
+}
+
+cv::Mat SparseCalibration::getDistortion() const
+{
+    return toDistortion(intrinsics_);
+}
+
+void SparseCalibration::getPoses(cv::Mat& rotations, cv::Mat& translations) const
+{
+    rotations.create(static_cast<int>(poses_.size()), 1, CV_64FC3);
+    translations.create(static_cast<int>(poses_.size()), 1, CV_64FC3);
+    for (size_t i = 0; i < poses_.size(); ++i) {
+        const PoseVector& pose = poses_[i];
+        rotations.at<cv::Vec3d>(static_cast<int>(i)) = cv::Vec3d(pose[0], pose[1], pose[2]);
+        translations.at<cv::Vec3d>(static_cast<int>(i)) = cv::Vec3d(pose[3], pose[4], pose[5]);
+    }
+}
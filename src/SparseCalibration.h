@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <opencv2/core/mat.hpp>
+#include <opencv2/core/matx.hpp>
+
+/// Camera calibration which scales linearly with the number of views, unlike
+/// cv::calibrateCamera which solves the dense normal equations of all views.
+/// The intrinsics (fx, fy, cx, cy, k1, k2, p1, p2, k3) start from Zhang's
+/// closed form solution and are refined together with the pose of every view
+/// by Levenberg-Marquardt. Only the intrinsics couple the views, so each step
+/// eliminates the 6x6 pose blocks into a 9x9 Schur complement over the
+/// intrinsics and solves the poses per view afterwards. Jacobians and blocks
+/// are computed for the views in parallel.
+class SparseCalibration
+{
+public:
+    /// fx, fy, cx, cy and the distortion coefficients
+    static constexpr int IntrinsicCount = 9;
+    /// k1, k2, p1, p2, k3 like the default model of cv::calibrateCamera
+    static constexpr int DistortionCount = 5;
+
+    /// The board points are copied in double precision, the image points are
+    /// referenced and must outlive the solver
+    SparseCalibration(const std::vector<std::vector<cv::Vec3f>>& objectPoints, const std::vector<std::vector<cv::Point2f>>& imagePoints,
+                      const cv::Size& resolution);
+
+    /// Intrinsics without distortion from Zhang's closed form over the board
+    /// homographies of all views, poses from decomposing the homographies.
+    /// Returns false if the views do not constrain the camera.
+    bool initialize();
+    /// Start from known intrinsics. The first views start from the poses in
+    /// the rows of rotations and translations (CV_64FC3) if given, like the
+    /// ones of the previous calibration, the others are posed by solvePnP. A
+    /// given pose which does not fit its view is solved again.
+    bool initialize(const cv::Matx33d& cameraMatrix, const cv::Mat& distortion, const cv::Mat& rotations = cv::Mat(),
+                    const cv::Mat& translations = cv::Mat());
+    /// Run up to iterations Levenberg-Marquardt steps, fewer once converged.
+    /// Returns the RMS reprojection error in pixels.
+    double iterate(uint32_t iterations);
+
+    cv::Matx33d getCameraMatrix() const;
+    /// DistortionCount coefficients as CV_64F column
+    cv::Mat getDistortion() const;
+    /// Board pose of every view as rows of CV_64FC3
+    void getPoses(cv::Mat& rotations, cv::Mat& translations) const;
+    inline double getError() const { return error_; };
+    /// Whether the last step did not reduce the error any more
+    inline bool hasConverged() const { return converged_; };
+
+private:
+    using IntrinsicVector = cv::Vec<double, IntrinsicCount>;
+    /// Rotation vector followed by translation
+    using PoseVector = cv::Vec<double, 6>;
+
+    /// Normal equations of one view, U and W couple it to the intrinsics
+    struct ViewBlock {
+        cv::Matx<double, IntrinsicCount, IntrinsicCount> U;
+        cv::Matx<double, IntrinsicCount, 6> W;
+        cv::Matx<double, 6, 6> V;
+        IntrinsicVector IntrinsicGradient;
+        PoseVector PoseGradient;
+        /// W * inverse of the damped V, kept to solve the pose after the intrinsics
+        cv::Matx<double, IntrinsicCount, 6> WInverseV;
+        cv::Matx<double, 6, 6> InverseV;
+        bool Solvable;
+    };
+
+    /// Fill the blocks at the current parameters, returns the squared error
+    double linearize();
+    /// Solve the damped normal equations for the next parameters, false if singular
+    bool solveStep(IntrinsicVector& intrinsics, std::vector<PoseVector>& poses);
+    /// Sum of squared reprojection errors at the given parameters
+    double cost(const IntrinsicVector& intrinsics, const std::vector<PoseVector>& poses);
+    /// Pose of a view by cv::solvePnP at the current intrinsics
+    bool solvePose(size_t view, PoseVector& pose) const;
+    /// Whether every view has as many image as board points, and enough of them
+    bool checkViews() const;
+
+    std::vector<std::vector<cv::Point3d>> objectPoints_;
+    const std::vector<std::vector<cv::Point2f>>& imagePoints_;
+    const cv::Size resolution_;
+    size_t pointCount_;
+
+    IntrinsicVector intrinsics_;
+    std::vector<PoseVector> poses_;
+    std::vector<ViewBlock> blocks_;
+    /// Squared error of every view, summed in order so results do not depend on threading
+    std::vector<double> viewErrors_;
+    IntrinsicVector candidateIntrinsics_;
+    std::vector<PoseVector> candidatePoses_;
+    /// Levenberg-Marquardt damping relative to the diagonal
+    double damping_;
+    double squaredError_;
+    double error_;
+    bool converged_;
+};
@@ -0,0 +1,265 @@
+#include "SyntheticBoard.h"
+
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+
+#include <opencv2/calib3d.hpp>
+#include <opencv2/core/persistence.hpp>
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+
+namespace
+{
+/// Pixels per square of the board texture
+constexpr int texturePixelsPerSquare = 64;
+/// Boards are rendered at this multiple of the camera resolution and averaged down
+constexpr int supersampling = 2;
+/// Gray level around the board
+constexpr double backgroundGray = 128.0;
+/// Pixels kept free between the board border and the image border
+constexpr double viewMargin = 8.0;
+
+/// Squares around the inner corners with a white border of one square
+cv::Mat makeTexture(const cv::Size& patternSize)
+{
+    const int squares = texturePixelsPerSquare;
+    cv::Mat texture((patternSize.height + 3) * squares, (patternSize.width + 3) * squares, CV_8U, cv::Scalar(255));
+    for (int y = 0; y <= patternSize.height; ++y) {
+        for (int x = 0; x <= patternSize.width; ++x) {
+            if ((x + y) % 2 == 0) {
+                texture(cv::Rect((x + 1) * squares, (y + 1) * squares, squares, squares)).setTo(0);
+            }
+        }
+    }
+    return texture;
+}
+
+/// Maps supersampled image coordinates to camera image coordinates, pixel
+/// centers stay at integer coordinates in both
+cv::Matx33d upscale()
+{
+    const double offset = 0.5 * (supersampling - 1);
+    return cv::Matx33d(supersampling, 0.0, offset, 0.0, supersampling, offset, 0.0, 0.0, 1.0);
+}
+
+/// Where every pixel of the supersampled distorted image lies in the
+/// supersampled undistorted one
+void makeDistortionMaps(const SyntheticBoard::CameraModel& camera, cv::Mat& mapX, cv::Mat& mapY)
+{
+    const cv::Size size(camera.Resolution.width * supersampling, camera.Resolution.height * supersampling);
+    const double offset = 0.5 * (supersampling - 1);
+    std::vector<cv::Point2f> distorted;
+    distorted.reserve(size.area());
+    for (int y = 0; y < size.height; ++y) {
+        for (int x = 0; x < size.width; ++x) {
+            distorted.emplace_back(static_cast<float>((x - offset) / supersampling), static_cast<float>((y - offset) / supersampling));
+        }
+    }
+    std::vector<cv::Point2f> undistorted;
+    cv::undistortPoints(distorted, undistorted, camera.CameraMatrix, camera.DistortionCoefficients, cv::noArray(), camera.CameraMatrix,
+                        cv::TermCriteria(cv::TermCriteria::COUNT + cv::TermCriteria::EPS, 20, 1e-6));
+    mapX.create(size, CV_32F);
+    mapY.create(size, CV_32F);
+    for (int y = 0; y < size.height; ++y) {
+        float* rowX = mapX.ptr<float>(y);
+        float* rowY = mapY.ptr<float>(y);
+        for (int x = 0; x < size.width; ++x) {
+            const auto& point = undistorted[static_cast<size_t>(y) * size.width + x];
+            rowX[x] = static_cast<float>(point.x * supersampling + offset);
+            rowY[x] = static_cast<float>(point.y * supersampling + offset);
+        }
+    }
+}
+
+void renderView(const SyntheticBoard::CameraModel& camera, const cv::Mat& texture, double squareSide, const SyntheticBoard::View& view, double noise,
+                double blur, const cv::Mat& mapX, const cv::Mat& mapY, cv::RNG& rng, cv::Mat& image)
+{
+    // texture pixel centers are at integer coordinates, the first inner corner is at board origin
+    const double texel = squareSide / texturePixelsPerSquare;
+    const double textureOrigin = (0.5 / texturePixelsPerSquare - 2.0) * squareSide;
+    const cv::Matx33d textureToBoard(texel, 0.0, textureOrigin, 0.0, texel, textureOrigin, 0.0, 0.0, 1.0);
+    cv::Matx33d rotation;
+    cv::Rodrigues(view.Rotation, rotation);
+    const cv::Matx33d boardToCamera(rotation(0, 0), rotation(0, 1), view.Translation[0], rotation(1, 0), rotation(1, 1), view.Translation[1],
+                                    rotation(2, 0), rotation(2, 1), view.Translation[2]);
+    const cv::Matx33d homography = upscale() * camera.CameraMatrix * boardToCamera * textureToBoard;
+
+    cv::Mat undistorted;
+    cv::warpPerspective(texture, undistorted, cv::Mat(homography), mapX.size(), cv::INTER_LINEAR, cv::BORDER_CONSTANT, cv::Scalar(backgroundGray));
+    cv::Mat distorted;
+    cv::remap(undistorted, distorted, mapX, mapY, cv::INTER_LINEAR, cv::BORDER_CONSTANT, cv::Scalar(backgroundGray));
+    cv::Mat gray;
+    cv::resize(distorted, gray, camera.Resolution, 0.0, 0.0, cv::INTER_AREA);
+    if (blur > 0.0) {
+        cv::GaussianBlur(gray, gray, cv::Size(), blur);
+    }
+    if (noise > 0.0) {
+        cv::Mat noisy;
+        gray.convertTo(noisy, CV_32F);
+        cv::Mat noiseImage(gray.size(), CV_32F);
+        rng.fill(noiseImage, cv::RNG::NORMAL, 0.0, noise);
+        noisy += noiseImage;
+        noisy.convertTo(gray, CV_8U);
+    }
+    cv::cvtColor(gray, image, cv::COLOR_GRAY2BGR);
+}
+
+/// Outer corners of the white border of the board in board coordinates
+std::vector<cv::Point3d> boardOutline(const cv::Size& patternSize, double squareSide)
+{
+    const double left = -2.0 * squareSide;
+    const double top = -2.0 * squareSide;
+    const double right = (patternSize.width + 1) * squareSide;
+    const double bottom = (patternSize.height + 1) * squareSide;
+    return {{left, top, 0.0}, {right, top, 0.0}, {right, bottom, 0.0}, {left, bottom, 0.0}};
+}
+} // namespace
+
+SyntheticBoard::CameraModel SyntheticBoard::defaultCamera(const cv::Size& resolution)
+{
+    const double focal = 0.85 * resolution.width;
+    // principal point a little off center, like real cameras
+    const double cx = 0.5 * resolution.width + 0.01 * resolution.width;
+    const double cy = 0.5 * resolution.height - 0.008 * resolution.height;
+    return CameraModel{resolution, cv::Matx33d(focal, 0.0, cx, 0.0, 1.01 * focal, cy, 0.0, 0.0, 1.0), cv::Vec<double, 5>(-0.12, 0.08, 0.0005, -0.0004, -0.02)};
+}
+
+std::vector<SyntheticBoard::View> SyntheticBoard::randomViews(const CameraModel& camera, const cv::Size& patternSize, double squareSide, uint32_t count,
+                                                              cv::RNG& rng)
+{
+    const cv::Vec3d center(0.5 * (patternSize.width - 1) * squareSide, 0.5 * (patternSize.height - 1) * squareSide, 0.0);
+    const double boardWidth = (patternSize.width + 3) * squareSide;
+    const cv::Matx33d inverseCamera = camera.CameraMatrix.inv();
+    const auto outline = boardOutline(patternSize, squareSide);
+    std::vector<View> views;
+    views.reserve(count);
+    std::vector<cv::Point2d> projected;
+    for (uint32_t attempt = 0; views.size() < count && attempt < 1000 * count; ++attempt) {
+        const double degrees = CV_PI / 180.0;
+        const cv::Vec3d tiltX(rng.uniform(-40.0, 40.0) * degrees, 0.0, 0.0);
+        const cv::Vec3d tiltY(0.0, rng.uniform(-40.0, 40.0) * degrees, 0.0);
+        const cv::Vec3d roll(0.0, 0.0, rng.uniform(-30.0, 30.0) * degrees);
+        cv::Matx33d rotationX, rotationY, rotationZ;
+        cv::Rodrigues(tiltX, rotationX);
+        cv::Rodrigues(tiltY, rotationY);
+        cv::Rodrigues(roll, rotationZ);
+        const cv::Matx33d rotation = rotationZ * rotationY * rotationX;
+
+        // board between a third and most of the image wide, centered anywhere
+        const double fraction = rng.uniform(0.3, 0.8);
+        const double distance = camera.CameraMatrix(0, 0) * boardWidth / (fraction * camera.Resolution.width);
+        const cv::Vec3d target(rng.uniform(0.0, static_cast<double>(camera.Resolution.width)), rng.uniform(0.0, static_cast<double>(camera.Resolution.height)),
+                               1.0);
+        const cv::Vec3d position = distance * (inverseCamera * target);
+
+        View view;
+        cv::Rodrigues(rotation, view.Rotation);
+        view.Translation = position - rotation * center;
+        cv::projectPoints(outline, view.Rotation, view.Translation, camera.CameraMatrix, camera.DistortionCoefficients, projected);
+        bool inside = true;
+        for (const auto& point : projected) {
+            inside = inside && point.x >= viewMargin && point.y >= viewMargin && point.x < camera.Resolution.width - viewMargin &&
+                     point.y < camera.Resolution.height - viewMargin;
+        }
+        if (inside) {
+            views.push_back(view);
+        }
+    }
+    return views;
+}
+
+void SyntheticBoard::render(const CameraModel& camera, const cv::Size& patternSize, double squareSide, const View& view, double noise, double blur,
+                            cv::RNG& rng, cv::Mat& image)
+{
+    cv::Mat mapX;
+    cv::Mat mapY;
+    makeDistortionMaps(camera, mapX, mapY);
+    renderView(camera, makeTexture(patternSize), squareSide, view, noise, blur, mapX, mapY, rng, image);
+}
+
+bool SyntheticBoard::writeSet(const std::string& directory, const GroundTruth& groundTruth, cv::RNG& rng)
+{
+    std::error_code error;
+    std::filesystem::create_directories(directory, error);
+    if (error) {
+        std::fprintf(stderr, "Could not create %s: %s\n", directory.c_str(), error.message().c_str());
+        return false;
+    }
+    // the distortion is the same for every view, only the board moves
+    cv::Mat mapX;
+    cv::Mat mapY;
+    makeDistortionMaps(groundTruth.Camera, mapX, mapY);
+    const cv::Mat texture = makeTexture(groundTruth.PatternSize);
+    cv::Mat image;
+    cv::Mat rotations(static_cast<int>(groundTruth.Views.size()), 3, CV_64F);
+    cv::Mat translations(static_cast<int>(groundTruth.Views.size()), 3, CV_64F);
+    for (size_t i = 0; i < groundTruth.Views.size(); ++i) {
+        const auto& view = groundTruth.Views[i];
+        renderView(groundTruth.Camera, texture, groundTruth.SquareSide, view, groundTruth.Noise, groundTruth.Blur, mapX, mapY, rng, image);
+        const auto path = (std::filesystem::path(directory) / ("calib" + std::to_string(i) + ".png")).string();
+        if (!cv::imwrite(path, image)) {
+            std::fprintf(stderr, "Could not write %s\n", path.c_str());
+            return false;
+        }
+        for (int j = 0; j < 3; ++j) {
+            rotations.at<double>(static_cast<int>(i), j) = view.Rotation[j];
+            translations.at<double>(static_cast<int>(i), j) = view.Translation[j];
+        }
+    }
+
+    cv::FileStorage storage((std::filesystem::path(directory) / groundTruthFileName).string(), cv::FileStorage::WRITE);
+    if (!storage.isOpened()) {
+        std::fprintf(stderr, "Could not write the ground truth of %s\n", directory.c_str());
+        return false;
+    }
+    storage << "resolution" << groundTruth.Camera.Resolution;
+    storage << "camera_matrix" << cv::Mat(groundTruth.Camera.CameraMatrix);
+    storage << "distortion_coefficients" << cv::Mat(groundTruth.Camera.DistortionCoefficients);
+    storage << "pattern_size" << groundTruth.PatternSize;
+    storage << "square_side" << groundTruth.SquareSide;
+    storage << "noise" << groundTruth.Noise;
+    storage << "blur" << groundTruth.Blur;
+    storage << "rotations" << rotations;
+    storage << "translations" << translations;
+    return true;
+}
+
+bool SyntheticBoard::readGroundTruth(const std::string& directory, GroundTruth& groundTruth)
+{
+    const auto path = (std::filesystem::path(directory) / groundTruthFileName).string();
+    cv::FileStorage storage;
+    try {
+        if (!storage.open(path, cv::FileStorage::READ)) {
+            return false;
+        }
+    } catch (cv::Exception& e) {
+        std::fprintf(stderr, "Could not read %s: %s\n", path.c_str(), e.what());
+        return false;
+    }
+    cv::Mat cameraMatrix;
+    cv::Mat distortion;
+    cv::Mat rotations;
+    cv::Mat translations;
+    storage["resolution"] >> groundTruth.Camera.Resolution;
+    storage["camera_matrix"] >> cameraMatrix;
+    storage["distortion_coefficients"] >> distortion;
+    storage["pattern_size"] >> groundTruth.PatternSize;
+    storage["square_side"] >> groundTruth.SquareSide;
+    storage["noise"] >> groundTruth.Noise;
+    storage["blur"] >> groundTruth.Blur;
+    storage["rotations"] >> rotations;
+    storage["translations"] >> translations;
+    if (cameraMatrix.size() != cv::Size(3, 3) || distortion.total() != 5 || rotations.cols != 3 || rotations.size() != translations.size()) {
+        std::fprintf(stderr, "%s is incomplete\n", path.c_str());
+        return false;
+    }
+    groundTruth.Camera.CameraMatrix = cameraMatrix;
+    groundTruth.Camera.DistortionCoefficients = distortion.reshape(1, 5);
+    groundTruth.Views.resize(rotations.rows);
+    for (int i = 0; i < rotations.rows; ++i) {
+        groundTruth.Views[i].Rotation = cv::Vec3d(rotations.ptr<double>(i));
+        groundTruth.Views[i].Translation = cv::Vec3d(translations.ptr<double>(i));
+    }
+    return true;
+}
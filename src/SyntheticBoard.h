@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <opencv2/core/mat.hpp>
+#include <opencv2/core/matx.hpp>
+
+/// Renders chessboards under known intrinsics, distortion and poses on the
+/// CPU, so detection and calibration can be checked against ground truth.
+/// The board is drawn with a white border of one square around the squares,
+/// rendered at twice the resolution, distorted and downsampled, and then
+/// optionally blurred and given gray level noise.
+class SyntheticBoard
+{
+public:
+    /// Camera the boards are seen through
+    struct CameraModel {
+        cv::Size Resolution;
+        cv::Matx33d CameraMatrix;
+        /// k1, k2, p1, p2, k3 as in OpenCV
+        cv::Vec<double, 5> DistortionCoefficients;
+    };
+
+    /// Board pose, maps board coordinates in meters into the camera
+    struct View {
+        cv::Vec3d Rotation;
+        cv::Vec3d Translation;
+    };
+
+    /// A set of calibration images and how they were made
+    struct GroundTruth {
+        CameraModel Camera;
+        /// inner corners of the board
+        cv::Size PatternSize;
+        double SquareSide;
+        /// standard deviation of the gray level noise
+        double Noise;
+        /// standard deviation of the gaussian blur in pixels, 0 for none
+        double Blur;
+        std::vector<View> Views;
+    };
+
+    /// Name of the ground truth file inside a set directory
+    static constexpr const char* groundTruthFileName = "ground_truth.yml";
+
+    /// Camera with a field of view of about 60 degrees and mild barrel distortion
+    static CameraModel defaultCamera(const cv::Size& resolution);
+    /// Random poses with the whole board in view, tilted up to 40 degrees
+    /// and at varying distances and positions in the image
+    static std::vector<View> randomViews(const CameraModel& camera, const cv::Size& patternSize, double squareSide, uint32_t count, cv::RNG& rng);
+    /// Render one view into a BGR image of the camera resolution
+    static void render(const CameraModel& camera, const cv::Size& patternSize, double squareSide, const View& view, double noise, double blur, cv::RNG& rng,
+                       cv::Mat& image);
+
+    /// Render every view of groundTruth into calibN.png files in directory
+    /// and store the ground truth next to them
+    static bool writeSet(const std::string& directory, const GroundTruth& groundTruth, cv::RNG& rng);
+    /// Read the ground truth of a set written by writeSet
+    static bool readGroundTruth(const std::string& directory, GroundTruth& groundTruth);
+};
@@ -0,0 +1,127 @@
+#include "Tracker.h"
+
+#include <cstdio>
+
+#include "FrameRecording.h"
+#include "FrameSource.h"
+
+std::unique_ptr<Tracker> Tracker::create(std::unique_ptr<FrameSource>&& source, const cv::Size& patternSize, float squareSideLengthM) {
+    auto capture = CaptureThread::create(std::move(source));
+    if (!capture) {
+        return nullptr;
+    }
+    return std::unique_ptr<Tracker>(new Tracker(std::move(capture), patternSize, squareSideLengthM));
+}
+
+Tracker::Tracker(std::unique_ptr<CaptureThread>&& capture, const cv::Size& patternSize, float squareSideLengthM)
+    : capture_(std::move(capture))
+    , dropStaleResults_(capture_->getSource().isLive())
+    , calibration_(patternSize, capture_->getFrameSize(), squareSideLengthM)
+    , addCalibrationView_(false)
+    , squareSideLengthM_(squareSideLengthM)
+    , processedFrames_(0)
+{
+    for (auto& slot : results_.getSlots()) {
+        slot.Image.create(capture_->getFrameSize(), CV_8UC3);
+        slot.Index = 0;
+        slot.Detected = false;
+        slot.PoseValid = false;
+    }
+    thread_ = std::thread(&Tracker::run, this);
+}
+
+Tracker::~Tracker()
+{
+    results_.close();
+    thread_.join();
+    stopRecording();
+}
+
+bool Tracker::startRecording(const std::string& path)
+{
+    auto recorder = FrameRecorder::create(path, capture_->getFrameSize(), CV_8UC3);
+    if (!recorder) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(calibrationMutex_);
+    recorder_ = std::move(recorder);
+    return true;
+}
+
+void Tracker::stopRecording()
+{
+    std::unique_ptr<FrameRecorder> recorder;
+    {
+        std::lock_guard<std::mutex> lock(calibrationMutex_);
+        recorder = std::move(recorder_);
+    }
+    if (recorder) {
+        std::printf("Recorded %llu frames from %s, %llu dropped\n", static_cast<unsigned long long>(recorder->getRecordedFrames()),
+                    capture_->getSource().getName().c_str(), static_cast<unsigned long long>(recorder->getDroppedFrames()));
+    }
+}
+
+void Tracker::run()
+{
+    // whether the last frame has no pose solvePnP could start from
+    bool firstPose = true;
+    while (auto frame = capture_->acquireLatest()) {
+        auto startAllocations = AllocationCounter::get();
+        Result& result = results_.getBack();
+        {
+            std::lock_guard<std::mutex> lock(calibrationMutex_);
+            if (recorder_) {
+                // only queues a copy, writing happens on the recorder thread
+                recorder_->push(frame->Image, frame->CaptureTime);
+            }
+            // the slot is reused, clear the stamps the consumer set last time
+            result.Timing = FrameTiming();
+            result.Timing.Capture = frame->CaptureTime;
+            result.Timing.DetectStart = Clock::now();
+            // gray, downscaled and pyramid images are built once and shared by every stage
+            frameCache_.update(frame->Image, calibration_.GetFrameCacheOptions());
+            const bool addView = addCalibrationView_.exchange(false);
+            result.Detected = calibration_.DetectPattern(frameCache_, addView, false);
+            if (result.Detected) {
+                result.Corners.assign(calibration_.GetImagePoints().begin(), calibration_.GetImagePoints().end());
+            } else {
+                result.Corners.clear();
+            }
+            result.Quality = calibration_.GetLastQuality();
+            result.QualityAccepted = calibration_.IsQualityAcceptable(result.Quality);
+            if (addView && !result.QualityAccepted) {
+                // keep the request for the next frame which is sharp enough
+                addCalibrationView_ = true;
+            }
+            result.Timing.DetectEnd = Clock::now();
+            result.PoseValid = result.Detected && calibration_.UpdateRotTransMat(result.RotTransMat, squareSideLengthM_, !firstPose);
+            if (result.PoseValid) {
+                calibration_.GetPose(result.RotationVector, result.TranslationVector);
+            }
+            result.Timing.PoseEnd = Clock::now();
+        }
+        // once the board is lost its last pose is stale, the next detection solves from scratch
+        firstPose = !result.PoseValid;
+        frame->Image.copyTo(result.Image);
+        result.Index = frame->Index;
+
+        auto endAllocations = AllocationCounter::get();
+        result.Allocations.Owned = endAllocations.Owned - startAllocations.Owned;
+        result.Allocations.External = endAllocations.External - startAllocations.External;
+        processedFrames_.fetch_add(1, std::memory_order_relaxed);
+        if (!results_.publish(!dropStaleResults_)) {
+            break;
+        }
+    }
+    results_.close();
+}
+
+Tracker::Result* Tracker::acquireLatest(bool wait)
+{
+    return results_.acquire(wait);
+}
+
+bool Tracker::isFinished()
+{
+    return results_.isDrained();
+}
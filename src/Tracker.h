@@ -0,0 +1,116 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <opencv2/core/mat.hpp>
+#include <opencv2/core/matx.hpp>
+
+#include "AllocationCounter.h"
+#include "Calibration.h"
+#include "CaptureThread.h"
+#include "FrameCache.h"
+#include "FrameQuality.h"
+#include "LatencyStats.h"
+#include "TripleBuffer.h"
+
+class FrameRecorder;
+class FrameSource;
+
+/// Tracking of one camera: owns the capture thread and the Calibration state
+/// of a source and runs detection and pose estimation on a worker thread of
+/// its own, so several cameras are processed on separate cores instead of
+/// serializing in the render loop.
+class Tracker
+{
+public:
+    using Clock = CaptureThread::Clock;
+
+    /// Outcome of tracking one frame
+    struct Result {
+        /// Copy of the frame the result belongs to
+        cv::Mat Image;
+        uint64_t Index;
+        bool Detected;
+        /// Board corners if Detected, reused between frames
+        std::vector<cv::Point2f> Corners;
+        /// Sharpness and exposure of the frame, and whether it passed the
+        /// quality gate and was searched
+        FrameQuality Quality;
+        bool QualityAccepted;
+        /// Whether RotTransMat holds a valid board pose
+        bool PoseValid;
+        mat4 RotTransMat;
+        /// Board pose as OpenCV rotation and translation vectors
+        cv::Vec3d RotationVector;
+        cv::Vec3d TranslationVector;
+        /// Stage timestamps, the tracker stamps capture to pose and the
+        /// consumer fills in the rest
+        FrameTiming Timing;
+        /// Heap allocations the worker made while processing the frame
+        AllocationCounter::Counts Allocations;
+    };
+
+    /// Factory function which takes ownership of an opened frame source and
+    /// starts capturing and tracking. Returns null if there is no source.
+    static std::unique_ptr<Tracker> create(std::unique_ptr<FrameSource>&& source, const cv::Size& patternSize, float squareSideLengthM);
+    virtual ~Tracker();
+
+    /// Take the newest result which has not been seen yet, optionally waiting
+    /// for one. The result stays valid until the next call. Returns null if
+    /// there is no new result.
+    Result* acquireLatest(bool wait);
+    /// Whether the source ended and every result was acquired
+    bool isFinished();
+
+    /// Lock which must be held while touching the calibration from any other
+    /// thread than the worker, e.g. for the UI or for loading images.
+    inline std::unique_lock<std::mutex> lockCalibration() { return std::unique_lock<std::mutex>(calibrationMutex_); };
+    /// Calibration state of this camera, guard with lockCalibration()
+    inline Calibration& getCalibration() { return calibration_; };
+    /// Add the next frame in which the board is detected as calibration view
+    inline void requestCalibrationView() { addCalibrationView_ = true; };
+    /// Append every captured frame to a raw recording at path (see
+    /// FrameRecorder) from now on. Returns false if it can't be created.
+    bool startRecording(const std::string& path);
+    /// Finish the raw recording, if any
+    void stopRecording();
+    /// Board square size used for the pose, can be changed while tracking
+    inline void setSquareSideLength(float squareSideLengthM) { squareSideLengthM_ = squareSideLengthM; };
+
+    inline cv::Size getFrameSize() const { return capture_->getFrameSize(); };
+    inline const FrameSource& getSource() const { return capture_->getSource(); };
+    /// Number of frames tracked by the worker
+    inline uint64_t getProcessedFrames() const { return processedFrames_.load(std::memory_order_relaxed); };
+    /// Number of camera frames which were never tracked because the worker was busy
+    inline uint64_t getDroppedFrames() const { return capture_->getDroppedFrames(); };
+
+private:
+    /// Private unique constructor forcing the use of factory function which
+    /// can return null unlike constructor.
+    Tracker(std::unique_ptr<CaptureThread>&& capture, const cv::Size& patternSize, float squareSideLengthM);
+
+    /// Body of the worker thread
+    void run();
+
+    const std::unique_ptr<CaptureThread> capture_;
+    /// Whether results may be dropped when the consumer is slower than the source
+    const bool dropStaleResults_;
+    std::mutex calibrationMutex_;
+    Calibration calibration_;
+    std::atomic<bool> addCalibrationView_;
+    /// derived images of the frame being tracked, only used by the worker thread
+    FrameCache frameCache_;
+    std::atomic<float> squareSideLengthM_;
+    std::atomic<uint64_t> processedFrames_;
+    /// Raw recording of the captured frames, guarded by calibrationMutex_
+    std::unique_ptr<FrameRecorder> recorder_;
+    TripleBuffer<Result> results_;
+    std::thread thread_;
+};
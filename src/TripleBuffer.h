@@ -0,0 +1,112 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+
+/// Hands values from one producer thread to one consumer thread through three
+/// preallocated slots: the producer owns one, one holds the newest published
+/// value and the consumer owns the last one. Publishing never copies, the
+/// slots just change owner. A consumer always gets the newest value; values
+/// it never picked up are overwritten and counted as dropped, unless the
+/// producer asks to wait for the consumer.
+template <typename T>
+class TripleBuffer
+{
+public:
+    TripleBuffer()
+        : back_(0)
+        , ready_(1)
+        , front_(2)
+        , fresh_(false)
+        , closed_(false)
+        , dropped_(0)
+    {
+    }
+
+    /// All slots, for preallocating their contents before producing starts
+    inline std::array<T, 3>& getSlots() { return slots_; };
+    /// Slot owned by the producer, only the producer thread may touch it
+    inline T& getBack() { return slots_[back_]; };
+
+    /// Make the back slot the newest value. With waitForConsumer the producer
+    /// blocks until the previous value was acquired instead of dropping it.
+    /// Returns false once the buffer is closed.
+    bool publish(bool waitForConsumer)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            if (waitForConsumer) {
+                consumed_.wait(lock, [this] { return !fresh_ || closed_; });
+            }
+            if (closed_) {
+                return false;
+            }
+            std::swap(back_, ready_);
+            if (fresh_) {
+                dropped_.fetch_add(1, std::memory_order_relaxed);
+            }
+            fresh_ = true;
+        }
+        published_.notify_one();
+        return true;
+    }
+
+    /// Take the newest value which the consumer has not seen yet. It stays
+    /// valid and owned by the consumer until the next call. When block is set
+    /// this waits for a value; returns null if there is no new value or the
+    /// buffer was closed and the last value was already taken.
+    T* acquire(bool block)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (block) {
+            published_.wait(lock, [this] { return fresh_ || closed_; });
+        }
+        if (!fresh_) {
+            return nullptr;
+        }
+        std::swap(front_, ready_);
+        fresh_ = false;
+        lock.unlock();
+        consumed_.notify_one();
+        return &slots_[front_];
+    }
+
+    /// Called by either side when it stops: wakes up the other side which then
+    /// stops publishing or, after the last value, acquiring.
+    void close()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            closed_ = true;
+        }
+        published_.notify_all();
+        consumed_.notify_all();
+    }
+
+    /// Whether the buffer is closed and the last value was acquired
+    bool isDrained()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return closed_ && !fresh_;
+    }
+
+    /// Number of values which were overwritten before being acquired
+    inline uint64_t getDropped() const { return dropped_.load(std::memory_order_relaxed); };
+
+private:
+    std::array<T, 3> slots_;
+    uint32_t back_;
+    uint32_t ready_;
+    uint32_t front_;
+    /// Whether ready_ holds a value the consumer has not seen yet
+    bool fresh_;
+    bool closed_;
+    std::atomic<uint64_t> dropped_;
+
+    std::mutex mutex_;
+    std::condition_variable published_;
+    std::condition_variable consumed_;
+};
@@ -1,12 +1,19 @@
 #include "Ui.h"
 
+#include <algorithm>
+#include <iterator>
+
 #include <imgui.h>
 #include <imgui_internal.h>
 #include <examples/imgui_impl_sdl.h>
 #include <examples/imgui_impl_opengl3.h>
 #include <ImGuiFileBrowser.h>
+#include <opencv2/calib3d.hpp>
+#include <opencv2/core/mat.hpp>
 
 #include "Calibration.h"
+#include "FrameArena.h"
+#include "LatencyStats.h"
 #include "Texture.h"
 
 void ImGuiDestroyer::operator()(ImGuiContext* context) const {
@@ -41,7 +48,12 @@ Ui::Ui(std::unique_ptr<ImGuiContext, ImGuiDestroyer>&& context)
     : context_(std::move(context))
     , show_save_dialog_(false)
     , folderDialog_(std::make_unique<imgui_addons::ImGuiFileBrowser>())
+    , calibImagesOwner_(nullptr)
+    , calibImagesVersion_(0)
+    , previewIndex_(0)
     , CalibrationDirectoryPath{"C:/Users/eempi/CLionProjects/INFOMCV_calibration/calibImages/"}
+    , ActiveCamera(0)
+    , UndistortBackground(true)
 {
     ImGuiSettingsHandler ini_handler;
     ini_handler.TypeName = "UserData";
@@ -74,16 +86,36 @@ void Ui::processEvent(const SDL_Event& event) {
     ImGui_ImplSDL2_ProcessEvent(&event);
 }
 
-void Ui::draw(SDL_Window *window, Calibration &calibration, float *objectMatrix, float *lightPos, float &squareSideLengthM, bool &saveNextImage)
+void Ui::draw(SDL_Window *window, FrameArena &arena, Calibration &calibration, float *objectMatrix, float *lightPos, float &squareSideLengthM, bool &saveNextImage,
+              const AllocationCounter::Counts &frameAllocations, uint32_t cameraCount, const LatencyStats &latency)
 {
+    if (calibImagesOwner_ != &calibration || calibImagesVersion_ != calibration.CalibImagesVersion) {
+        // textures are created when the previews are shown
+        calibImageTextures_.clear();
+        calibImageTextures_.resize(calibration.CalibImages.size());
+        previewFailed_.assign(calibration.CalibImages.size(), false);
+        calibImagesOwner_ = &calibration;
+        calibImagesVersion_ = calibration.CalibImagesVersion;
+        // a decode in flight may be of an image which is gone
+        previewPath_.clear();
+        decodedPreview_.release();
+    }
+
     ImGui_ImplOpenGL3_NewFrame();
     ImGui_ImplSDL2_NewFrame(window);
     ImGui::NewFrame();
 
     ImGui::SetNextWindowBgAlpha(0.4f);
     if (ImGui::Begin("Configuration", nullptr, ImGuiWindowFlags_AlwaysAutoResize)) {
+        if (cameraCount > 1) {
+            int activeCamera = static_cast<int>(ActiveCamera);
+            if (ImGui::SliderInt("Active Camera", &activeCamera, 0, static_cast<int>(cameraCount) - 1)) {
+                ActiveCamera = static_cast<uint32_t>(activeCamera);
+            }
+        }
         if (ImGui::BeginTabBar("Tab bar")) {
             if (ImGui::BeginTabItem("Offline")) {
+                const auto intrinsics = calibration.GetIntrinsics();
                 if (ImGui::CollapsingHeader("Load saved calibration", ImGuiTreeNodeFlags_DefaultOpen)) {
                     ImGui::InputText("##Calibration files", CalibrationDirectoryPath, sizeof(CalibrationDirectoryPath));
                     ImGui::SameLine();
@@ -92,45 +124,128 @@ void Ui::draw(SDL_Window *window, Calibration &calibration, float *objectMatrix,
                         if (strcmp(CalibrationDirectoryPath, "") != 0)
                             saveNextImage = true;
                     }
-                    if (ImGui::Button("Calibrate Cameras (R key)")) {
+                    const auto loadProgress = calibration.GetLoadProgress();
+                    if (loadProgress.Loading) {
+                        const float fraction = loadProgress.Total > 0 ? static_cast<float>(loadProgress.Processed) / loadProgress.Total : 1.0f;
+                        ImGui::ProgressBar(fraction, ImVec2(-1.0f, 0.0f),
+                                           arena.format("Loading %u/%u", loadProgress.Processed, loadProgress.Total));
+                    } else if (ImGui::Button("Calibrate Cameras (R key)")) {
                         if (strcmp(CalibrationDirectoryPath, "") != 0)
-                            calibration.LoadFromDirectory(CalibrationDirectoryPath);
+                            calibration.StartLoadFromDirectory(CalibrationDirectoryPath);
+                    }
+                    ImGui::Checkbox("Calibrate While Capturing (C key)", &calibration.IncrementalCalibration);
+                    int incrementalMinViews = static_cast<int>(calibration.IncrementalMinViews);
+                    if (ImGui::SliderInt("Views Before First Calibration", &incrementalMinViews, 3, 30)) {
+                        calibration.IncrementalMinViews = static_cast<uint32_t>(incrementalMinViews);
+                    }
+                    int incrementalIterations = static_cast<int>(calibration.IncrementalIterations);
+                    if (ImGui::SliderInt("Iterations Per View", &incrementalIterations, 1, 30)) {
+                        calibration.IncrementalIterations = static_cast<uint32_t>(incrementalIterations);
+                    }
+                    if (ImGui::BeginCombo("Solver", CalibrationWorker::getSolverName(calibration.Solver))) {
+                        for (int i = 0; i < static_cast<int>(CalibrationWorker::Solver::Count); ++i) {
+                            const auto solver = static_cast<CalibrationWorker::Solver>(i);
+                            if (ImGui::Selectable(CalibrationWorker::getSolverName(solver), solver == calibration.Solver)) {
+                                calibration.Solver = solver;
+                            }
+                        }
+                        ImGui::EndCombo();
+                    }
+                    const auto calibrationProgress = calibration.GetCalibrationProgress();
+                    if (calibrationProgress.Running) {
+                        ImGui::ProgressBar(calibrationProgress.Fraction, ImVec2(-80.0f, 0.0f),
+                                           calibrationProgress.Indeterminate ? "Calibrating (no progress)" : "Calibrating");
+                        // cv::calibrateCamera can't be stopped before it returns
+                        if (!calibrationProgress.Indeterminate) {
+                            ImGui::SameLine();
+                            if (ImGui::Button("Cancel##calibration")) {
+                                calibration.CancelCalibration();
+                            }
+                        }
+                    }
+                    if (intrinsics) {
+                        ImGui::Text("%zu views, reprojection error %.3f px", calibration.GetViewCount(), intrinsics->ReprojectionError);
+                    } else {
+                        ImGui::Text("%zu views", calibration.GetViewCount());
+                    }
+                    ImGui::Checkbox("Select Diverse Views", &calibration.ViewSelection);
+                    int viewBudget = static_cast<int>(calibration.ViewBudget);
+                    if (ImGui::SliderInt("View Budget", &viewBudget, 0, 200)) {
+                        calibration.ViewBudget = static_cast<uint32_t>(viewBudget);
+                    }
+                    ImGui::SliderFloat("Min View Distance", &calibration.ViewMinDistance, 0.0f, 0.5f, "%.3f");
+                    if (!loadProgress.Loading && calibration.GetViewCount() > 0 && ImGui::Button("Compare Selected With All Views")) {
+                        calibration.CompareViewSelection();
+                    }
+                    const auto report = calibration.GetViewSelectionReport();
+                    if (report.AllViews > 0) {
+                        ImGui::Text("All %u views: %.1f ms, %.3f px", report.AllViews, report.AllMs, report.AllError);
+                        ImGui::Text("Selected %u views: %.1f ms, %.3f px", report.SelectedViews, report.SelectedMs, report.SelectedError);
                     }
                 }
 
-                if (ImGui::CollapsingHeader("Intrinsic Matrix")) {
-                    ImGui::InputScalarN("##intrinsic_matrix_0", ImGuiDataType_Double, calibration.CameraMatrix.data + 0 * sizeof(double), 3, nullptr, nullptr, "%0.3f");
-                    ImGui::InputScalarN("##intrinsic_matrix_1", ImGuiDataType_Double, calibration.CameraMatrix.data + 3 * sizeof(double), 3, nullptr, nullptr, "%0.3f");
-                    ImGui::InputScalarN("##intrinsic_matrix_2", ImGuiDataType_Double, calibration.CameraMatrix.data + 6 * sizeof(double), 3, nullptr, nullptr, "%0.3f");
+                // the snapshot is immutable, the fields show copies of it
+                if (intrinsics && ImGui::CollapsingHeader("Intrinsic Matrix")) {
+                    cv::Matx33d cameraMatrix = intrinsics->CameraMatrix;
+                    ImGui::InputScalarN("##intrinsic_matrix_0", ImGuiDataType_Double, cameraMatrix.val + 0, 3, nullptr, nullptr, "%0.3f", ImGuiInputTextFlags_ReadOnly);
+                    ImGui::InputScalarN("##intrinsic_matrix_1", ImGuiDataType_Double, cameraMatrix.val + 3, 3, nullptr, nullptr, "%0.3f", ImGuiInputTextFlags_ReadOnly);
+                    ImGui::InputScalarN("##intrinsic_matrix_2", ImGuiDataType_Double, cameraMatrix.val + 6, 3, nullptr, nullptr, "%0.3f", ImGuiInputTextFlags_ReadOnly);
                 }
 
-                if (ImGui::CollapsingHeader("Projection Matrix")) {
-                    ImGui::InputFloat4("##projection_matrix_0", calibration.ProjMat + 0);
-                    ImGui::InputFloat4("##projection_matrix_1", calibration.ProjMat + 4);
-                    ImGui::InputFloat4("##projection_matrix_2", calibration.ProjMat + 8);
-                    ImGui::InputFloat4("##projection_matrix_3", calibration.ProjMat + 12);
+                if (intrinsics && ImGui::CollapsingHeader("Projection Matrix")) {
+                    mat4 projMat;
+                    std::copy(std::begin(intrinsics->ProjMat), std::end(intrinsics->ProjMat), projMat);
+                    ImGui::InputFloat4("##projection_matrix_0", projMat + 0, "%.3f", ImGuiInputTextFlags_ReadOnly);
+                    ImGui::InputFloat4("##projection_matrix_1", projMat + 4, "%.3f", ImGuiInputTextFlags_ReadOnly);
+                    ImGui::InputFloat4("##projection_matrix_2", projMat + 8, "%.3f", ImGuiInputTextFlags_ReadOnly);
+                    ImGui::InputFloat4("##projection_matrix_3", projMat + 12, "%.3f", ImGuiInputTextFlags_ReadOnly);
                 }
 
-                if (ImGui::CollapsingHeader("Distortion Coefficients")) {
-                    for (uint32_t i = 0; i < calibration.DistortionCoefficients.rows; ++i) {
-                        ImGui::InputDouble(("##distortion" + std::to_string(i)).c_str(), &calibration.DistortionCoefficients.at<double>(i, 0));
+                if (intrinsics && ImGui::CollapsingHeader("Distortion Coefficients")) {
+                    for (uint32_t i = 0; i < intrinsics->DistortionCoefficients.total(); ++i) {
+                        double coefficient = intrinsics->DistortionCoefficients.at<double>(static_cast<int>(i));
+                        ImGui::InputDouble(arena.format("##distortion%u", i), &coefficient, 0.0, 0.0, "%.6f", ImGuiInputTextFlags_ReadOnly);
                     }
                 }
 
+                const cv::Mat rotationVectors = intrinsics ? intrinsics->RotationVectors : cv::Mat();
+                const cv::Mat translationVectors = intrinsics ? intrinsics->TranslationVectors : cv::Mat();
                 uint32_t numFiles = std::min(
-                    static_cast<uint32_t>(std::min(calibration.CalibImages.size(), calibration.CalibImageNames.size())),
-                    static_cast<uint32_t>(std::min(calibration.InitialRotationVectors.size[0], calibration.InitialTranslationVectors.size[0]))
+                    static_cast<uint32_t>(std::min(calibImageTextures_.size(), calibration.CalibImageNames.size())),
+                    static_cast<uint32_t>(std::min(rotationVectors.rows, translationVectors.rows))
                 );
-                if (numFiles > 0 && ImGui::CollapsingHeader(("Calibration Files (" + std::to_string(numFiles) + ")").c_str())) {
+                if (numFiles > 0 && ImGui::CollapsingHeader(arena.format("Calibration Files (%u)", numFiles))) {
+                    // previews of cached images are decoded one per frame by render, outside
+                    // the calibration lock, so the list opens instantly
                     for (uint32_t i = 0; i < numFiles; ++i)
                     {
                         if (ImGui::CollapsingHeader(calibration.CalibImageNames[i].c_str(), ImGuiTreeNodeFlags_DefaultOpen)) {
-                            if (calibration.CalibImages[i])
+                            if (!calibImageTextures_[i]) {
+                                if (calibration.CalibImages[i].empty() && previewIndex_ == i && !decodedPreview_.empty()) {
+                                    calibration.SetPreview(i, std::move(decodedPreview_));
+                                    previewPath_.clear();
+                                }
+                                const cv::Mat& preview = calibration.CalibImages[i];
+                                if (!preview.empty()) {
+                                    calibImageTextures_[i] = Texture::create(preview.cols, preview.rows);
+                                    if (calibImageTextures_[i]) {
+                                        calibImageTextures_[i]->upload(preview);
+                                    }
+                                } else if (previewPath_.empty() && !previewFailed_[i]) {
+                                    previewPath_ = calibration.GetImagePath(i);
+                                    previewIndex_ = i;
+                                }
+                            }
+                            if (calibImageTextures_[i])
                             {
-                                ImGui::Image(reinterpret_cast<ImTextureID>(calibration.CalibImages[i]->getNativeHandle()), ImVec2(256, 256 / calibration.CalibImages[i]->getAspect()));
+                                ImGui::Image(reinterpret_cast<ImTextureID>(calibImageTextures_[i]->getNativeHandle()), ImVec2(256, 256 / calibImageTextures_[i]->getAspect()));
                             }
-                            ImGui::InputScalarN(("rvec##rvec" + std::to_string(i)).c_str(), ImGuiDataType_Double, calibration.InitialRotationVectors.row(i).data, 3, nullptr, nullptr, "%.5f", ImGuiInputTextFlags_ReadOnly);
-                            ImGui::InputScalarN(("tvec##tvec" + std::to_string(i)).c_str(), ImGuiDataType_Double, calibration.InitialTranslationVectors.row(i).data, 3, nullptr, nullptr, "%.5f", ImGuiInputTextFlags_ReadOnly);
+                            else
+                            {
+                                ImGui::TextDisabled(previewFailed_[i] ? "Preview unavailable" : "Loading preview...");
+                            }
+                            ImGui::InputScalarN(arena.format("rvec##rvec%u", i), ImGuiDataType_Double, const_cast<uchar*>(rotationVectors.ptr(i)), 3, nullptr, nullptr, "%.5f", ImGuiInputTextFlags_ReadOnly);
+                            ImGui::InputScalarN(arena.format("tvec##tvec%u", i), ImGuiDataType_Double, const_cast<uchar*>(translationVectors.ptr(i)), 3, nullptr, nullptr, "%.5f", ImGuiInputTextFlags_ReadOnly);
                         }
                     }
                 }
@@ -146,9 +261,98 @@ void Ui::draw(SDL_Window *window, Calibration &calibration, float *objectMatrix,
                     ImGui::InputFloat4("##object_matrix_3", objectMatrix + 12);
                 }
                 ImGui::InputFloat3( "Light Position", lightPos);
+                if (ImGui::CollapsingHeader("Detection")) {
+                    // SetDetector replaces the detector, only keep copies of its settings
+                    const auto detectorType = calibration.GetDetector().getType();
+                    const cv::Size detectorPatternSize = calibration.GetDetector().getPatternSize();
+                    if (ImGui::BeginCombo("Detector", PatternDetector::getTypeName(detectorType))) {
+                        for (int i = 0; i < static_cast<int>(PatternDetector::Type::Count); ++i) {
+                            const auto type = static_cast<PatternDetector::Type>(i);
+                            if (ImGui::Selectable(PatternDetector::getTypeName(type), type == detectorType)) {
+                                calibration.SetDetector(type, detectorPatternSize);
+                            }
+                        }
+                        ImGui::EndCombo();
+                    }
+                    int patternSize[2] = {detectorPatternSize.width, detectorPatternSize.height};
+                    if (ImGui::InputInt2("Pattern Size", patternSize, ImGuiInputTextFlags_EnterReturnsTrue) && patternSize[0] > 1 && patternSize[1] > 1) {
+                        calibration.SetDetector(calibration.GetDetector().getType(), cv::Size(patternSize[0], patternSize[1]));
+                    }
+                    auto& detector = calibration.GetDetector();
+                    unsigned int flags = static_cast<unsigned int>(detector.Flags);
+                    switch (detector.getType()) {
+                    case PatternDetector::Type::Chessboard:
+                        ImGui::CheckboxFlags("Adaptive Threshold", &flags, cv::CALIB_CB_ADAPTIVE_THRESH);
+                        ImGui::CheckboxFlags("Normalize Image", &flags, cv::CALIB_CB_NORMALIZE_IMAGE);
+                        ImGui::CheckboxFlags("Filter Quads", &flags, cv::CALIB_CB_FILTER_QUADS);
+                        ImGui::CheckboxFlags("Fast Check", &flags, cv::CALIB_CB_FAST_CHECK);
+                        break;
+                    case PatternDetector::Type::ChessboardSB:
+                        ImGui::CheckboxFlags("Normalize Image", &flags, cv::CALIB_CB_NORMALIZE_IMAGE);
+                        ImGui::CheckboxFlags("Exhaustive", &flags, cv::CALIB_CB_EXHAUSTIVE);
+                        ImGui::CheckboxFlags("Accuracy", &flags, cv::CALIB_CB_ACCURACY);
+                        break;
+                    case PatternDetector::Type::CircleGrid:
+                    case PatternDetector::Type::AsymmetricCircleGrid:
+                        ImGui::CheckboxFlags("Clustering", &flags, cv::CALIB_CB_CLUSTERING);
+                        break;
+                    default:
+                        break;
+                    }
+                    detector.Flags = static_cast<int>(flags);
+                    ImGui::SliderFloat("Coarse Scale", &calibration.CoarseScale, 0.125f, 1.0f, "%.3f");
+                    ImGui::Checkbox("Full Resolution Fallback", &calibration.CoarseFallback);
+                    ImGui::Checkbox("Search Around Last Board", &calibration.RoiTracking);
+                    ImGui::SliderFloat("Search Padding", &calibration.RoiPadding, 0.05f, 1.0f, "%.2f");
+                    int roiMaxMisses = static_cast<int>(calibration.RoiMaxMisses);
+                    if (ImGui::SliderInt("Misses Before Full Search", &roiMaxMisses, 1, 30)) {
+                        calibration.RoiMaxMisses = static_cast<uint32_t>(roiMaxMisses);
+                    }
+                    ImGui::Checkbox("Optical Flow Tracking", &calibration.FlowTracking);
+                    int flowRedetectInterval = static_cast<int>(calibration.FlowRedetectInterval);
+                    if (ImGui::SliderInt("Frames Between Detections", &flowRedetectInterval, 1, 60)) {
+                        calibration.FlowRedetectInterval = static_cast<uint32_t>(flowRedetectInterval);
+                    }
+                    ImGui::SliderFloat("Max Flow Error", &calibration.FlowMaxError, 1.0f, 30.0f, "%.1f");
+                    ImGui::Checkbox("Skip Poor Quality Frames", &calibration.QualityGating);
+                    ImGui::SliderFloat("Min Sharpness", &calibration.MinSharpness, 0.0f, 200.0f, "%.1f");
+                    ImGui::SliderFloat("Max Clipped Pixels", &calibration.MaxClippedRatio, 0.0f, 1.0f, "%.2f");
+                }
+                const auto& quality = calibration.GetLastQuality();
+                const ImVec4 qualityColor = calibration.IsQualityAcceptable(quality) ? ImVec4(0.4f, 1.0f, 0.4f, 1.0f) : ImVec4(1.0f, 0.4f, 0.4f, 1.0f);
+                ImGui::TextColored(qualityColor, "Sharpness: %.1f, clipped pixels: %.1f%%", quality.Sharpness, 100.0f * quality.ClippedRatio);
+                ImGui::Text("Heap allocations last frame: %llu (%llu inside OpenCV)", static_cast<unsigned long long>(frameAllocations.Owned),
+                            static_cast<unsigned long long>(frameAllocations.External));
 
                 ImGui::EndTabItem();
             }
+            if (ImGui::BeginTabItem("Latency")) {
+                ImGui::Checkbox("Undistort Background", &UndistortBackground);
+                ImGui::Columns(4, "##latency_columns");
+                ImGui::Text("Stage");
+                ImGui::NextColumn();
+                ImGui::Text("p50 (ms)");
+                ImGui::NextColumn();
+                ImGui::Text("p95 (ms)");
+                ImGui::NextColumn();
+                ImGui::Text("p99 (ms)");
+                ImGui::NextColumn();
+                ImGui::Separator();
+                for (uint32_t i = 0; i < LatencyStats::StageCount; ++i) {
+                    auto stage = static_cast<LatencyStats::Stage>(i);
+                    auto percentiles = latency.get(stage);
+                    ImGui::Text("%s", LatencyStats::getStageName(stage));
+                    ImGui::NextColumn();
+                    ImGui::Text("%.3f", percentiles.P50);
+                    ImGui::NextColumn();
+                    ImGui::Text("%.3f", percentiles.P95);
+                    ImGui::NextColumn();
+                    ImGui::Text("%.3f", percentiles.P99);
+                    ImGui::NextColumn();
+                }
+                ImGui::Columns(1);
+                ImGui::EndTabItem();
+            }
             ImGui::EndTabBar();
         }
     }
@@ -167,5 +371,16 @@ void Ui::draw(SDL_Window *window, Calibration &calibration, float *objectMatrix,
     }
 
     ImGui::Render();
+}
+
+void Ui::render()
+{
     ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+    if (!previewPath_.empty() && decodedPreview_.empty()) {
+        decodedPreview_ = Calibration::LoadPreview(previewPath_);
+        if (decodedPreview_.empty()) {
+            previewFailed_[previewIndex_] = true;
+            previewPath_.clear();
+        }
+    }
 }
@@ -1,11 +1,21 @@
 #pragma once
 
+#include <cstdint>
 #include <memory>
+#include <string>
+#include <vector>
+
+#include <opencv2/core/mat.hpp>
+
+#include "AllocationCounter.h"
 
 struct SDL_Window;
 struct ImGuiContext;
 union SDL_Event;
 class Calibration;
+class FrameArena;
+class LatencyStats;
+class Texture;
 
 namespace imgui_addons
 {
@@ -31,7 +41,14 @@ public:
   void processEvent(const SDL_Event& event);
   /// Draw UI and update variables in immediate mode.
   /// Takes in the calibration object and other variables to display and edit their public variables.
-  void draw(SDL_Window *window, Calibration &calibration, float *objectMatrix, float *lightPos, float &squareSideLengthM, bool &saveNextImage);
+  /// Per-frame strings such as widget labels are formatted into the frame arena.
+  /// With several cameras, calibration belongs to the camera selected as ActiveCamera.
+  /// Only builds the frame, hold the calibration lock for this call alone.
+  void draw(SDL_Window *window, FrameArena &arena, Calibration &calibration, float *objectMatrix, float *lightPos, float &squareSideLengthM, bool &saveNextImage,
+            const AllocationCounter::Counts &frameAllocations, uint32_t cameraCount, const LatencyStats &latency);
+  /// Submit the frame built by draw and decode the calibration image preview
+  /// it asked for. Call without holding the calibration lock.
+  void render();
 
 private:
   /// Private unique constructor forcing the use of factory function which
@@ -41,7 +58,22 @@ private:
   std::unique_ptr<ImGuiContext, ImGuiDestroyer> context_;
   bool show_save_dialog_;
   std::unique_ptr<imgui_addons::ImGuiFileBrowser> folderDialog_;
+  /// GPU copies of the calibration image previews, rebuilt when they change
+  std::vector<std::unique_ptr<Texture>> calibImageTextures_;
+  const Calibration* calibImagesOwner_;
+  uint32_t calibImagesVersion_;
+  /// Calibration image whose preview render decodes, empty if none is asked for
+  std::string previewPath_;
+  size_t previewIndex_;
+  /// Preview decoded by render, handed to the calibration by the next draw
+  cv::Mat decodedPreview_;
+  /// Calibration images whose preview could not be read, not retried until they change
+  std::vector<bool> previewFailed_;
 
 public:
   char CalibrationDirectoryPath[0x400];
+  /// Camera whose calibration is shown and which receives capture and calibrate commands
+  uint32_t ActiveCamera;
+  /// Whether the camera frames are shown with the lens distortion removed
+  bool UndistortBackground;
 };
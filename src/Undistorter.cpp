@@ -0,0 +1,162 @@
+#include "Undistorter.h"
+
+#include <cstring>
+
+#include <opencv2/calib3d.hpp>
+#include <opencv2/core/utility.hpp>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define UNDISTORT_SSE2 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define UNDISTORT_NEON 1
+#endif
+
+namespace
+{
+/// Sub-pixel precision of the maps, 1/128 of a pixel is well below what shows on screen
+constexpr int fractionBits = 7;
+constexpr int fractionOne = 1 << fractionBits;
+/// The four bilinear weights of a pixel sum up to 1 << weightBits, which
+/// still fits the signed 16 bit lanes of the SIMD multiplies
+constexpr int weightBits = 2 * fractionBits;
+/// Rows remapped by one task
+constexpr int stripeRows = 32;
+
+#if UNDISTORT_SSE2
+/// Channels of the pixel at pixel and of its right neighbour interleaved as
+/// 16 bit B0 B1 G0 G1 R0 R1 for _mm_madd_epi16, read without touching the
+/// bytes behind the neighbour
+inline __m128i loadPair(const uint8_t* pixel)
+{
+    int32_t left;
+    int32_t right;
+    std::memcpy(&left, pixel, sizeof(left));
+    std::memcpy(&right, pixel + 2, sizeof(right));
+    // B0 G0 R0 B1 R0 B1 G1 R1
+    const __m128i bytes = _mm_unpacklo_epi32(_mm_cvtsi32_si128(left), _mm_cvtsi32_si128(right));
+    const __m128i words = _mm_unpacklo_epi8(bytes, _mm_setzero_si128());
+    return _mm_unpacklo_epi16(words, _mm_srli_si128(words, 10));
+}
+#elif UNDISTORT_NEON
+/// Channels of the pixel at pixel in lanes 0-2 and of its right neighbour in
+/// lanes 5-7, read without touching the bytes behind the neighbour
+inline uint16x8_t loadPair(const uint8_t* pixel)
+{
+    uint32_t left;
+    uint32_t right;
+    std::memcpy(&left, pixel, sizeof(left));
+    std::memcpy(&right, pixel + 2, sizeof(right));
+    return vmovl_u8(vreinterpret_u8_u32(vset_lane_u32(right, vdup_n_u32(left), 1)));
+}
+#endif
+
+/// Bilinear remap of one row of a BGR frame, the channels of a pixel are
+/// interpolated together in one vector
+void remapRow(const uint8_t* frame, int stride, const int32_t* offsets, const cv::Vec2b* fractions, uint8_t* out, int width)
+{
+    for (int x = 0; x < width; ++x, out += 3) {
+        const int32_t offset = offsets[x];
+        if (offset < 0) {
+            out[0] = out[1] = out[2] = 0;
+            continue;
+        }
+        const int fractionX = fractions[x][0];
+        const int fractionY = fractions[x][1];
+        const int w00 = (fractionOne - fractionX) * (fractionOne - fractionY);
+        const int w01 = fractionX * (fractionOne - fractionY);
+        const int w10 = (fractionOne - fractionX) * fractionY;
+        const int w11 = fractionX * fractionY;
+        const uint8_t* top = frame + offset;
+        const uint8_t* bottom = top + stride;
+
+#if UNDISTORT_SSE2
+        const __m128i topWeights = _mm_set_epi16(0, 0, static_cast<int16_t>(w01), static_cast<int16_t>(w00), static_cast<int16_t>(w01),
+                                                 static_cast<int16_t>(w00), static_cast<int16_t>(w01), static_cast<int16_t>(w00));
+        const __m128i bottomWeights = _mm_set_epi16(0, 0, static_cast<int16_t>(w11), static_cast<int16_t>(w10), static_cast<int16_t>(w11),
+                                                    static_cast<int16_t>(w10), static_cast<int16_t>(w11), static_cast<int16_t>(w10));
+        __m128i sum = _mm_add_epi32(_mm_madd_epi16(loadPair(top), topWeights), _mm_madd_epi16(loadPair(bottom), bottomWeights));
+        sum = _mm_srli_epi32(_mm_add_epi32(sum, _mm_set1_epi32(1 << (weightBits - 1))), weightBits);
+        const __m128i words = _mm_packs_epi32(sum, sum);
+        const __m128i bytes = _mm_packus_epi16(words, words);
+        const int32_t value = _mm_cvtsi128_si32(bytes);
+        std::memcpy(out, &value, 3);
+#elif UNDISTORT_NEON
+        const uint16x8_t topPair = loadPair(top);
+        const uint16x8_t bottomPair = loadPair(bottom);
+        uint32x4_t sum = vmull_n_u16(vget_low_u16(topPair), static_cast<uint16_t>(w00));
+        sum = vmlal_n_u16(sum, vget_low_u16(vextq_u16(topPair, topPair, 5)), static_cast<uint16_t>(w01));
+        sum = vmlal_n_u16(sum, vget_low_u16(bottomPair), static_cast<uint16_t>(w10));
+        sum = vmlal_n_u16(sum, vget_low_u16(vextq_u16(bottomPair, bottomPair, 5)), static_cast<uint16_t>(w11));
+        const uint8x8_t bytes = vmovn_u16(vcombine_u16(vrshrn_n_u32(sum, weightBits), vdup_n_u16(0)));
+        const uint32_t value = vget_lane_u32(vreinterpret_u32_u8(bytes), 0);
+        std::memcpy(out, &value, 3);
+#else
+        for (int c = 0; c < 3; ++c) {
+            const int sum = top[c] * w00 + top[c + 3] * w01 + bottom[c] * w10 + bottom[c + 3] * w11;
+            out[c] = static_cast<uint8_t>((sum + (1 << (weightBits - 1))) >> weightBits);
+        }
+#endif
+    }
+}
+} // namespace
+
+bool Undistorter::update(const std::shared_ptr<const Intrinsics>& intrinsics, const cv::Size& size)
+{
+    if (!intrinsics) {
+        return false;
+    }
+    if (intrinsics == intrinsics_ && size == size_) {
+        return true;
+    }
+
+    // keep the camera matrix so the overlay projection matches the undistorted frame
+    cv::Mat map;
+    cv::Mat unused;
+    cv::initUndistortRectifyMap(intrinsics->CameraMatrix, intrinsics->DistortionCoefficients, cv::noArray(), intrinsics->CameraMatrix, size, CV_32FC2,
+                                map, unused);
+
+    offsets_.create(size, CV_32S);
+    fractions_.create(size, CV_8UC2);
+    const int stride = size.width * 3;
+    cv::parallel_for_(cv::Range(0, size.height), [this, &map, &size, stride](const cv::Range& rows) {
+        for (int y = rows.start; y < rows.end; ++y) {
+            const auto* positions = map.ptr<cv::Vec2f>(y);
+            auto* offsets = offsets_.ptr<int32_t>(y);
+            auto* fractions = fractions_.ptr<cv::Vec2b>(y);
+            for (int x = 0; x < size.width; ++x) {
+                const cv::Vec2f position = positions[x];
+                // both neighbours have to be inside, the comparisons also reject NaN
+                bool inside = position[0] >= 0.0f && position[1] >= 0.0f && position[0] < size.width - 1 && position[1] < size.height - 1;
+                const int fixedX = inside ? cvRound(position[0] * fractionOne) : 0;
+                const int fixedY = inside ? cvRound(position[1] * fractionOne) : 0;
+                const int sourceX = fixedX >> fractionBits;
+                const int sourceY = fixedY >> fractionBits;
+                // rounding may carry onto the last row or column
+                inside = inside && sourceX < size.width - 1 && sourceY < size.height - 1;
+                offsets[x] = inside ? sourceY * stride + sourceX * 3 : -1;
+                fractions[x] = cv::Vec2b(static_cast<uint8_t>(fixedX & (fractionOne - 1)), static_cast<uint8_t>(fixedY & (fractionOne - 1)));
+            }
+        }
+    }, size.height / stripeRows);
+
+    intrinsics_ = intrinsics;
+    size_ = size;
+    return true;
+}
+
+bool Undistorter::apply(const cv::Mat& frame, cv::Mat& undistorted) const
+{
+    if (offsets_.empty() || frame.type() != CV_8UC3 || frame.size() != size_ || !frame.isContinuous() || frame.data == undistorted.data) {
+        return false;
+    }
+    undistorted.create(size_, CV_8UC3);
+    const int stride = size_.width * 3;
+    cv::parallel_for_(cv::Range(0, size_.height), [this, &frame, &undistorted, stride](const cv::Range& rows) {
+        for (int y = rows.start; y < rows.end; ++y) {
+            remapRow(frame.data, stride, offsets_.ptr<int32_t>(y), fractions_.ptr<cv::Vec2b>(y), undistorted.ptr<uint8_t>(y), size_.width);
+        }
+    }, size_.height / stripeRows);
+    return true;
+}
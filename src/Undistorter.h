@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+
+#include <opencv2/core/mat.hpp>
+
+#include "CalibrationWorker.h"
+
+/// Removes the lens distortion from camera frames before they are shown, so
+/// the background matches the pinhole projection the overlay is drawn with.
+/// The maps are built once per intrinsics snapshot in a compact fixed-point
+/// form: the byte offset of the top left source pixel and 7 bit fractions in
+/// x and y, 6 bytes per pixel. Frames are then remapped bilinearly with
+/// SSE2/NEON where available, split over all cores in stripes of rows.
+class Undistorter
+{
+public:
+    /// Rebuild the maps if intrinsics is another snapshot than the maps were
+    /// built from or size changed. The undistorted frame keeps the camera
+    /// matrix, so Intrinsics::ProjMat stays valid for it. Returns false
+    /// without intrinsics.
+    bool update(const std::shared_ptr<const Intrinsics>& intrinsics, const cv::Size& size);
+    /// Remap a continuous CV_8UC3 frame of the map size into undistorted,
+    /// which is only allocated when its size changes. Pixels which map outside
+    /// the frame are black. Returns false if frame does not fit the maps or
+    /// shares its data with undistorted.
+    bool apply(const cv::Mat& frame, cv::Mat& undistorted) const;
+
+private:
+    /// Snapshot the maps were built from, held so its address is not reused
+    std::shared_ptr<const Intrinsics> intrinsics_;
+    cv::Size size_;
+    /// Byte offset of the top left source pixel of every pixel (CV_32S), -1 outside
+    cv::Mat offsets_;
+    /// Fractions of the source position in x and y (CV_8UC2)
+    cv::Mat fractions_;
+};
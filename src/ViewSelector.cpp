@@ -0,0 +1,98 @@
+#include "ViewSelector.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include <opencv2/calib3d.hpp>
+#include <opencv2/imgproc.hpp>
+
+ViewSelector::Features ViewSelector::describe(const std::vector<cv::Vec3f>& objectPoints, const std::vector<cv::Point2f>& imagePoints,
+                                              const cv::Size& imageSize)
+{
+    Features features = Features::zeros();
+    if (imagePoints.size() < 4 || objectPoints.size() != imagePoints.size() || imageSize.area() == 0) {
+        return features;
+    }
+    const double width = imageSize.width;
+    const double height = imageSize.height;
+
+    std::vector<cv::Point2f> planarPoints;
+    planarPoints.reserve(objectPoints.size());
+    for (const auto& point : objectPoints) {
+        planarPoints.emplace_back(point[0], point[1]);
+    }
+    const cv::Mat homography = cv::findHomography(planarPoints, imagePoints);
+    if (!homography.empty()) {
+        // the intrinsics are what is being calibrated, a camera with a field
+        // of view of about 50 degrees is close enough to tell tilts apart
+        const double focal = std::max(width, height);
+        const cv::Matx33d inverseCamera(1.0 / focal, 0.0, -0.5 * width / focal, 0.0, 1.0 / focal, -0.5 * height / focal, 0.0, 0.0, 1.0);
+        const cv::Matx33d h = inverseCamera * cv::Matx33d(homography);
+        const cv::Vec3d xAxis(h(0, 0), h(1, 0), h(2, 0));
+        const cv::Vec3d yAxis(h(0, 1), h(1, 1), h(2, 1));
+        cv::Vec3d normal = cv::normalize(xAxis).cross(cv::normalize(yAxis));
+        // the sign of the homography cancels in the cross product, but a board
+        // seen from behind or a corner order which mirrors its axes turns the
+        // normal away, let it face the camera
+        if (normal[2] > 0.0) {
+            normal = -normal;
+        }
+        normal = cv::normalize(normal);
+        features[0] = normal[0];
+        features[1] = normal[1];
+    }
+
+    cv::Point2f center(0.0f, 0.0f);
+    for (const auto& point : imagePoints) {
+        center += point;
+    }
+    center *= 1.0f / static_cast<float>(imagePoints.size());
+    features[2] = center.x / width - 0.5;
+    features[3] = center.y / height - 0.5;
+
+    std::vector<cv::Point2f> hull;
+    cv::convexHull(imagePoints, hull);
+    features[4] = std::sqrt(cv::contourArea(hull) / (width * height));
+    return features;
+}
+
+std::vector<size_t> ViewSelector::select(const std::vector<Features>& features, size_t budget, double minDistance)
+{
+    const size_t count = features.size();
+    if (budget == 0 || budget > count) {
+        budget = count;
+    }
+    std::vector<size_t> selected;
+    if (count == 0) {
+        return selected;
+    }
+    selected.reserve(budget);
+
+    // start from the view covering most of the image, it constrains the distortion best
+    size_t next = 0;
+    for (size_t i = 1; i < count; ++i) {
+        if (features[i][4] > features[next][4]) {
+            next = i;
+        }
+    }
+    // squared distance of every view to the closest chosen one
+    std::vector<double> distances(count, std::numeric_limits<double>::max());
+    const double minSquaredDistance = minDistance * minDistance;
+    while (true) {
+        selected.push_back(next);
+        distances[next] = 0.0;
+        if (selected.size() >= budget) {
+            break;
+        }
+        for (size_t i = 0; i < count; ++i) {
+            distances[i] = std::min(distances[i], cv::norm(features[i] - features[next], cv::NORM_L2SQR));
+        }
+        next = static_cast<size_t>(std::max_element(distances.begin(), distances.end()) - distances.begin());
+        if (distances[next] == 0.0 || (distances[next] < minSquaredDistance && selected.size() >= minViews)) {
+            break;
+        }
+    }
+    std::sort(selected.begin(), selected.end());
+    return selected;
+}
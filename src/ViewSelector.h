@@ -0,0 +1,30 @@
+#pragma once
+
+#include <vector>
+
+#include <opencv2/core/mat.hpp>
+#include <opencv2/core/matx.hpp>
+
+/// Picks a diverse subset of calibration views so cv::calibrateCamera doesn't
+/// pay for near duplicates. Every view is described by the tilt of the board,
+/// estimated from its homography with a rough pinhole camera, and by where and
+/// how large the board appears in the image. Views are then chosen greedily,
+/// always taking the one farthest from everything chosen so far, which makes
+/// every chosen view the center of a cluster of views similar to it.
+class ViewSelector
+{
+public:
+    /// Board normal x and y, board center x and y relative to the image
+    /// center and square root of the image fraction the board covers
+    using Features = cv::Vec<double, 5>;
+
+    /// Describe a view of a planar (z = 0) board
+    static Features describe(const std::vector<cv::Vec3f>& objectPoints, const std::vector<cv::Point2f>& imagePoints, const cv::Size& imageSize);
+    /// Indices of the chosen views in ascending order. Stops at budget views
+    /// (0 for no limit) or once every remaining view is closer than
+    /// minDistance to a chosen one, but keeps at least minViews.
+    static std::vector<size_t> select(const std::vector<Features>& features, size_t budget, double minDistance);
+
+    /// Views kept even if they are redundant, fewer don't calibrate reliably
+    static constexpr size_t minViews = 3;
+};
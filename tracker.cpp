@@ -0,0 +1,497 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cmath>
+#include <cstdlib>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "Calibration.h"
+#include "FrameCache.h"
+#include "FrameSource.h"
+#include "IntrinsicsStore.h"
+#include "LatencyStats.h"
+#include "PatternDetector.h"
+#include "RigCalibration.h"
+#include "Tracker.h"
+
+/// Headless tracking: capture -> detect -> pose without any window or GL
+/// context. Poses are written as CSV so this runs on display-less servers and
+/// measures the pure CPU cost of the tracking core per frame.
+/// Every source is tracked on its own threads. With several sources on a rig,
+/// boards seen by more than one camera at once calibrate the poses of the
+/// cameras relative to the first one, and with those the board poses of all
+/// cameras are fused into one.
+
+/// Inner corners of the default chessboard
+const cv::Size defaultPatternSize = cv::Size(6, 9);
+/// Levenberg-Marquardt iterations of the rig calibration
+constexpr uint32_t rigIterations = 100;
+/// Pixels the corner by corner distance of a detector may exceed the distance
+/// to the nearest reference corners before its order counts as different
+constexpr double orderMismatchPx = 1.0;
+
+void printUsage(const char* program) {
+    std::fprintf(stderr,
+                 "Usage: %s [sources...] [--unthrottled] [--fps N] [--calibration DIR]... [--output FILE] [--latency-dump FILE]\n"
+                 "          [--record FILE]... [--start-frame N] [--coarse-scale S]\n"
+                 "          [--flow-interval N] [--min-sharpness X] [--intrinsics FILE] [--detector NAME] [--pattern WxH] [--compare-detectors]\n"
+                 "          [--view-budget N] [--compare-views] [--solver NAME] [--rig-calibrate FILE] [--rig FILE] [--rig-max-skew MS]\n"
+                 "  sources            camera indices, video files, image sequences (frame%%04d.png)\n"
+                 "                     or raw recordings (.cvraw)\n"
+                 "  --unthrottled      replay recorded sources as fast as possible\n"
+                 "  --fps N            frame rate of image sequences (default 30)\n"
+                 "  --calibration DIR  load calibN.png images from DIR to compute the intrinsics,\n"
+                 "                     given once for all sources or once per source in order\n"
+                 "  --output FILE      write poses to FILE instead of stdout\n"
+                 "  --latency-dump FILE write per-stage latency percentiles as JSON to FILE\n"
+                 "  --record FILE      record the raw frames of the sources in order to .cvraw files\n"
+                 "  --start-frame N    start replaying recorded sources at frame N\n"
+                 "  --coarse-scale S   detect on a copy downscaled by S, refine at full resolution\n"
+                 "  --flow-interval N  follow the board with optical flow for N frames between detections\n"
+                 "  --min-sharpness X  skip frames with a Laplacian variance below X, 0 searches every frame\n"
+                 "  --intrinsics FILE  store of calibrated intrinsics per camera and resolution, loaded at start\n"
+                 "                     and updated by every calibration (default intrinsics.store, \"\" for none)\n"
+                 "  --detector NAME    pattern detector: chessboard (default), chessboard-sb, circles,\n"
+                 "                     asymmetric-circles or saddle\n"
+                 "  --pattern WxH      inner corners or circles per row and column (default 6x9)\n"
+                 "  --compare-detectors run every chessboard detector on every frame of the sources and\n"
+                 "                     report their cost, distance to the OpenCV chessboard corners and\n"
+                 "                     frames with the corners in another order\n"
+                 "  --view-budget N    calibrate from at most N diverse views, 0 uses every view\n"
+                 "  --compare-views    report time and reprojection error of all against the selected views\n"
+                 "  --solver NAME      calibration solver: sparse (default) or opencv\n"
+                 "  --rig-calibrate FILE calibrate the poses of all cameras relative to the first one from\n"
+                 "                     boards they see at the same time and write them to FILE\n"
+                 "  --rig FILE         fuse the board poses of all cameras with the camera poses in FILE into\n"
+                 "                     extra rows of camera \"rig\", in the frame of the first camera\n"
+                 "  --rig-max-skew MS  largest capture time difference of live frames taken as simultaneous\n"
+                 "                     (default 10), recorded sources are matched by frame number\n",
+                 program);
+}
+
+/// Run every chessboard detector backend on the same frames, as fast as the
+/// sources can be read, and report detection rate, time per frame, the mean
+/// distance of the corners to the same corners of cv::findChessboardCorners
+/// and how often they come in another order
+int compareDetectors(const std::vector<std::string>& videoSourceUris, double sequenceFps, const cv::Size& patternSize, float coarseScale)
+{
+    using Milliseconds = std::chrono::duration<double, std::milli>;
+    const PatternDetector::Type types[] = {PatternDetector::Type::Chessboard, PatternDetector::Type::ChessboardSB, PatternDetector::Type::SaddlePoint};
+    struct Comparison {
+        std::unique_ptr<PatternDetector> Detector;
+        std::vector<cv::Point2f> Points;
+        bool Found = false;
+        uint64_t Detected = 0;
+        double Ms = 0.0;
+        /// frames both this detector and the reference found the board on
+        uint64_t Matched = 0;
+        /// mean distance of every corner to the reference corner of the same index
+        double Distance = 0.0;
+        /// frames with the corners in another order or number than the reference
+        uint64_t OrderMismatches = 0;
+    };
+    for (const auto& uri : videoSourceUris) {
+        auto source = FrameSource::create(uri, FrameSource::Pacing::Unthrottled, sequenceFps);
+        if (!source) {
+            return EXIT_FAILURE;
+        }
+        std::vector<Comparison> comparisons(std::size(types));
+        for (size_t i = 0; i < comparisons.size(); ++i) {
+            comparisons[i].Detector = PatternDetector::create(types[i], patternSize);
+        }
+        FrameCache frame;
+        const FrameCache::Options options{coarseScale, 0, cv::Size(), false};
+        cv::Mat image;
+        FrameSource::Clock::time_point captureTime;
+        uint64_t frames = 0;
+        while (source->read(image, captureTime)) {
+            frame.update(image, options);
+            const cv::Rect bounds(0, 0, image.cols, image.rows);
+            for (auto& comparison : comparisons) {
+                auto start = std::chrono::steady_clock::now();
+                comparison.Found = comparison.Detector->detect(frame, bounds, true, comparison.Points);
+                comparison.Ms += Milliseconds(std::chrono::steady_clock::now() - start).count();
+                comparison.Detected += comparison.Found ? 1 : 0;
+            }
+            // corner i has to match reference corner i, solvePnP gets a wrong pose
+            // otherwise. Only the reversed order of the 180 degree symmetric board is
+            // accepted. Frames whose corners agree but are ordered differently are
+            // counted as order mismatches.
+            const auto& reference = comparisons.front();
+            for (auto& comparison : comparisons) {
+                if (!reference.Found || !comparison.Found) {
+                    continue;
+                }
+                const size_t count = comparison.Points.size();
+                if (count != reference.Points.size() || count == 0) {
+                    ++comparison.OrderMismatches;
+                    continue;
+                }
+                double forward = 0.0;
+                double reversed = 0.0;
+                double nearest = 0.0;
+                for (size_t i = 0; i < count; ++i) {
+                    const cv::Point2f& point = comparison.Points[i];
+                    forward += cv::norm(point - reference.Points[i]);
+                    reversed += cv::norm(point - reference.Points[count - 1 - i]);
+                    float closest = std::numeric_limits<float>::max();
+                    for (const auto& referencePoint : reference.Points) {
+                        const cv::Point2f offset = point - referencePoint;
+                        closest = std::min(closest, offset.dot(offset));
+                    }
+                    nearest += std::sqrt(closest);
+                }
+                const double distance = std::min(forward, reversed) / count;
+                if (distance > nearest / count + orderMismatchPx) {
+                    ++comparison.OrderMismatches;
+                }
+                comparison.Distance += distance;
+                ++comparison.Matched;
+            }
+            ++frames;
+        }
+        if (frames == 0) {
+            continue;
+        }
+        std::fprintf(stderr, "%s: %llu frames\n", source->getName().c_str(), static_cast<unsigned long long>(frames));
+        std::fprintf(stderr, "  %-20s %10s %10s %14s %16s\n", "detector", "detected", "ms/frame", "distance (px)", "order mismatches");
+        for (const auto& comparison : comparisons) {
+            std::fprintf(stderr, "  %-20s %10llu %10.3f %14.4f %16llu\n", PatternDetector::getTypeName(comparison.Detector->getType()),
+                         static_cast<unsigned long long>(comparison.Detected), comparison.Ms / frames,
+                         comparison.Matched > 0 ? comparison.Distance / comparison.Matched : 0.0,
+                         static_cast<unsigned long long>(comparison.OrderMismatches));
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char* argv[]) {
+    std::vector<std::string> videoSourceUris;
+    auto pacing = FrameSource::Pacing::RealTime;
+    double sequenceFps = 30.0;
+    std::vector<std::string> calibrationDirectories;
+    std::string outputPath;
+    std::string latencyDumpPath;
+    // raw recordings of the sources in order, see FrameRecorder
+    std::vector<std::string> recordingPaths;
+    uint64_t startFrame = 0;
+    // downscale factor of the coarse detection pass, 1 detects at full resolution
+    float coarseScale = 1.0f;
+    // frames followed with optical flow between detections, 0 detects every frame
+    uint32_t flowInterval = 0;
+    // Laplacian variance below which frames are skipped, 0 searches every frame and
+    // negative keeps the default
+    float minSharpness = -1.0f;
+    // intrinsics of every camera seen before, loaded at start and updated by every calibration
+    std::string intrinsicsPath(IntrinsicsStoreDefaultPath);
+    // most views calibrated from, 0 uses every view
+    int viewBudget = -1;
+    bool compareViews = false;
+    auto solver = CalibrationWorker::Solver::Sparse;
+    // camera poses of a rig, calibrated during the run or loaded for fusing
+    std::string rigCalibrationPath;
+    std::string rigPath;
+    double rigMaxSkewMs = 10.0;
+    auto detectorType = PatternDetector::Type::Chessboard;
+    cv::Size patternSize = defaultPatternSize;
+    bool compare = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg = argv[i];
+        if (arg == "--unthrottled") {
+            pacing = FrameSource::Pacing::Unthrottled;
+        } else if (arg == "--fps" && i + 1 < argc) {
+            sequenceFps = std::stod(argv[++i]);
+        } else if (arg == "--calibration" && i + 1 < argc) {
+            calibrationDirectories.emplace_back(argv[++i]);
+        } else if (arg == "--output" && i + 1 < argc) {
+            outputPath = argv[++i];
+        } else if (arg == "--latency-dump" && i + 1 < argc) {
+            latencyDumpPath = argv[++i];
+        } else if (arg == "--record" && i + 1 < argc) {
+            recordingPaths.emplace_back(argv[++i]);
+        } else if (arg == "--start-frame" && i + 1 < argc) {
+            startFrame = std::stoull(argv[++i]);
+        } else if (arg == "--coarse-scale" && i + 1 < argc) {
+            coarseScale = std::stof(argv[++i]);
+        } else if (arg == "--flow-interval" && i + 1 < argc) {
+            flowInterval = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (arg == "--min-sharpness" && i + 1 < argc) {
+            minSharpness = std::stof(argv[++i]);
+        } else if (arg == "--intrinsics" && i + 1 < argc) {
+            intrinsicsPath = argv[++i];
+        } else if (arg == "--view-budget" && i + 1 < argc) {
+            viewBudget = std::stoi(argv[++i]);
+        } else if (arg == "--compare-views") {
+            compareViews = true;
+        } else if (arg == "--solver" && i + 1 < argc) {
+            if (!CalibrationWorker::parseSolver(argv[++i], solver)) {
+                std::fprintf(stderr, "Unknown solver %s\n", argv[i]);
+                return EXIT_FAILURE;
+            }
+        } else if (arg == "--rig-calibrate" && i + 1 < argc) {
+            rigCalibrationPath = argv[++i];
+        } else if (arg == "--rig" && i + 1 < argc) {
+            rigPath = argv[++i];
+        } else if (arg == "--rig-max-skew" && i + 1 < argc) {
+            rigMaxSkewMs = std::stod(argv[++i]);
+        } else if (arg == "--detector" && i + 1 < argc) {
+            if (!PatternDetector::parseType(argv[++i], detectorType)) {
+                std::fprintf(stderr, "Unknown detector %s\n", argv[i]);
+                return EXIT_FAILURE;
+            }
+        } else if (arg == "--pattern" && i + 1 < argc) {
+            if (std::sscanf(argv[++i], "%dx%d", &patternSize.width, &patternSize.height) != 2 || patternSize.width < 2 || patternSize.height < 2) {
+                std::fprintf(stderr, "Invalid pattern size %s, expected WxH\n", argv[i]);
+                return EXIT_FAILURE;
+            }
+        } else if (arg == "--compare-detectors") {
+            compare = true;
+        } else if (arg == "--help" || arg == "-h") {
+            printUsage(argv[0]);
+            return EXIT_SUCCESS;
+        } else {
+            videoSourceUris.emplace_back(arg);
+        }
+    }
+    if (videoSourceUris.empty()) {
+        videoSourceUris.emplace_back("0");
+    }
+    if (compare) {
+        return compareDetectors(videoSourceUris, sequenceFps, patternSize, coarseScale);
+    }
+
+    float squareSideLengthM = 0.023;
+    std::vector<std::unique_ptr<Tracker>> trackers;
+    bool replay = false;
+    for (size_t i = 0; i < videoSourceUris.size(); ++i) {
+        auto source = FrameSource::create(videoSourceUris[i], pacing, sequenceFps);
+        if (source && startFrame > 0 && !source->seek(startFrame)) {
+            std::fprintf(stderr, "Could not seek %s to frame %llu\n", videoSourceUris[i].c_str(), static_cast<unsigned long long>(startFrame));
+        }
+        auto tracker = Tracker::create(std::move(source), patternSize, squareSideLengthM);
+        if (!tracker) {
+            return EXIT_FAILURE;
+        }
+        if (i < recordingPaths.size() && !tracker->startRecording(recordingPaths[i])) {
+            return EXIT_FAILURE;
+        }
+        {
+            auto lock = tracker->lockCalibration();
+            tracker->getCalibration().SetIntrinsicsStore(intrinsicsPath, tracker->getSource().getName());
+            tracker->getCalibration().SetDetector(detectorType, patternSize);
+            tracker->getCalibration().CoarseScale = coarseScale;
+            tracker->getCalibration().Solver = solver;
+            tracker->getCalibration().FlowTracking = flowInterval > 0;
+            if (flowInterval > 0) {
+                tracker->getCalibration().FlowRedetectInterval = flowInterval;
+            }
+            if (minSharpness >= 0.0f) {
+                tracker->getCalibration().QualityGating = minSharpness > 0.0f;
+                tracker->getCalibration().MinSharpness = minSharpness;
+            }
+            if (viewBudget >= 0) {
+                tracker->getCalibration().ViewSelection = viewBudget > 0;
+                tracker->getCalibration().ViewBudget = static_cast<uint32_t>(viewBudget);
+            }
+        }
+        if (!calibrationDirectories.empty()) {
+            const auto& directory = calibrationDirectories[std::min(i, calibrationDirectories.size() - 1)];
+            auto lock = tracker->lockCalibration();
+            tracker->getCalibration().LoadFromDirectory(directory);
+            if (compareViews) {
+                tracker->getCalibration().CompareViewSelection();
+                tracker->getCalibration().WaitForCalibration();
+            }
+            if (!tracker->getCalibration().GetIntrinsics()) {
+                std::fprintf(stderr, "Could not calibrate %s from %s, only detections will be written\n", videoSourceUris[i].c_str(), directory.c_str());
+            }
+        }
+        replay = replay || !tracker->getSource().isLive();
+        trackers.emplace_back(std::move(tracker));
+    }
+
+    std::unique_ptr<RigCalibration> rig;
+    if (!rigCalibrationPath.empty()) {
+        if (trackers.size() < 2) {
+            std::fprintf(stderr, "Rig calibration needs at least two sources\n");
+            return EXIT_FAILURE;
+        }
+        auto lock = trackers[0]->lockCalibration();
+        rig = std::make_unique<RigCalibration>(trackers.size(), trackers[0]->getCalibration().GetObjectPoints());
+    }
+    std::vector<RigCalibration::Pose> rigExtrinsics;
+    std::vector<cv::Vec3f> rigObjectPoints;
+    if (!rigPath.empty()) {
+        std::vector<std::string> rigNames;
+        if (!RigCalibration::load(rigPath, rigNames, rigExtrinsics)) {
+            return EXIT_FAILURE;
+        }
+        if (rigExtrinsics.size() != trackers.size()) {
+            std::fprintf(stderr, "%s holds %zu cameras but %zu sources are tracked\n", rigPath.c_str(), rigExtrinsics.size(), trackers.size());
+            return EXIT_FAILURE;
+        }
+        auto lock = trackers[0]->lockCalibration();
+        rigObjectPoints = trackers[0]->getCalibration().GetObjectPoints();
+    }
+
+    FILE* output = stdout;
+    if (!outputPath.empty()) {
+        output = std::fopen(outputPath.c_str(), "w");
+        if (output == nullptr) {
+            std::fprintf(stderr, "Could not open %s for writing\n", outputPath.c_str());
+            return EXIT_FAILURE;
+        }
+    }
+    std::fprintf(output, "camera,frame,capture_ms,detected,pose,rx,ry,rz,tx,ty,tz,sharpness,clipped\n");
+
+    using Clock = std::chrono::steady_clock;
+    using Milliseconds = std::chrono::duration<double, std::milli>;
+    struct Totals {
+        uint64_t Frames = 0;
+        uint64_t Detected = 0;
+        double DetectMs = 0.0;
+        double PoseMs = 0.0;
+    };
+    std::vector<Totals> totals(trackers.size());
+    std::vector<LatencyStats> latencies(trackers.size());
+    // results of the current round per source, null if it had none
+    std::vector<Tracker::Result*> roundResults(trackers.size());
+    std::vector<std::vector<cv::Point2f>> rigPoints(trackers.size());
+    std::vector<std::optional<RigCalibration::Pose>> rigPoses(trackers.size());
+    auto loopStart = Clock::now();
+    bool allFinished = false;
+    while (!allFinished) {
+        allFinished = true;
+        bool anyResult = false;
+        for (size_t i = 0; i < trackers.size(); ++i) {
+            // replays are waited for so no result is dropped
+            auto result = trackers[i]->acquireLatest(replay);
+            allFinished = allFinished && trackers[i]->isFinished();
+            roundResults[i] = result;
+            if (result == nullptr) {
+                continue;
+            }
+            anyResult = true;
+
+            cv::Vec3d rotation = result->PoseValid ? result->RotationVector : cv::Vec3d();
+            cv::Vec3d translation = result->PoseValid ? result->TranslationVector : cv::Vec3d();
+            std::fprintf(output, "%zu,%llu,%.3f,%d,%d,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f,%.2f,%.4f\n", i, static_cast<unsigned long long>(result->Index),
+                         Milliseconds(result->Timing.Capture - loopStart).count(), result->Detected ? 1 : 0, result->PoseValid ? 1 : 0, rotation[0], rotation[1],
+                         rotation[2], translation[0], translation[1], translation[2], result->Quality.Sharpness, result->Quality.ClippedRatio);
+            totals[i].Frames += 1;
+            totals[i].Detected += result->Detected ? 1 : 0;
+            totals[i].DetectMs += Milliseconds(result->Timing.DetectEnd - result->Timing.DetectStart).count();
+            totals[i].PoseMs += Milliseconds(result->Timing.PoseEnd - result->Timing.DetectEnd).count();
+            latencies[i].record(result->Timing);
+        }
+        if (anyResult && (rig || !rigExtrinsics.empty())) {
+            // recordings advance in lockstep and must show the same frame,
+            // live cameras must have captured close enough to each other
+            bool synchronized = true;
+            const Tracker::Result* first = nullptr;
+            for (const auto* result : roundResults) {
+                if (result == nullptr) {
+                    continue;
+                }
+                if (first == nullptr) {
+                    first = result;
+                } else if (replay) {
+                    synchronized = synchronized && result->Index == first->Index;
+                } else {
+                    synchronized = synchronized && std::abs(Milliseconds(result->Timing.Capture - first->Timing.Capture).count()) <= rigMaxSkewMs;
+                }
+            }
+            if (synchronized && rig) {
+                for (size_t i = 0; i < trackers.size(); ++i) {
+                    rigPoints[i].clear();
+                    if (roundResults[i] != nullptr && roundResults[i]->Detected) {
+                        rigPoints[i] = roundResults[i]->Corners;
+                    }
+                }
+                rig->addObservation(rigPoints);
+            }
+            if (synchronized && !rigExtrinsics.empty()) {
+                for (size_t i = 0; i < trackers.size(); ++i) {
+                    rigPoses[i].reset();
+                    if (roundResults[i] != nullptr && roundResults[i]->PoseValid) {
+                        rigPoses[i] = RigCalibration::Pose{roundResults[i]->RotationVector, roundResults[i]->TranslationVector};
+                    }
+                }
+                RigCalibration::Pose fused;
+                if (RigCalibration::fusePoses(rigExtrinsics, rigPoses, rigObjectPoints, fused)) {
+                    std::fprintf(output, "rig,%llu,%.3f,1,1,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f,,\n", static_cast<unsigned long long>(first->Index),
+                                 Milliseconds(first->Timing.Capture - loopStart).count(), fused.RotationVector[0], fused.RotationVector[1],
+                                 fused.RotationVector[2], fused.TranslationVector[0], fused.TranslationVector[1], fused.TranslationVector[2]);
+                }
+            }
+        }
+        if (!anyResult && !allFinished && !replay) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+    if (!replay) {
+        std::fprintf(stderr, "Camera returned an empty frame... Quitting.\n");
+    }
+    if (output != stdout) {
+        std::fclose(output);
+    }
+
+    double seconds = std::chrono::duration<double>(Clock::now() - loopStart).count();
+    if (rig) {
+        std::vector<std::shared_ptr<const Intrinsics>> intrinsics;
+        std::vector<std::string> names;
+        for (const auto& tracker : trackers) {
+            auto lock = tracker->lockCalibration();
+            intrinsics.push_back(tracker->getCalibration().GetIntrinsics());
+            names.push_back(tracker->getSource().getName());
+        }
+        const auto start = Clock::now();
+        if (!rig->calibrate(intrinsics, rigIterations) || !rig->save(rigCalibrationPath, names)) {
+            return EXIT_FAILURE;
+        }
+        std::fprintf(stderr, "Calibrated the rig from %zu observations in %.1f ms, reprojection error %.3f px\n", rig->getObservationCount(),
+                     Milliseconds(Clock::now() - start).count(), rig->getError());
+        for (size_t i = 1; i < trackers.size(); ++i) {
+            const auto& extrinsics = rig->getExtrinsics()[i];
+            std::fprintf(stderr, "%s: rotation %.5f %.5f %.5f, translation %.5f %.5f %.5f m\n", names[i].c_str(), extrinsics.RotationVector[0],
+                         extrinsics.RotationVector[1], extrinsics.RotationVector[2], extrinsics.TranslationVector[0], extrinsics.TranslationVector[1],
+                         extrinsics.TranslationVector[2]);
+        }
+    }
+    for (size_t i = 0; i < trackers.size(); ++i) {
+        if (totals[i].Frames == 0) {
+            continue;
+        }
+        std::fprintf(stderr,
+                     "Processed %llu frames (%llu detected) from %s in %.3f s: %.2f fps\n"
+                     "CPU per frame: detect %.3f ms, pose %.3f ms, %llu dropped\n",
+                     static_cast<unsigned long long>(totals[i].Frames), static_cast<unsigned long long>(totals[i].Detected), trackers[i]->getSource().getName().c_str(),
+                     seconds, totals[i].Frames / seconds, totals[i].DetectMs / totals[i].Frames, totals[i].PoseMs / totals[i].Frames,
+                     static_cast<unsigned long long>(trackers[i]->getDroppedFrames()));
+        auto endToEnd = latencies[i].get(LatencyStats::EndToEnd);
+        std::fprintf(stderr, "Capture to pose latency: p50 %.3f ms, p95 %.3f ms, p99 %.3f ms\n", endToEnd.P50, endToEnd.P95, endToEnd.P99);
+    }
+
+    if (!latencyDumpPath.empty()) {
+        FILE* dump = std::fopen(latencyDumpPath.c_str(), "w");
+        if (dump == nullptr) {
+            std::fprintf(stderr, "Could not open %s for writing\n", latencyDumpPath.c_str());
+            return EXIT_FAILURE;
+        }
+        std::fprintf(dump, "[");
+        for (size_t i = 0; i < trackers.size(); ++i) {
+            std::fprintf(dump, i == 0 ? "\n  " : ",\n  ");
+            latencies[i].dump(dump, trackers[i]->getSource().getName().c_str());
+        }
+        std::fprintf(dump, "\n]\n");
+        std::fclose(dump);
+    }
+    return replay ? EXIT_SUCCESS : EXIT_FAILURE;
+}